@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+# zygote.py - Ouroboros exemplary preloader (fork-server)
+#
+# Preloader imports stable dependencies once and waits for fork requests
+# on the control socket passed via the OUROBOROS_ZYGOTE_FD environment
+# variable. Every request is a "FORK" string followed by NUL-terminated
+# command line arguments, and it carries three file descriptors (standard
+# input, output and error) for the new worker. The response is the worker
+# PID as a decimal number. Preloader runs in its own process group, and the
+# worker shall join the process group of ouroboros (the preloader parent),
+# so it can be killed without killing the preloader.
+#
+# Usage (ouroboros.conf):
+#   zygote = ["python3", "zygote.py"];
+#   zygote-invalidate = ["requirements\\.txt$"];
+
+import os
+import runpy
+import socket
+import sys
+
+# preload stable (and expensive) dependencies here
+import http.server  # noqa: F401
+import json  # noqa: F401
+
+sock = socket.socket(fileno=int(os.environ.pop("OUROBOROS_ZYGOTE_FD")))
+pgid = os.getpgid(os.getppid())
+
+while True:
+    try:
+        msg, fds, _, _ = socket.recv_fds(sock, 4096, 3)
+    except ConnectionError:
+        break
+    if not msg:
+        break
+
+    argv = [x.decode() for x in msg.split(b"\0")[1:-1]]
+    pid = os.fork()
+
+    if pid == 0:
+        os.setpgid(0, pgid)
+        for i, fd in enumerate(fds):
+            os.dup2(fd, i)
+            os.close(fd)
+        sock.close()
+        sys.argv = argv
+        runpy.run_path(argv[0], run_name="__main__")
+        sys.exit(0)
+
+    for fd in fds:
+        os.close(fd)
+    sock.send(str(pid).encode())
+
+    # reap terminated workers
+    try:
+        while os.waitpid(-1, os.WNOHANG)[0] > 0:
+            pass
+    except ChildProcessError:
+        pass
@@ -0,0 +1,316 @@
+/*
+ * ouroboros - agent.c
+ * Copyright (c) 2015 Arkadiusz Bokowy
+ *
+ * This file is a part of a ouroboros.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+#define _GNU_SOURCE
+#include "agent.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/un.h>
+
+#include "config.h"
+#include "debug.h"
+#include "server.h"
+
+
+/* Internal function which connects datagram socket to the given target. The
+ * target is either the Unix domain socket path (it has to contain a slash)
+ * or the "host[:port]" string. Upon error this function returns -1. */
+static int _connect(const char *target) {
+
+	struct addrinfo hints = { 0 };
+	struct addrinfo *res, *ai;
+	char *host, *port;
+	int fd = -1;
+	int rv;
+
+	if (strchr(target, '/') != NULL) {
+
+		struct sockaddr_un addr = { 0 };
+
+		if (strlen(target) >= sizeof(addr.sun_path)) {
+			fprintf(stderr, "error: socket path too long: %s\n", target);
+			return -1;
+		}
+
+		addr.sun_family = AF_UNIX;
+		strcpy(addr.sun_path, target);
+
+		if ((fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0)) == -1)
+			return -1;
+		/* autobind, so the server will be able to send us replies */
+		if (bind(fd, (struct sockaddr *)&addr, sizeof(sa_family_t)) == -1 ||
+				connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+			close(fd);
+			return -1;
+		}
+
+		return fd;
+	}
+
+	if ((host = strdup(target)) == NULL)
+		return -1;
+	if ((port = strrchr(host, ':')) != NULL)
+		*port++ = '\0';
+
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+
+	if ((rv = getaddrinfo(host, port != NULL ? port : "3945", &hints, &res)) != 0) {
+		fprintf(stderr, "error: unable to resolve %s: %s\n", target, gai_strerror(rv));
+		free(host);
+		errno = EHOSTUNREACH;
+		return -1;
+	}
+
+	for (ai = res; ai != NULL; ai = ai->ai_next) {
+		if ((fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC | SOCK_NONBLOCK,
+						ai->ai_protocol)) == -1)
+			continue;
+		if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+			break;
+		close(fd);
+		fd = -1;
+	}
+
+	freeaddrinfo(res);
+	free(host);
+	return fd;
+}
+
+/* Internal function which draws the origin of events. */
+static void _origin(char *origin, size_t size) {
+
+	unsigned char tmp[8];
+	size_t i;
+	int fd;
+
+	if ((fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC)) == -1 ||
+			read(fd, tmp, sizeof(tmp)) != sizeof(tmp)) {
+		/* not so random, but good enough for telling instances apart */
+		unsigned long long value = ((unsigned long long)time(NULL) << 22) ^ getpid();
+		memcpy(tmp, &value, sizeof(tmp));
+	}
+	if (fd != -1)
+		close(fd);
+
+	for (i = 0; i < sizeof(tmp) && 2 * i + 2 < size; i++)
+		sprintf(&origin[2 * i], "%02x", tmp[i]);
+
+}
+
+/* Initialize agent which forwards events to given targets. This function
+ * returns pointer to the initialized agent structure or NULL upon error. */
+struct ouroboros_agent *ouroboros_agent_init(char **targets) {
+
+	struct ouroboros_agent *agent;
+	int fd;
+
+	if ((agent = malloc(sizeof(struct ouroboros_agent))) == NULL)
+		return NULL;
+
+	agent->fds = NULL;
+	agent->fds_size = 0;
+	agent->seq = 0;
+	agent->pending = NULL;
+	agent->size = 0;
+	agent->sent = 0;
+
+	_origin(agent->origin, sizeof(agent->origin));
+	debug("agent origin: %s", agent->origin);
+
+	for (; targets != NULL && *targets != NULL; targets++) {
+		debug("agent target: %s", *targets);
+		if ((fd = _connect(*targets)) == -1) {
+			fprintf(stderr, "error: unable to connect agent to %s: %s\n",
+					*targets, strerror(errno));
+			ouroboros_agent_free(agent);
+			return NULL;
+		}
+		if (ouroboros_config_add_int(&agent->fds, fd) == -1) {
+			close(fd);
+			ouroboros_agent_free(agent);
+			return NULL;
+		}
+		agent->fds_size++;
+	}
+
+	return agent;
+}
+
+/* Free allocated resources. */
+void ouroboros_agent_free(struct ouroboros_agent *agent) {
+	while (agent->fds_size > 0)
+		close(agent->fds[--agent->fds_size]);
+	free(agent->fds);
+	ouroboros_config_free_strings(&agent->pending);
+	free(agent);
+}
+
+/* Internal function which queues command for the forwarding. One node
+ * usually generates a burst of events, so duplicated commands are merged.
+ * On success this function returns 0, otherwise -1. */
+static int _queue(struct ouroboros_agent *agent, const char *command, const char *arg) {
+
+	char *tmp;
+	int i;
+
+	if (arg == NULL)
+		tmp = strdup(command);
+	else if ((tmp = malloc(strlen(command) + strlen(arg) + 2)) != NULL)
+		sprintf(tmp, "%s %s", command, arg);
+	if (tmp == NULL)
+		return -1;
+
+	for (i = 0; i < agent->size; i++)
+		if (strcmp(agent->pending[i], tmp) == 0) {
+			free(tmp);
+			return 0;
+		}
+
+	i = ouroboros_config_add_string(&agent->pending, tmp);
+	free(tmp);
+
+	if (i == -1)
+		return -1;
+	agent->size++;
+	return 0;
+}
+
+/* Queue changed path for the forwarding. The path is sent relative to the
+ * watched root it belongs to, because the tree is usually mounted under
+ * a different location on the remote side. Paths which can not be carried
+ * by the protocol (with new lines or semicolons) are skipped. On success
+ * this function returns 0, otherwise -1. */
+int ouroboros_agent_add(struct ouroboros_agent *agent, char **roots, const char *path) {
+
+	size_t len;
+
+	if (strpbrk(path, "\n;") != NULL) {
+		debug("agent skipping path: %s", path);
+		return -1;
+	}
+
+	for (; roots != NULL && *roots != NULL; roots++) {
+		len = strlen(*roots);
+		while (len > 1 && (*roots)[len - 1] == '/')
+			len--;
+		if (strncmp(path, *roots, len) == 0 && path[len] == '\0') {
+			/* change of the root itself (e.g. reported by the poll engine) */
+			path = ".";
+			break;
+		}
+		if (strncmp(path, *roots, len) == 0 && path[len] == '/') {
+			path += len + 1;
+			break;
+		}
+	}
+
+	return _queue(agent, "change", path);
+}
+
+/* Queue restart of the given service (or all services if the name is NULL)
+ * for the forwarding. On success this function returns 0, otherwise -1. */
+int ouroboros_agent_restart(struct ouroboros_agent *agent, const char *name) {
+	return _queue(agent, "restart", name);
+}
+
+/* Internal function which sends the datagram to all targets. */
+static int _send(struct ouroboros_agent *agent, const char *data, size_t len) {
+
+	int rv = 0;
+	int i;
+
+	for (i = 0; i < agent->fds_size; i++)
+		if (send(agent->fds[i], data, len, 0) == -1) {
+			perror("warning: unable to forward event");
+			rv = -1;
+		}
+
+	return rv;
+}
+
+/* Send queued commands to remote servers. Commands are packed into as few
+ * datagrams (events) as possible - within the limits of the server. Every
+ * event starts with the header which identifies it and the flush it belongs
+ * to, so receivers rate limit whole flushes. On success this function
+ * returns 0, otherwise -1. */
+int ouroboros_agent_flush(struct ouroboros_agent *agent) {
+
+	char buffer[OUROBOROS_SERVER_REQUEST_SIZE];
+	unsigned long long flush = agent->seq + 1;
+	size_t header = 0;
+	size_t len = 0;
+	int count = 0;
+	int rv = 0;
+	size_t n;
+	int i;
+
+	for (i = 0; i <= agent->size; i++) {
+
+		n = i < agent->size ? strlen(agent->pending[i]) + 1 : 0;
+
+		/* send the datagram if it is full or there is nothing more to add -
+		 * note, that the header counts as a command as well */
+		if (count > 0 && (i == agent->size || count == OUROBOROS_SERVER_COMMANDS - 1 ||
+					len + n >= sizeof(buffer))) {
+			if (_send(agent, buffer, len) == -1)
+				rv = -1;
+			else
+				agent->sent += count;
+			count = 0;
+		}
+
+		if (i == agent->size)
+			break;
+
+		if (count == 0)
+			len = header = sprintf(buffer, "event %s %llu %llu\n",
+					agent->origin, ++agent->seq, flush);
+
+		if (header + n >= sizeof(buffer)) {
+			debug("agent skipping command: %s", agent->pending[i]);
+			continue;
+		}
+
+		len += sprintf(&buffer[len], "%s\n", agent->pending[i]);
+		count++;
+	}
+
+	ouroboros_config_free_strings(&agent->pending);
+	agent->size = 0;
+	return rv;
+}
+
+/* Dispatch replies of the remote server. Events are not answered, however
+ * servers which do not know them reply with errors, and these have to be
+ * read, so they will not pile up. */
+void ouroboros_agent_dispatch(struct ouroboros_agent *agent, int fd) {
+
+	char buffer[512];
+	ssize_t rlen;
+
+	while ((rlen = recv(fd, buffer, sizeof(buffer) - 1, 0)) > 0) {
+		buffer[rlen] = '\0';
+		if (strncmp(buffer, "error", 5) == 0)
+			fprintf(stderr, "warning: remote server: %s", buffer);
+	}
+
+}
@@ -0,0 +1,56 @@
+/*
+ * ouroboros - agent.h
+ * Copyright (c) 2015 Arkadiusz Bokowy
+ *
+ * This file is a part of a ouroboros.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef __AGENT_H
+#define __AGENT_H
+
+#include <stddef.h>
+#include <sys/socket.h>
+
+
+/* delay (in seconds) used to batch changes reported at once */
+#define OUROBOROS_AGENT_FLUSH_DELAY 0.01
+
+
+/* Agent publishes events detected by this instance to remote servers. It
+ * forwards changes from the host into the VM where the tree is mounted over
+ * a network file system (and where inotify does not report modifications),
+ * or fans out changes and restarts to the fleet of peer instances. */
+struct ouroboros_agent {
+
+	/* connected datagram sockets - one per target */
+	int *fds;
+	int fds_size;
+
+	/* Every datagram is a sequenced event, so receivers can drop duplicates
+	 * (e.g. delivered via multicast and the peer list). The origin is chosen
+	 * randomly upon every start, so the sequence does not have to persist. */
+	char origin[17];
+	unsigned long long seq;
+
+	/* commands waiting for the flush */
+	char **pending;
+	int size;
+
+	/* forwarded commands statistics */
+	unsigned long long sent;
+
+};
+
+
+struct ouroboros_agent *ouroboros_agent_init(char **targets);
+void ouroboros_agent_free(struct ouroboros_agent *agent);
+
+int ouroboros_agent_add(struct ouroboros_agent *agent, char **roots, const char *path);
+int ouroboros_agent_restart(struct ouroboros_agent *agent, const char *name);
+int ouroboros_agent_flush(struct ouroboros_agent *agent);
+void ouroboros_agent_dispatch(struct ouroboros_agent *agent, int fd);
+
+#endif
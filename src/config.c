@@ -37,6 +37,12 @@ void ouroboros_config_init(struct ouroboros_config *config) {
 	config->watch_update_nodes = 0;
 	config->watch_dirs_only = 0;
 	config->watch_files_only = 0;
+	config->watch_verify_content = 0;
+	config->watch_ignore_temp = 1;
+	config->watch_write_timeout = 0.0;
+	config->watch_vcs_gate = 0;
+	config->watch_remote_poll = 1;
+	config->watch_follow_symlinks = 1;
 	config->watch_paths = NULL;
 	config->watch_includes = NULL;
 	config->watch_excludes = NULL;
@@ -45,15 +51,62 @@ void ouroboros_config_init(struct ouroboros_config *config) {
 	config->kill_latency = 1.0;
 	config->start_latency = 0.0;
 
+	config->ready_notify = 0;
+	config->ready_port = 0;
+	config->ready_pattern = NULL;
+	config->ready_timeout = 30.0;
+
+	config->watchdog_timeout = 0.0;
+	config->liveness_port = 0;
+	config->liveness_idle = 0.0;
+	config->liveness_interval = 1.0;
+
+	config->recycle_memory = 0;
+	config->recycle_lifetime = 0.0;
+
+	config->crash_restart = 0;
+	config->crash_backoff_min = 0.5;
+	config->crash_backoff_max = 30.0;
+	config->crash_restart_limit = 5;
+	config->crash_restart_window = 60.0;
+
+	config->zygote = NULL;
+	config->zygote_invalidate = NULL;
+
+	config->start_on_demand = 0;
+	config->idle_timeout = 0.0;
+
 	config->redirect_input = 0;
 	config->redirect_output = NULL;
+	config->output_tee = 0;
+	config->output_timestamps = 0;
+	config->output_markers = 0;
+	config->output_rotate_size = 0;
+	config->output_rotate_count = 3;
+	config->output_buffer_size = 0;
+	config->output_dump = NULL;
 	config->redirect_signals = NULL;
 
 #if ENABLE_SERVER
 	config->server_iface = NULL;
 	config->server_port = 3945;
+	config->server_socket = NULL;
+	config->agent_target = NULL;
+	config->fleet_peers = NULL;
+	config->fleet_group = NULL;
+	config->fleet_rate_limit = 10;
+	config->http_port = 0;
 #endif /* ENABLE_SERVER */
 
+	config->proxy_port = 0;
+	config->proxy_target_port = 0;
+	config->proxy_hold_timeout = 30.0;
+
+	config->trace_file = NULL;
+
+	config->services = NULL;
+	config->services_size = 0;
+
 }
 
 /* Internal function which actually frees array resources. */
@@ -69,22 +122,125 @@ static void _free_array(char ***array) {
 	}
 }
 
+/* Internal function which frees all configured services. */
+static void _free_services(struct ouroboros_config *config) {
+	while (config->services_size--) {
+		struct ouroboros_config_service *service = &config->services[config->services_size];
+		free(service->name);
+		_free_array(&service->command);
+		_free_array(&service->watch_paths);
+		_free_array(&service->watch_includes);
+		_free_array(&service->watch_excludes);
+		free(service->redirect_output);
+	}
+	free(config->services);
+	config->services = NULL;
+	config->services_size = 0;
+}
+
 /* Free allocated resources. */
 void ouroboros_config_free(struct ouroboros_config *config) {
 	_free_array(&config->watch_paths);
 	_free_array(&config->watch_includes);
 	_free_array(&config->watch_excludes);
+	_free_array(&config->zygote);
+	_free_array(&config->zygote_invalidate);
+	free(config->ready_pattern);
+	config->ready_pattern = NULL;
 	free(config->redirect_output);
 	config->redirect_output = NULL;
+	free(config->output_dump);
+	config->output_dump = NULL;
+	free(config->trace_file);
+	config->trace_file = NULL;
 	free(config->redirect_signals);
 	config->redirect_signals = NULL;
+	_free_services(config);
 #if ENABLE_SERVER
 	free(config->server_iface);
 	config->server_iface = NULL;
+	free(config->server_socket);
+	config->server_socket = NULL;
+	free(config->agent_target);
+	config->agent_target = NULL;
+	_free_array(&config->fleet_peers);
+	free(config->fleet_group);
+	config->fleet_group = NULL;
 #endif
 }
 
 #if ENABLE_LIBCONFIG
+/* Internal function which reads an array of strings from the given setting.
+ * If the setting exists, the array is replaced with the new one. */
+static void _load_array(const config_setting_t *root, const char *name, char ***array) {
+
+	config_setting_t *setting;
+	const char *tmp;
+	int length;
+	int i;
+
+	if ((setting = config_setting_get_member(root, name)) == NULL)
+		return;
+
+	_free_array(array);
+	length = config_setting_length(setting);
+	for (i = 0; i < length; i++)
+		if ((tmp = config_setting_get_string_elem(setting, i)) != NULL)
+			ouroboros_config_add_string(array, tmp);
+
+}
+
+/* Internal function which reads service definition. Settings which are not
+ * defined for the service are inherited from the global configuration. */
+static void _load_service(const config_setting_t *root, struct ouroboros_config *config) {
+
+	struct ouroboros_config_service *service;
+	struct ouroboros_config_service *tmp;
+	const char *value;
+
+	if (!config_setting_is_group(root))
+		return;
+
+	tmp = realloc(config->services, sizeof(*tmp) * (config->services_size + 1));
+	if (tmp == NULL)
+		return;
+
+	config->services = tmp;
+	service = &config->services[config->services_size];
+	memset(service, 0, sizeof(*service));
+
+	_load_array(root, OCKD_SERVICE_COMMAND, &service->command);
+	if (service->command == NULL) {
+		fprintf(stderr, "warning: service without command - skipping\n");
+		return;
+	}
+
+	if (config_setting_lookup_string(root, OCKD_SERVICE_NAME, &value))
+		service->name = strdup(value);
+	else
+		service->name = strdup(service->command[0]);
+
+	_load_array(root, OCKD_WATCH_PATH, &service->watch_paths);
+	_load_array(root, OCKD_WATCH_INCLUDE, &service->watch_includes);
+	_load_array(root, OCKD_WATCH_EXCLUDE, &service->watch_excludes);
+
+	/* settings which are not given are inherited from the global ones - they
+	 * are resolved with the ouroboros_config_inherit() function */
+	if (config_setting_lookup_string(root, OCKD_KILL_SIGNAL, &value))
+		service->kill_signal = ouroboros_config_get_signal(value);
+
+	service->kill_latency = -1;
+	config_setting_lookup_float(root, OCKD_KILL_LATENCY, &service->kill_latency);
+
+	service->start_latency = -1;
+	config_setting_lookup_float(root, OCKD_START_LATENCY, &service->start_latency);
+
+	if (config_setting_lookup_string(root, OCKD_REDIRECT_OUTPUT, &value) && strlen(value) != 0)
+		service->redirect_output = strdup(value);
+
+	config->services_size++;
+}
+
 /* Internal function which actually reads data from the configuration file. */
 static void _load_config(const config_setting_t *root, struct ouroboros_config *config) {
 
@@ -130,6 +286,18 @@ static void _load_config(const config_setting_t *root, struct ouroboros_config *
 
 	config_setting_lookup_bool(root, OCKD_WATCH_FILE_ONLY, &config->watch_files_only);
 
+	config_setting_lookup_bool(root, OCKD_WATCH_VERIFY_CONTENT, &config->watch_verify_content);
+
+	config_setting_lookup_bool(root, OCKD_WATCH_IGNORE_TEMP, &config->watch_ignore_temp);
+
+	config_setting_lookup_float(root, OCKD_WATCH_WRITE_TIMEOUT, &config->watch_write_timeout);
+
+	config_setting_lookup_bool(root, OCKD_WATCH_VCS_GATE, &config->watch_vcs_gate);
+
+	config_setting_lookup_bool(root, OCKD_WATCH_REMOTE_POLL, &config->watch_remote_poll);
+
+	config_setting_lookup_bool(root, OCKD_WATCH_FOLLOW_SYMLINKS, &config->watch_follow_symlinks);
+
 	if (config_setting_lookup_string(root, OCKD_KILL_SIGNAL, &tmp))
 		if ((val = ouroboros_config_get_signal(tmp)) != 0)
 			config->kill_signal = val;
@@ -138,6 +306,61 @@ static void _load_config(const config_setting_t *root, struct ouroboros_config *
 
 	config_setting_lookup_float(root, OCKD_START_LATENCY, &config->start_latency);
 
+	config_setting_lookup_bool(root, OCKD_READY_NOTIFY, &config->ready_notify);
+
+	config_setting_lookup_int(root, OCKD_READY_PORT, &config->ready_port);
+
+	if (config_setting_lookup_string(root, OCKD_READY_PATTERN, &tmp)) {
+		free(config->ready_pattern);
+		config->ready_pattern = NULL;
+		if (strlen(tmp) != 0)
+			config->ready_pattern = strdup(tmp);
+	}
+
+	config_setting_lookup_float(root, OCKD_READY_TIMEOUT, &config->ready_timeout);
+
+	config_setting_lookup_float(root, OCKD_WATCHDOG_TIMEOUT, &config->watchdog_timeout);
+
+	config_setting_lookup_int(root, OCKD_LIVENESS_PORT, &config->liveness_port);
+
+	config_setting_lookup_float(root, OCKD_LIVENESS_IDLE, &config->liveness_idle);
+
+	config_setting_lookup_float(root, OCKD_LIVENESS_INTERVAL, &config->liveness_interval);
+
+	config_setting_lookup_int(root, OCKD_RECYCLE_MEMORY, &config->recycle_memory);
+
+	config_setting_lookup_float(root, OCKD_RECYCLE_LIFETIME, &config->recycle_lifetime);
+
+	config_setting_lookup_bool(root, OCKD_CRASH_RESTART, &config->crash_restart);
+
+	config_setting_lookup_float(root, OCKD_CRASH_BACKOFF_MIN, &config->crash_backoff_min);
+
+	config_setting_lookup_float(root, OCKD_CRASH_BACKOFF_MAX, &config->crash_backoff_max);
+
+	config_setting_lookup_int(root, OCKD_CRASH_RESTART_LIMIT, &config->crash_restart_limit);
+
+	config_setting_lookup_float(root, OCKD_CRASH_RESTART_WINDOW, &config->crash_restart_window);
+
+	if ((array = config_setting_get_member(root, OCKD_ZYGOTE)) != NULL) {
+		_free_array(&config->zygote);
+		length = config_setting_length(array);
+		for (i = 0; i < length; i++)
+			if ((tmp = config_setting_get_string_elem(array, i)) != NULL)
+				ouroboros_config_add_string(&config->zygote, tmp);
+	}
+
+	if ((array = config_setting_get_member(root, OCKD_ZYGOTE_INVALIDATE)) != NULL) {
+		_free_array(&config->zygote_invalidate);
+		length = config_setting_length(array);
+		for (i = 0; i < length; i++)
+			if ((tmp = config_setting_get_string_elem(array, i)) != NULL)
+				ouroboros_config_add_string(&config->zygote_invalidate, tmp);
+	}
+
+	config_setting_lookup_bool(root, OCKD_START_ON_DEMAND, &config->start_on_demand);
+
+	config_setting_lookup_float(root, OCKD_IDLE_TIMEOUT, &config->idle_timeout);
+
 	config_setting_lookup_bool(root, OCKD_REDIRECT_INPUT, &config->redirect_input);
 
 	/* output setting is a special one, because it can be boolean or string*/
@@ -152,6 +375,25 @@ static void _load_config(const config_setting_t *root, struct ouroboros_config *
 			config->redirect_output = strdup(tmp);
 	}
 
+	config_setting_lookup_bool(root, OCKD_OUTPUT_TEE, &config->output_tee);
+
+	config_setting_lookup_bool(root, OCKD_OUTPUT_TIMESTAMPS, &config->output_timestamps);
+
+	config_setting_lookup_bool(root, OCKD_OUTPUT_MARKERS, &config->output_markers);
+
+	config_setting_lookup_int(root, OCKD_OUTPUT_ROTATE_SIZE, &config->output_rotate_size);
+
+	config_setting_lookup_int(root, OCKD_OUTPUT_ROTATE_COUNT, &config->output_rotate_count);
+
+	config_setting_lookup_int(root, OCKD_OUTPUT_BUFFER_SIZE, &config->output_buffer_size);
+
+	if (config_setting_lookup_string(root, OCKD_OUTPUT_DUMP, &tmp)) {
+		free(config->output_dump);
+		config->output_dump = NULL;
+		if (strlen(tmp) != 0)
+			config->output_dump = strdup(tmp);
+	}
+
 	if ((array = config_setting_get_member(root, OCKD_REDIRECT_SIGNAL)) != NULL) {
 		free(config->redirect_signals);
 		config->redirect_signals = NULL;
@@ -171,8 +413,55 @@ static void _load_config(const config_setting_t *root, struct ouroboros_config *
 	}
 
 	config_setting_lookup_int(root, OCKD_SERVER_PORT, &config->server_port);
+
+	if (config_setting_lookup_string(root, OCKD_SERVER_SOCKET, &tmp)) {
+		free(config->server_socket);
+		config->server_socket = NULL;
+		if (strlen(tmp) != 0)
+			config->server_socket = strdup(tmp);
+	}
+
+	if (config_setting_lookup_string(root, OCKD_AGENT_TARGET, &tmp)) {
+		free(config->agent_target);
+		config->agent_target = NULL;
+		if (strlen(tmp) != 0)
+			config->agent_target = strdup(tmp);
+	}
+
+	_load_array(root, OCKD_FLEET_PEER, &config->fleet_peers);
+
+	if (config_setting_lookup_string(root, OCKD_FLEET_GROUP, &tmp)) {
+		free(config->fleet_group);
+		config->fleet_group = NULL;
+		if (strlen(tmp) != 0)
+			config->fleet_group = strdup(tmp);
+	}
+
+	config_setting_lookup_int(root, OCKD_FLEET_RATE_LIMIT, &config->fleet_rate_limit);
+
+	config_setting_lookup_int(root, OCKD_HTTP_PORT, &config->http_port);
 #endif /* ENABLE_SERVER */
 
+	config_setting_lookup_int(root, OCKD_PROXY_PORT, &config->proxy_port);
+
+	config_setting_lookup_int(root, OCKD_PROXY_TARGET_PORT, &config->proxy_target_port);
+
+	config_setting_lookup_float(root, OCKD_PROXY_HOLD_TIMEOUT, &config->proxy_hold_timeout);
+
+	if (config_setting_lookup_string(root, OCKD_TRACE_FILE, &tmp)) {
+		free(config->trace_file);
+		config->trace_file = NULL;
+		if (strlen(tmp) != 0)
+			config->trace_file = strdup(tmp);
+	}
+
+	if ((array = config_setting_get_member(root, OCKD_SERVICES)) != NULL) {
+		_free_services(config);
+		length = config_setting_length(array);
+		for (i = 0; i < length; i++)
+			_load_service(config_setting_get_elem(array, i), config);
+	}
+
 }
 #endif /* ENABLE_LIBCONFIG */
 
@@ -290,6 +579,8 @@ int load_ouroboros_ini_config(const char *filename, struct ouroboros_config *con
 /* Dump configuration settings on the standard error output. */
 void dump_ouroboros_config(const struct ouroboros_config *config) {
 
+	int i;
+
 	const char *_engine(enum ouroboros_notify_type value) {
 		switch (value) {
 		case ONT_POLL:
@@ -330,12 +621,24 @@ void dump_ouroboros_config(const struct ouroboros_config *config) {
 			"  watch recursive:\t%s\n"
 			"  watch update nodes:\t%s\n"
 			"  watch dirs only:\t%s\n"
-			"  watch files only:\t%s\n",
+			"  watch files only:\t%s\n"
+			"  watch verify content:\t%s\n"
+			"  watch ignore temp:\t%s\n"
+			"  watch write timeout:\t%.2f s\n"
+			"  watch VCS gate:\t%s\n"
+			"  watch remote poll:\t%s\n"
+			"  watch follow links:\t%s\n",
 			_engine(config->engine),
 			_boolean(config->watch_recursive),
 			_boolean(config->watch_update_nodes),
 			_boolean(config->watch_dirs_only),
-			_boolean(config->watch_files_only));
+			_boolean(config->watch_files_only),
+			_boolean(config->watch_verify_content),
+			_boolean(config->watch_ignore_temp),
+			config->watch_write_timeout,
+			_boolean(config->watch_vcs_gate),
+			_boolean(config->watch_remote_poll),
+			_boolean(config->watch_follow_symlinks));
 
 	_dump_array_char("  watch paths:\t\t", config->watch_paths);
 	_dump_array_char("  watch includes:\t", config->watch_includes);
@@ -345,24 +648,136 @@ void dump_ouroboros_config(const struct ouroboros_config *config) {
 			"  kill signal:\t\t%u\n"
 			"  kill latency:\t\t%.2f s\n"
 			"  start latency:\t%.2f s\n"
+			"  start on demand:\t%s\n"
+			"  idle timeout:\t\t%.2f s\n"
 			"  redirect input:\t%s\n"
 			"  redirect output:\t%s\n",
 			config->kill_signal,
 			config->kill_latency,
 			config->start_latency,
+			_boolean(config->start_on_demand),
+			config->idle_timeout,
 			_boolean(config->redirect_input),
 			config->redirect_output);
 
+	fprintf(stderr,
+			"  ready notify:\t\t%s\n"
+			"  ready port:\t\t%u\n"
+			"  ready pattern:\t%s\n"
+			"  ready timeout:\t%.2f s\n",
+			_boolean(config->ready_notify),
+			config->ready_port,
+			config->ready_pattern,
+			config->ready_timeout);
+
+	fprintf(stderr,
+			"  watchdog timeout:\t%.2f s\n"
+			"  liveness port:\t%u\n"
+			"  liveness idle:\t%.2f s\n"
+			"  liveness interval:\t%.2f s\n"
+			"  recycle memory:\t%d KiB\n"
+			"  recycle lifetime:\t%.2f s\n",
+			config->watchdog_timeout,
+			config->liveness_port,
+			config->liveness_idle,
+			config->liveness_interval,
+			config->recycle_memory,
+			config->recycle_lifetime);
+
+	fprintf(stderr,
+			"  crash restart:\t%s\n"
+			"  crash backoff:\t%.2f - %.2f s\n"
+			"  crash restart limit:\t%d per %.2f s\n",
+			_boolean(config->crash_restart),
+			config->crash_backoff_min,
+			config->crash_backoff_max,
+			config->crash_restart_limit,
+			config->crash_restart_window);
+
+	_dump_array_char("  zygote:\t\t", config->zygote);
+	_dump_array_char("  zygote invalidate:\t", config->zygote_invalidate);
+
 	_dump_array_int("  redirect signals:\t", config->redirect_signals);
 
+	fprintf(stderr,
+			"  output tee:\t\t%s\n"
+			"  output timestamps:\t%s\n"
+			"  output markers:\t%s\n"
+			"  output rotation:\t%d KiB, %d files\n"
+			"  output buffer:\t%d KiB\n"
+			"  output dump:\t\t%s\n",
+			_boolean(config->output_tee),
+			_boolean(config->output_timestamps),
+			_boolean(config->output_markers),
+			config->output_rotate_size,
+			config->output_rotate_count,
+			config->output_buffer_size,
+			config->output_dump);
+
 #if ENABLE_SERVER
 	fprintf(stderr,
 			"  server iface:\t\t%s\n"
-			"  server port:\t\t%u\n",
+			"  server port:\t\t%u\n"
+			"  server socket:\t%s\n"
+			"  agent target:\t\t%s\n",
 			config->server_iface,
-			config->server_port);
+			config->server_port,
+			config->server_socket,
+			config->agent_target);
+	_dump_array_char("  fleet peers:\t\t", config->fleet_peers);
+	fprintf(stderr,
+			"  fleet group:\t\t%s\n"
+			"  fleet rate limit:\t%d/s\n"
+			"  http port:\t\t%u\n",
+			config->fleet_group,
+			config->fleet_rate_limit,
+			config->http_port);
 #endif /* ENABLE_SERVER */
 
+	fprintf(stderr,
+			"  proxy port:\t\t%u\n"
+			"  proxy target port:\t%u\n"
+			"  proxy hold timeout:\t%.2f s\n"
+			"  trace file:\t\t%s\n",
+			config->proxy_port,
+			config->proxy_target_port,
+			config->proxy_hold_timeout,
+			config->trace_file);
+
+	for (i = 0; i < config->services_size; i++) {
+		const struct ouroboros_config_service *service = &config->services[i];
+		fprintf(stderr, "  service:\t\t%s\n", service->name);
+		_dump_array_char("    command:\t\t", service->command);
+		_dump_array_char("    watch paths:\t", service->watch_paths);
+		_dump_array_char("    watch includes:\t", service->watch_includes);
+		_dump_array_char("    watch excludes:\t", service->watch_excludes);
+		fprintf(stderr,
+				"    kill signal:\t%d\n"
+				"    kill latency:\t%.2f s\n"
+				"    start latency:\t%.2f s\n"
+				"    redirect output:\t%s\n",
+				service->kill_signal,
+				service->kill_latency,
+				service->start_latency,
+				service->redirect_output);
+	}
+
+}
+
+/* Resolve service settings which are inherited from the global configuration.
+ * This function shall be called when all configuration sources (including
+ * command line options) have been applied. */
+void ouroboros_config_inherit(struct ouroboros_config *config) {
+	int i;
+	for (i = 0; i < config->services_size; i++) {
+		struct ouroboros_config_service *service = &config->services[i];
+		if (service->kill_signal == 0)
+			service->kill_signal = config->kill_signal;
+		if (service->kill_latency < 0)
+			service->kill_latency = config->kill_latency;
+		if (service->start_latency < 0)
+			service->start_latency = config->start_latency;
+	}
 }
 
 /* Add new non-zero value to the array. On success this function returns
@@ -391,6 +806,11 @@ int ouroboros_config_add_int(int **array, int value) {
 	return size - 1;
 }
 
+/* Free array of strings created with the ouroboros_config_add_string(). */
+void ouroboros_config_free_strings(char ***array) {
+	_free_array(array);
+}
+
 /* Add new value to the array. On success this function returns the number
  * of stored elements in the array, otherwise -1. */
 int ouroboros_config_add_string(char ***array, const char *value) {
@@ -28,15 +28,78 @@
 #define OCKD_WATCH_EXCLUDE "watch-exclude"
 #define OCKD_WATCH_DIR_ONLY "watch-dirs-only"
 #define OCKD_WATCH_FILE_ONLY "watch-files-only"
+#define OCKD_WATCH_VERIFY_CONTENT "watch-verify-content"
+#define OCKD_WATCH_IGNORE_TEMP "watch-ignore-temp"
+#define OCKD_WATCH_WRITE_TIMEOUT "watch-write-timeout"
+#define OCKD_WATCH_VCS_GATE "watch-vcs-gate"
+#define OCKD_WATCH_REMOTE_POLL "watch-remote-poll"
+#define OCKD_WATCH_FOLLOW_SYMLINKS "watch-follow-symlinks"
 #define OCKD_KILL_SIGNAL "kill-signal"
 #define OCKD_KILL_LATENCY "kill-latency"
 #define OCKD_START_LATENCY "start-latency"
+#define OCKD_READY_NOTIFY "ready-notify"
+#define OCKD_READY_PORT "ready-port"
+#define OCKD_READY_PATTERN "ready-pattern"
+#define OCKD_READY_TIMEOUT "ready-timeout"
+#define OCKD_WATCHDOG_TIMEOUT "watchdog-timeout"
+#define OCKD_LIVENESS_PORT "liveness-port"
+#define OCKD_LIVENESS_IDLE "liveness-idle"
+#define OCKD_LIVENESS_INTERVAL "liveness-interval"
+#define OCKD_RECYCLE_MEMORY "recycle-memory"
+#define OCKD_RECYCLE_LIFETIME "recycle-lifetime"
+#define OCKD_CRASH_RESTART "crash-restart"
+#define OCKD_CRASH_BACKOFF_MIN "crash-backoff-min"
+#define OCKD_CRASH_BACKOFF_MAX "crash-backoff-max"
+#define OCKD_CRASH_RESTART_LIMIT "crash-restart-limit"
+#define OCKD_CRASH_RESTART_WINDOW "crash-restart-window"
+#define OCKD_ZYGOTE "zygote"
+#define OCKD_ZYGOTE_INVALIDATE "zygote-invalidate"
+#define OCKD_START_ON_DEMAND "start-on-demand"
+#define OCKD_IDLE_TIMEOUT "idle-timeout"
 #define OCKD_REDIRECT_INPUT "redirect-input"
 #define OCKD_REDIRECT_OUTPUT "redirect-output"
 #define OCKD_REDIRECT_SIGNAL "redirect-signal"
+#define OCKD_OUTPUT_TEE "output-tee"
+#define OCKD_OUTPUT_TIMESTAMPS "output-timestamps"
+#define OCKD_OUTPUT_MARKERS "output-markers"
+#define OCKD_OUTPUT_ROTATE_SIZE "output-rotate-size"
+#define OCKD_OUTPUT_ROTATE_COUNT "output-rotate-count"
+#define OCKD_OUTPUT_BUFFER_SIZE "output-buffer-size"
+#define OCKD_OUTPUT_DUMP "output-dump"
 #define OCKD_SERVER_INTERFACE "server-interface"
 #define OCKD_SERVER_PORT "server-port"
+#define OCKD_SERVER_SOCKET "server-socket"
+#define OCKD_AGENT_TARGET "agent-target"
+#define OCKD_FLEET_PEER "fleet-peer"
+#define OCKD_FLEET_GROUP "fleet-group"
+#define OCKD_FLEET_RATE_LIMIT "fleet-rate-limit"
+#define OCKD_HTTP_PORT "http-port"
+#define OCKD_PROXY_PORT "proxy-port"
+#define OCKD_PROXY_TARGET_PORT "proxy-target-port"
+#define OCKD_PROXY_HOLD_TIMEOUT "proxy-hold-timeout"
+#define OCKD_TRACE_FILE "trace-file"
+#define OCKD_SERVICES "services"
+#define OCKD_SERVICE_NAME "name"
+#define OCKD_SERVICE_COMMAND "command"
+
+
+/* additional service supervised by the same instance */
+struct ouroboros_config_service {
+
+	char *name;
+	char **command;
+
+	/* scope of the watched tree */
+	char **watch_paths;
+	char **watch_includes;
+	char **watch_excludes;
 
+	int kill_signal;
+	double kill_latency;
+	double start_latency;
+	char *redirect_output;
+
+};
 
 struct ouroboros_config {
 
@@ -48,6 +111,12 @@ struct ouroboros_config {
 	int watch_update_nodes;
 	int watch_dirs_only;
 	int watch_files_only;
+	int watch_verify_content;
+	int watch_ignore_temp;
+	double watch_write_timeout;
+	int watch_vcs_gate;
+	int watch_remote_poll;
+	int watch_follow_symlinks;
 	char **watch_paths;
 	char **watch_includes;
 	char **watch_excludes;
@@ -57,14 +126,79 @@ struct ouroboros_config {
 	double kill_latency;
 	double start_latency;
 
+	/* readiness detection */
+	int ready_notify;
+	int ready_port;
+	char *ready_pattern;
+	double ready_timeout;
+
+	/* liveness checks */
+	double watchdog_timeout;
+	int liveness_port;
+	double liveness_idle;
+	double liveness_interval;
+
+	/* recycling of long-running process */
+	int recycle_memory;
+	double recycle_lifetime;
+
+	/* crash supervision */
+	int crash_restart;
+	double crash_backoff_min;
+	double crash_backoff_max;
+	int crash_restart_limit;
+	double crash_restart_window;
+
+	/* fork-server (preloader) */
+	char **zygote;
+	char **zygote_invalidate;
+
+	/* on-demand start and idle stop */
+	int start_on_demand;
+	double idle_timeout;
+
 	/* IO redirection */
 	int redirect_input;
 	char *redirect_output;
 	int *redirect_signals;
 
+	/* output capture */
+	int output_tee;
+	int output_timestamps;
+	int output_markers;
+	int output_rotate_size;
+	int output_rotate_count;
+	int output_buffer_size;
+	char *output_dump;
+
 	/* server binding */
 	char *server_iface;
 	int server_port;
+	/* Unix domain socket path */
+	char *server_socket;
+
+	/* forwarding of changes to the remote server */
+	char *agent_target;
+
+	/* fan-out of changes and restarts to peer instances */
+	char **fleet_peers;
+	char *fleet_group;
+	int fleet_rate_limit;
+
+	/* HTTP metrics and webhooks */
+	int http_port;
+
+	/* TCP proxy */
+	int proxy_port;
+	int proxy_target_port;
+	double proxy_hold_timeout;
+
+	/* pipeline stage tracing */
+	char *trace_file;
+
+	/* multi-service supervision */
+	struct ouroboros_config_service *services;
+	int services_size;
 
 };
 
@@ -79,9 +213,11 @@ int load_ouroboros_ini_config(const char *filename, struct ouroboros_config *con
 #endif
 
 void dump_ouroboros_config(const struct ouroboros_config *config);
+void ouroboros_config_inherit(struct ouroboros_config *config);
 
 int ouroboros_config_add_int(int **array, int value);
 int ouroboros_config_add_string(char ***array, const char *value);
+void ouroboros_config_free_strings(char ***array);
 
 int ouroboros_config_get_bool(const char *name);
 int ouroboros_config_get_engine(const char *name);
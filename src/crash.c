@@ -0,0 +1,118 @@
+/*
+ * ouroboros - crash.c
+ * Copyright (c) 2015 Arkadiusz Bokowy
+ *
+ * This file is a part of a ouroboros.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include "crash.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "debug.h"
+
+
+/* Initialize crash supervision structure. At most limit restarts will be
+ * granted within the given time window (in seconds). */
+void ouroboros_crash_init(struct ouroboros_crash *crash, int limit, double window,
+		double delay_min, double delay_max) {
+
+	crash->delay_min = delay_min;
+	crash->delay_max = delay_max > delay_min ? delay_max : delay_min;
+	crash->failures = 0;
+
+	crash->limit = limit;
+	crash->window = window;
+	crash->tokens = limit;
+	clock_gettime(CLOCK_MONOTONIC, &crash->refilled);
+
+	crash->count = 0;
+
+	/* jitter does not need to be cryptographically secure */
+	srandom(time(NULL) ^ getpid());
+
+}
+
+/* Check whether given termination status denotes a failure - process has
+ * been killed by a signal or it has exited with non-zero status. */
+int ouroboros_crash_is_failure(int status) {
+	return !(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+/* Internal function which refills the token bucket proportionally to the
+ * time elapsed since the last refill. */
+static void _refill(struct ouroboros_crash *crash) {
+
+	struct timespec now;
+	double elapsed;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed = now.tv_sec - crash->refilled.tv_sec +
+		(now.tv_nsec - crash->refilled.tv_nsec) / 1e9;
+	crash->refilled = now;
+
+	if (crash->window > 0)
+		crash->tokens += elapsed * crash->limit / crash->window;
+	if (crash->tokens > crash->limit)
+		crash->tokens = crash->limit;
+
+}
+
+/* Record process termination and compute the delay (in seconds) after which
+ * the process should be restarted. The delay grows exponentially with every
+ * consecutive failure and it is randomized (equal jitter), so a fleet of
+ * crashing services will not restart in lockstep. If the restart limit has
+ * been reached, this function returns -1. */
+double ouroboros_crash_record(struct ouroboros_crash *crash, int status, double uptime) {
+
+	struct ouroboros_crash_record *record;
+	double delay;
+
+	record = &crash->history[crash->count++ % OUROBOROS_CRASH_HISTORY];
+	clock_gettime(CLOCK_REALTIME, &record->time);
+	record->uptime = uptime;
+	record->status = status;
+
+	/* process which was running for a while is considered as a healthy one,
+	 * so the backoff starts from the beginning */
+	if (uptime > crash->delay_max)
+		crash->failures = 0;
+
+	_refill(crash);
+	if (crash->tokens < 1) {
+		debug("restart limit reached: tokens=%.2f", crash->tokens);
+		return -1;
+	}
+	crash->tokens -= 1;
+
+	delay = crash->delay_min;
+	if (crash->failures < 32)
+		delay *= 1U << crash->failures;
+	if (delay > crash->delay_max)
+		delay = crash->delay_max;
+	delay = delay / 2 + delay / 2 * random() / RAND_MAX;
+
+	crash->failures++;
+
+	debug("restart delay: failures=%d, delay=%.3f", crash->failures, delay);
+	return delay;
+}
+
+/* Reset backoff state, e.g. when the process is restarted on purpose. */
+void ouroboros_crash_reset(struct ouroboros_crash *crash) {
+	crash->failures = 0;
+}
+
+/* Get the termination record, where index 0 denotes the most recent one. If
+ * there is no such record, this function returns NULL. */
+const struct ouroboros_crash_record *ouroboros_crash_history(
+		const struct ouroboros_crash *crash, unsigned int index) {
+	if (index >= crash->count || index >= OUROBOROS_CRASH_HISTORY)
+		return NULL;
+	return &crash->history[(crash->count - 1 - index) % OUROBOROS_CRASH_HISTORY];
+}
@@ -0,0 +1,61 @@
+/*
+ * ouroboros - crash.h
+ * Copyright (c) 2015 Arkadiusz Bokowy
+ *
+ * This file is a part of a ouroboros.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef __CRASH_H
+#define __CRASH_H
+
+#include <time.h>
+
+
+/* the number of remembered process terminations */
+#define OUROBOROS_CRASH_HISTORY 16
+/* the number of recent terminations reported in the status */
+#define OUROBOROS_CRASH_STATUS 4
+
+
+struct ouroboros_crash_record {
+	struct timespec time;
+	double uptime;
+	int status;
+};
+
+
+struct ouroboros_crash {
+
+	/* exponential backoff boundaries */
+	double delay_min;
+	double delay_max;
+	/* the number of consecutive crashes */
+	int failures;
+
+	/* restart storm protection - token bucket */
+	int limit;
+	double window;
+	double tokens;
+	struct timespec refilled;
+
+	/* termination history (ring buffer) */
+	struct ouroboros_crash_record history[OUROBOROS_CRASH_HISTORY];
+	unsigned int count;
+
+};
+
+
+void ouroboros_crash_init(struct ouroboros_crash *crash, int limit, double window,
+		double delay_min, double delay_max);
+
+int ouroboros_crash_is_failure(int status);
+double ouroboros_crash_record(struct ouroboros_crash *crash, int status, double uptime);
+void ouroboros_crash_reset(struct ouroboros_crash *crash);
+
+const struct ouroboros_crash_record *ouroboros_crash_history(
+		const struct ouroboros_crash *crash, unsigned int index);
+
+#endif
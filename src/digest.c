@@ -0,0 +1,334 @@
+/*
+ * ouroboros - digest.c
+ * Copyright (c) 2015 Arkadiusz Bokowy
+ *
+ * This file is a part of a ouroboros.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include "digest.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "debug.h"
+
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+/* size of the buffer used for reading files */
+#define DIGEST_BUFFER_SIZE (64 * 1024)
+
+
+/* streaming state of the XXH64 hash function */
+struct _hash_state {
+	uint64_t total;
+	uint64_t v[4];
+	unsigned char stripe[32];
+	size_t stripe_len;
+	uint64_t seed;
+};
+
+static inline uint64_t _rotl(uint64_t x, int r) {
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t _read64(const unsigned char *p) {
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	return v;
+}
+
+static inline uint32_t _read32(const unsigned char *p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap32(v);
+#endif
+	return v;
+}
+
+static inline uint64_t _round(uint64_t acc, uint64_t input) {
+	acc += input * PRIME64_2;
+	return _rotl(acc, 31) * PRIME64_1;
+}
+
+static inline uint64_t _merge(uint64_t acc, uint64_t v) {
+	acc ^= _round(0, v);
+	return acc * PRIME64_1 + PRIME64_4;
+}
+
+static void _hash_init(struct _hash_state *state, uint64_t seed) {
+	state->total = 0;
+	state->v[0] = seed + PRIME64_1 + PRIME64_2;
+	state->v[1] = seed + PRIME64_2;
+	state->v[2] = seed;
+	state->v[3] = seed - PRIME64_1;
+	state->stripe_len = 0;
+	state->seed = seed;
+}
+
+/* Internal function which consumes 32-byte stripes. Four independent lanes
+ * are kept in registers, so the loop is limited by the memory bandwidth
+ * rather than by the multiplication latency. */
+static const unsigned char *_hash_stripes(uint64_t *v, const unsigned char *p,
+		const unsigned char *end) {
+
+	uint64_t v0 = v[0], v1 = v[1], v2 = v[2], v3 = v[3];
+
+	for (; p + 32 <= end; p += 32) {
+		v0 = _round(v0, _read64(p));
+		v1 = _round(v1, _read64(p + 8));
+		v2 = _round(v2, _read64(p + 16));
+		v3 = _round(v3, _read64(p + 24));
+	}
+
+	v[0] = v0, v[1] = v1, v[2] = v2, v[3] = v3;
+	return p;
+}
+
+static void _hash_update(struct _hash_state *state, const void *data, size_t len) {
+
+	const unsigned char *p = data;
+	const unsigned char *end = p + len;
+	size_t n;
+
+	state->total += len;
+
+	if (state->stripe_len > 0) {
+		n = 32 - state->stripe_len;
+		if (n > len)
+			n = len;
+		memcpy(&state->stripe[state->stripe_len], p, n);
+		state->stripe_len += n;
+		p += n;
+		if (state->stripe_len < 32)
+			return;
+		_hash_stripes(state->v, state->stripe, state->stripe + 32);
+		state->stripe_len = 0;
+	}
+
+	p = _hash_stripes(state->v, p, end);
+
+	if (p < end) {
+		memcpy(state->stripe, p, end - p);
+		state->stripe_len = end - p;
+	}
+
+}
+
+static uint64_t _hash_final(const struct _hash_state *state) {
+
+	const unsigned char *p = state->stripe;
+	const unsigned char *end = p + state->stripe_len;
+	uint64_t h;
+
+	if (state->total >= 32) {
+		h = _rotl(state->v[0], 1) + _rotl(state->v[1], 7) +
+			_rotl(state->v[2], 12) + _rotl(state->v[3], 18);
+		h = _merge(h, state->v[0]);
+		h = _merge(h, state->v[1]);
+		h = _merge(h, state->v[2]);
+		h = _merge(h, state->v[3]);
+	}
+	else
+		h = state->seed + PRIME64_5;
+
+	h += state->total;
+
+	for (; p + 8 <= end; p += 8)
+		h = _rotl(h ^ _round(0, _read64(p)), 27) * PRIME64_1 + PRIME64_4;
+	if (p + 4 <= end) {
+		h = _rotl(h ^ (_read32(p) * PRIME64_1), 23) * PRIME64_2 + PRIME64_3;
+		p += 4;
+	}
+	for (; p < end; p++)
+		h = _rotl(h ^ (*p * PRIME64_5), 11) * PRIME64_1;
+
+	h ^= h >> 33;
+	h *= PRIME64_2;
+	h ^= h >> 29;
+	h *= PRIME64_3;
+	h ^= h >> 32;
+
+	return h;
+}
+
+/* Compute the 64-bit non-cryptographic hash (XXH64) of the given data. */
+uint64_t ouroboros_digest_hash(uint64_t seed, const void *data, size_t len) {
+	struct _hash_state state;
+	_hash_init(&state, seed);
+	_hash_update(&state, data, len);
+	return _hash_final(&state);
+}
+
+/* Internal function which computes the hash of the file content. On success
+ * this function returns 0, otherwise -1. */
+static int _hash_file(const char *path, uint64_t *hash) {
+
+	unsigned char buffer[DIGEST_BUFFER_SIZE];
+	struct _hash_state state;
+	ssize_t rlen;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK)) == -1)
+		return -1;
+
+	_hash_init(&state, 0);
+	while ((rlen = read(fd, buffer, sizeof(buffer))) > 0)
+		_hash_update(&state, buffer, rlen);
+
+	close(fd);
+	if (rlen == -1)
+		return -1;
+
+	*hash = _hash_final(&state);
+	return 0;
+}
+
+/* Internal function which gets the index of the cache entry for the given
+ * path. If there is no such entry, the index of the insertion point is
+ * returned as -(index + 1). */
+static int _lookup(const struct ouroboros_digest *digest, const char *path) {
+
+	int lo = 0, hi = digest->size - 1;
+	int mid, rv;
+
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		if ((rv = strcmp(digest->entries[mid].path, path)) == 0)
+			return mid;
+		if (rv < 0)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+
+	return -(lo + 1);
+}
+
+/* Internal function which removes the cache entry at the given index. */
+static void _remove(struct ouroboros_digest *digest, int i) {
+	free(digest->entries[i].path);
+	memmove(&digest->entries[i], &digest->entries[i + 1],
+			sizeof(*digest->entries) * (digest->size - i - 1));
+	digest->size--;
+}
+
+/* Free allocated resources. */
+void ouroboros_digest_free(struct ouroboros_digest *digest) {
+	while (digest->size--)
+		free(digest->entries[digest->size].path);
+	free(digest->entries);
+	digest->entries = NULL;
+	digest->size = 0;
+}
+
+/* Verify whether the content of the given file has changed since the last
+ * call for the same path. Only regular files are verified - for any other
+ * node (or when the file can not be read) the change is assumed. The size
+ * of the hashed file is subtracted from the budget, and if the budget does
+ * not suffice, the change is assumed as well. If the content has changed,
+ * this function returns 1, otherwise 0. */
+int ouroboros_digest_verify(struct ouroboros_digest *digest, const char *path,
+		off_t *budget) {
+
+	struct ouroboros_digest_entry *entry;
+	struct timespec now;
+	struct stat s;
+	uint64_t hash;
+	int i;
+
+	i = _lookup(digest, path);
+
+	if (stat(path, &s) == -1 || !S_ISREG(s.st_mode) ||
+			s.st_size > OUROBOROS_DIGEST_MAX_SIZE) {
+		/* the node has been removed or it is not worth hashing */
+		if (i >= 0)
+			_remove(digest, i);
+		return 1;
+	}
+
+	if (i >= 0) {
+		entry = &digest->entries[i];
+		/* Metadata has not changed at all, e.g. the event was generated by
+		 * opening the file for writing without writing anything. However,
+		 * metadata is trusted only if the file had been modified before the
+		 * hash was taken - otherwise the file might have been modified again
+		 * within the timestamp granularity (racy-clean file). */
+		if (entry->dev == s.st_dev && entry->ino == s.st_ino &&
+				entry->size == s.st_size &&
+				entry->mtime.tv_sec == s.st_mtim.tv_sec &&
+				entry->mtime.tv_nsec == s.st_mtim.tv_nsec &&
+				entry->mtime.tv_sec + OUROBOROS_DIGEST_MTIME_GRANULARITY < entry->hashed.tv_sec)
+			return 0;
+	}
+
+	if (s.st_size > *budget) {
+		debug("digest budget exceeded: %s", path);
+		if (i >= 0)
+			_remove(digest, i);
+		return 1;
+	}
+
+	*budget -= s.st_size;
+	clock_gettime(CLOCK_REALTIME, &now);
+	if (_hash_file(path, &hash) == -1) {
+		debug("unable to hash file: %s: %s", path, strerror(errno));
+		if (i >= 0)
+			_remove(digest, i);
+		return 1;
+	}
+
+	if (i < 0) {
+
+		struct ouroboros_digest_entry *tmp;
+		char *name;
+
+		if ((name = strdup(path)) == NULL)
+			return 1;
+		if ((tmp = realloc(digest->entries, sizeof(*tmp) * (digest->size + 1))) == NULL) {
+			free(name);
+			return 1;
+		}
+		digest->entries = tmp;
+
+		i = -i - 1;
+		memmove(&digest->entries[i + 1], &digest->entries[i],
+				sizeof(*digest->entries) * (digest->size - i));
+		digest->size++;
+
+		entry = &digest->entries[i];
+		entry->path = name;
+		/* there is no baseline for the first sighting of the file */
+		entry->hash = ~hash;
+		entry->size = -1;
+
+	}
+
+	entry = &digest->entries[i];
+	i = entry->size != s.st_size || entry->hash != hash;
+
+	entry->dev = s.st_dev;
+	entry->ino = s.st_ino;
+	entry->size = s.st_size;
+	entry->mtime.tv_sec = s.st_mtim.tv_sec;
+	entry->mtime.tv_nsec = s.st_mtim.tv_nsec;
+	entry->hash = hash;
+	entry->hashed = now;
+
+	return i;
+}
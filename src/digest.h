@@ -0,0 +1,57 @@
+/*
+ * ouroboros - digest.h
+ * Copyright (c) 2015 Arkadiusz Bokowy
+ *
+ * This file is a part of a ouroboros.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef __DIGEST_H
+#define __DIGEST_H
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+
+
+/* files bigger than that are not hashed - they are always reported */
+#define OUROBOROS_DIGEST_MAX_SIZE (4 * 1024 * 1024)
+/* the maximum number of bytes hashed within one batch of changes, so the
+ * verification will not stall the caller for long */
+#define OUROBOROS_DIGEST_BATCH_SIZE (8 * 1024 * 1024)
+/* the coarsest granularity (in seconds) of the modification time - e.g. the
+ * FAT file system - within which the file might be modified again without
+ * any change of its metadata */
+#define OUROBOROS_DIGEST_MTIME_GRANULARITY 2
+
+
+/* content digest of the file, valid as long as metadata does not change */
+struct ouroboros_digest_entry {
+	char *path;
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	struct timespec mtime;
+	uint64_t hash;
+	/* the time when the content has been hashed */
+	struct timespec hashed;
+};
+
+/* Cache of content digests sorted by the path. Digests are computed lazily
+ * - upon the first change of the file - so the first change of every file
+ * can not be verified and it is always reported. */
+struct ouroboros_digest {
+	struct ouroboros_digest_entry *entries;
+	int size;
+};
+
+
+uint64_t ouroboros_digest_hash(uint64_t seed, const void *data, size_t len);
+
+void ouroboros_digest_free(struct ouroboros_digest *digest);
+int ouroboros_digest_verify(struct ouroboros_digest *digest, const char *path,
+		off_t *budget);
+
+#endif
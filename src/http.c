@@ -0,0 +1,270 @@
+/*
+ * ouroboros - http.c
+ * Copyright (c) 2015 Arkadiusz Bokowy
+ *
+ * This file is a part of a ouroboros.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+#define _GNU_SOURCE
+#include "http.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "debug.h"
+
+/* Initialize HTTP listener on the given IPv4 address. If the address is
+ * NULL (or it is not an IPv4 one), the loopback interface is used. This
+ * function returns pointer to the initialized structure or NULL upon error. */
+struct ouroboros_http *ouroboros_http_init(const struct sockaddr *addr, int port) {
+
+	struct ouroboros_http *http;
+	struct sockaddr_storage tmp = { 0 };
+	const int reuse = 1;
+
+	if (addr != NULL && addr->sa_family == AF_INET)
+		memcpy(&tmp, addr, sizeof(struct sockaddr_in));
+	else {
+		tmp.ss_family = AF_INET;
+		((struct sockaddr_in *)&tmp)->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	}
+
+	((struct sockaddr_in *)&tmp)->sin_port = htons(port);
+
+	if ((http = malloc(sizeof(struct ouroboros_http))) == NULL)
+		return NULL;
+
+	http->clients = 0;
+
+	if ((http->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1) {
+		perror("error: unable to create HTTP socket");
+		free(http);
+		return NULL;
+	}
+
+	setsockopt(http->fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+	debug("HTTP listening on port: %d", port);
+	if (bind(http->fd, (struct sockaddr *)&tmp, sizeof(struct sockaddr_in)) == -1 ||
+			listen(http->fd, 16) == -1) {
+		perror("error: unable to bind HTTP socket");
+		ouroboros_http_free(http);
+		return NULL;
+	}
+
+	return http;
+}
+
+/* Free allocated resources. */
+void ouroboros_http_free(struct ouroboros_http *http) {
+	close(http->fd);
+	free(http);
+}
+
+/* Accept new client connection. The client socket is non-blocking, so
+ * a slow client can not stall the caller - the request is read when the
+ * socket is readable and the response is written when it is writable. If
+ * the limit of connected clients has been reached, the connection is closed
+ * right away. This function returns pointer to the client structure or NULL
+ * upon error. */
+struct ouroboros_http_client *ouroboros_http_accept(struct ouroboros_http *http) {
+
+	struct ouroboros_http_client *client;
+	int fd;
+
+	if ((fd = accept4(http->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) == -1) {
+		if (errno != EAGAIN)
+			perror("warning: unable to accept HTTP connection");
+		return NULL;
+	}
+
+	if (http->clients >= OUROBOROS_HTTP_CLIENTS) {
+		fprintf(stderr, "warning: too many HTTP clients\n");
+		close(fd);
+		return NULL;
+	}
+
+	if ((client = malloc(sizeof(struct ouroboros_http_client))) == NULL) {
+		close(fd);
+		return NULL;
+	}
+
+	client->fd = fd;
+	client->http = http;
+	client->userdata = NULL;
+	client->source = NULL;
+	client->timer = NULL;
+	client->len = 0;
+	client->method = NULL;
+	client->path = NULL;
+	client->query = NULL;
+	client->response = NULL;
+	client->response_len = 0;
+	client->sent = 0;
+
+	http->clients++;
+
+	debug("HTTP new connection: fd=%d", fd);
+	return client;
+}
+
+/* Close client connection and free its resources. */
+void ouroboros_http_close(struct ouroboros_http_client *client) {
+	client->http->clients--;
+	close(client->fd);
+	free(client->response);
+	free(client);
+}
+
+/* Read available data of the request. The body of the request (if any) is
+ * ignored. If the request head has been read, this function returns 1, if
+ * more data is needed 0, and -1 if the connection shall be closed. */
+int ouroboros_http_read(struct ouroboros_http_client *client) {
+
+	char *tmp;
+	ssize_t rlen;
+
+	rlen = read(client->fd, &client->buffer[client->len],
+			sizeof(client->buffer) - client->len - 1);
+	if (rlen == -1 && errno == EAGAIN)
+		return 0;
+	if (rlen <= 0)
+		return -1;
+
+	client->len += rlen;
+	client->buffer[client->len] = '\0';
+
+	if ((tmp = strstr(client->buffer, "\r\n\r\n")) == NULL &&
+			(tmp = strstr(client->buffer, "\n\n")) == NULL) {
+		/* request head does not fit into our buffer */
+		if (client->len == sizeof(client->buffer) - 1)
+			return -1;
+		return 0;
+	}
+
+	/* parse the request line: METHOD PATH[?QUERY] VERSION */
+	client->method = strtok_r(client->buffer, " ", &tmp);
+	client->path = strtok_r(NULL, " \r\n", &tmp);
+	if (client->method == NULL || client->path == NULL)
+		return -1;
+
+	if ((tmp = strchr(client->path, '?')) != NULL) {
+		*tmp = '\0';
+		client->query = tmp + 1;
+	}
+
+	debug("HTTP request: %s %s", client->method, client->path);
+	return 1;
+}
+
+/* Get the value of the query parameter. Percent-encoding is not decoded,
+ * because parameters are expected to be simple names. This function returns
+ * the value stored in the given buffer or NULL if there is no parameter. */
+const char *ouroboros_http_param(const struct ouroboros_http_client *client,
+		const char *name, char *value, size_t size) {
+
+	const char *tmp = client->query;
+	size_t len = strlen(name);
+	size_t n;
+
+	while (tmp != NULL && *tmp != '\0') {
+		n = strcspn(tmp, "&");
+		if (n > len && strncmp(tmp, name, len) == 0 && tmp[len] == '=') {
+			n -= len + 1;
+			if (n >= size)
+				n = size - 1;
+			memcpy(value, &tmp[len + 1], n);
+			value[n] = '\0';
+			return value;
+		}
+		tmp += n;
+		if (*tmp == '&')
+			tmp++;
+	}
+
+	return NULL;
+}
+
+/* Send the response to the client. If the response has been sent, this
+ * function returns 1. If the socket is not writable, the rest of the
+ * response is kept in the client structure and 0 is returned - it shall be
+ * sent with the ouroboros_http_write() when the socket becomes writable.
+ * Upon error this function returns -1. */
+int ouroboros_http_respond(struct ouroboros_http_client *client, int status,
+		const char *type, const char *body, size_t len) {
+
+	const char *reason;
+	int n;
+
+	switch (status) {
+	case 200:
+		reason = "OK";
+		break;
+	case 400:
+		reason = "Bad Request";
+		break;
+	case 404:
+		reason = "Not Found";
+		break;
+	case 405:
+		reason = "Method Not Allowed";
+		break;
+	default:
+		reason = "Internal Server Error";
+	}
+
+	free(client->response);
+	client->response = NULL;
+	client->response_len = client->sent = 0;
+
+	if ((n = asprintf(&client->response, "HTTP/1.0 %d %s\r\n"
+					"Content-Type: %s\r\n"
+					"Content-Length: %zu\r\n"
+					"Connection: close\r\n\r\n",
+					status, reason, type, len)) == -1) {
+		client->response = NULL;
+		return -1;
+	}
+
+	if (len > 0) {
+		char *tmp;
+		if ((tmp = realloc(client->response, n + len)) == NULL)
+			return -1;
+		memcpy(&tmp[n], body, len);
+		client->response = tmp;
+	}
+
+	client->response_len = n + len;
+	return ouroboros_http_write(client);
+}
+
+/* Write the pending response. If the response has been sent entirely, this
+ * function returns 1, if the socket is not writable 0, and -1 upon error. */
+int ouroboros_http_write(struct ouroboros_http_client *client) {
+
+	ssize_t rv;
+
+	while (client->sent < client->response_len) {
+		if ((rv = send(client->fd, &client->response[client->sent],
+						client->response_len - client->sent, MSG_NOSIGNAL)) == -1) {
+			if (errno == EAGAIN)
+				return 0;
+			return -1;
+		}
+		client->sent += rv;
+	}
+
+	return 1;
+}
@@ -0,0 +1,77 @@
+/*
+ * ouroboros - http.h
+ * Copyright (c) 2015 Arkadiusz Bokowy
+ *
+ * This file is a part of a ouroboros.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef __HTTP_H
+#define __HTTP_H
+
+#include <stddef.h>
+#include <sys/socket.h>
+
+#include "loop.h"
+
+
+/* the maximum size of the request head */
+#define OUROBOROS_HTTP_REQUEST_SIZE 4096
+/* the maximum number of concurrently served clients */
+#define OUROBOROS_HTTP_CLIENTS 16
+/* time (in seconds) within which the client has to send the request and
+ * receive the response */
+#define OUROBOROS_HTTP_TIMEOUT 5
+
+
+/* single client connection - one request per connection */
+struct ouroboros_http_client {
+
+	int fd;
+	struct ouroboros_http *http;
+	void *userdata;
+
+	/* event loop sources of the connection */
+	struct ouroboros_loop_source *source;
+	struct ouroboros_loop_source *timer;
+
+	/* request head */
+	char buffer[OUROBOROS_HTTP_REQUEST_SIZE];
+	size_t len;
+
+	/* parsed request - they refer to the buffer */
+	const char *method;
+	const char *path;
+	const char *query;
+
+	/* response which has not been sent yet */
+	char *response;
+	size_t response_len;
+	size_t sent;
+
+};
+
+struct ouroboros_http {
+	/* listening socket */
+	int fd;
+	/* the number of connected clients */
+	int clients;
+};
+
+
+struct ouroboros_http *ouroboros_http_init(const struct sockaddr *addr, int port);
+void ouroboros_http_free(struct ouroboros_http *http);
+
+struct ouroboros_http_client *ouroboros_http_accept(struct ouroboros_http *http);
+void ouroboros_http_close(struct ouroboros_http_client *client);
+
+int ouroboros_http_read(struct ouroboros_http_client *client);
+const char *ouroboros_http_param(const struct ouroboros_http_client *client,
+		const char *name, char *value, size_t size);
+int ouroboros_http_respond(struct ouroboros_http_client *client, int status,
+		const char *type, const char *body, size_t len);
+int ouroboros_http_write(struct ouroboros_http_client *client);
+
+#endif
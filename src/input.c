@@ -0,0 +1,176 @@
+/*
+ * ouroboros - input.c
+ * Copyright (c) 2015 Arkadiusz Bokowy
+ *
+ * This file is a part of a ouroboros.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+#define _GNU_SOURCE
+#include "input.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "debug.h"
+
+
+/* the maximum amount of data moved by a single transfer, it is also the
+ * size of the buffer used when the source does not support splice() */
+#define INPUT_CHUNK_SIZE (64 * 1024)
+
+
+/* Initialize forwarding of the given descriptor into the process input pipe.
+ * The pipe is not closed between process restarts, so data which has not
+ * been consumed by the terminated process (or written during the restart)
+ * will be read by the next one. This function returns pointer to the
+ * initialized input structure or NULL upon error. */
+struct ouroboros_input *ouroboros_input_init(int fd, int pipefd) {
+
+	struct ouroboros_input *input;
+	int flags;
+
+	if ((input = malloc(sizeof(struct ouroboros_input))) == NULL)
+		return NULL;
+
+	input->fd = fd;
+	input->splice = 1;
+	input->eof = 0;
+	input->pipefd = pipefd;
+	input->blocked = 0;
+	input->size = INPUT_CHUNK_SIZE;
+	input->len = 0;
+	input->bytes = 0;
+
+	if ((input->buffer = malloc(input->size)) == NULL) {
+		free(input);
+		return NULL;
+	}
+
+	/* full pipe shall not block us - we will wait for it with the poll() */
+	if ((flags = fcntl(pipefd, F_GETFL)) == -1 ||
+			fcntl(pipefd, F_SETFL, flags | O_NONBLOCK) == -1) {
+		perror("error: unable to setup input pipe");
+		ouroboros_input_free(input);
+		return NULL;
+	}
+
+	/* The bigger the pipe is, the more data can be carried over a restart.
+	 * It is not an error if we are not allowed to enlarge it, though. */
+	if (fcntl(pipefd, F_SETPIPE_SZ, OUROBOROS_INPUT_PIPE_SIZE) == -1)
+		debug("unable to resize input pipe: %s", strerror(errno));
+
+	return input;
+}
+
+/* Free allocated resources. */
+void ouroboros_input_free(struct ouroboros_input *input) {
+	free(input->buffer);
+	free(input);
+}
+
+/* Setup poll structure for the current state of the forwarding. If the pipe
+ * is full, we have to wait until the process consumes some data, otherwise
+ * we wait for new data from the source. */
+void ouroboros_input_poll(struct ouroboros_input *input, struct pollfd *pfd) {
+
+	if (input->blocked) {
+		pfd->fd = input->pipefd;
+		pfd->events = POLLOUT;
+	}
+	else {
+		pfd->fd = input->eof ? -1 : input->fd;
+		pfd->events = POLLIN;
+	}
+
+}
+
+/* Internal function which writes buffered data into the pipe. If the pipe
+ * has become full, then this function returns -1. */
+static int _input_flush(struct ouroboros_input *input) {
+
+	ssize_t rv;
+
+	while (input->len > 0) {
+		if ((rv = write(input->pipefd, input->buffer, input->len)) == -1) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN)
+				return -1;
+			perror("warning: data lost during input forwarding");
+			input->len = 0;
+			break;
+		}
+		input->len -= rv;
+		input->bytes += rv;
+		memmove(input->buffer, &input->buffer[rv], input->len);
+	}
+
+	return 0;
+}
+
+/* Dispatch readiness of the source or the pipe. Data is moved from the source
+ * into the pipe with the splice(), so it does not go through the user-space.
+ * If the source does not support it (e.g. it is a terminal), data is copied
+ * through the bounded buffer. When the pipe is full, reading from the source
+ * is suspended. Upon error this function returns -1. */
+int ouroboros_input_dispatch(struct ouroboros_input *input) {
+
+	ssize_t rv;
+
+	if (input->blocked || input->len > 0) {
+		/* pipe was full - write pending data and resume reading */
+		input->blocked = _input_flush(input) == -1;
+		return 0;
+	}
+
+	if (input->splice) {
+		rv = splice(input->fd, NULL, input->pipefd, NULL, INPUT_CHUNK_SIZE,
+				SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (rv == -1 && errno == EINVAL) {
+			debug("input splice not supported: fd=%d", input->fd);
+			input->splice = 0;
+		}
+	}
+
+	if (!input->splice) {
+		if ((rv = read(input->fd, input->buffer, input->size)) > 0) {
+			input->len = rv;
+			input->blocked = _input_flush(input) == -1;
+			return 0;
+		}
+	}
+
+	if (rv == -1) {
+		if (errno == EINTR)
+			return 0;
+		if (errno == EAGAIN) {
+			/* the source has been reported as readable, so it has to be
+			 * the pipe which is full */
+			input->blocked = 1;
+			return 0;
+		}
+		perror("error: unable to forward input");
+		return -1;
+	}
+
+	if (rv == 0) {
+		debug("input EOF: fd=%d", input->fd);
+		input->eof = 1;
+	}
+
+	if (input->splice)
+		input->bytes += rv;
+
+	return 0;
+}
@@ -0,0 +1,52 @@
+/*
+ * ouroboros - input.h
+ * Copyright (c) 2015 Arkadiusz Bokowy
+ *
+ * This file is a part of a ouroboros.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef __INPUT_H
+#define __INPUT_H
+
+#include <poll.h>
+#include <stddef.h>
+
+
+/* requested capacity of the process input pipe */
+#define OUROBOROS_INPUT_PIPE_SIZE (1024 * 1024)
+
+
+struct ouroboros_input {
+
+	/* forwarded descriptor */
+	int fd;
+	/* source supports splice() */
+	int splice;
+	int eof;
+
+	/* write end of the process input pipe */
+	int pipefd;
+	/* pipe is full - wait until it becomes writable */
+	int blocked;
+
+	/* data which has not been written into the pipe yet */
+	char *buffer;
+	size_t size;
+	size_t len;
+
+	/* forwarded data statistics */
+	unsigned long long bytes;
+
+};
+
+
+struct ouroboros_input *ouroboros_input_init(int fd, int pipefd);
+void ouroboros_input_free(struct ouroboros_input *input);
+
+void ouroboros_input_poll(struct ouroboros_input *input, struct pollfd *pfd);
+int ouroboros_input_dispatch(struct ouroboros_input *input);
+
+#endif
@@ -0,0 +1,139 @@
+/*
+ * ouroboros - liveness.c
+ * Copyright (c) 2015 Arkadiusz Bokowy
+ *
+ * This file is a part of a ouroboros.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include "liveness.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "metrics.h"
+#include "ready.h"
+
+
+/* Internal function which gets the CPU time (in clock ticks) consumed by
+ * the given process. Upon error this function returns 0. */
+static unsigned long long _cpu_time(pid_t pid) {
+
+	unsigned long long utime = 0, stime = 0;
+	char buffer[1024];
+	char *tmp;
+	FILE *f;
+
+	sprintf(buffer, "/proc/%d/stat", pid);
+	if ((f = fopen(buffer, "r")) == NULL)
+		return 0;
+	tmp = fgets(buffer, sizeof(buffer), f);
+	fclose(f);
+
+	/* command name might contain spaces, so skip it as a whole - CPU times
+	 * are the 14th and 15th fields of the stat file */
+	if (tmp == NULL || (tmp = strrchr(buffer, ')')) == NULL ||
+			sscanf(tmp, ") %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu",
+				&utime, &stime) != 2)
+		return 0;
+
+	return utime + stime;
+}
+
+/* Initialize liveness checks. If the watchdog timeout is given, it is
+ * exported via the WATCHDOG_USEC environment variable, so the sd_notify(3)
+ * client knows how often it shall send heartbeats. This function returns
+ * pointer to the initialized structure or NULL upon error. */
+struct ouroboros_liveness *ouroboros_liveness_init(double watchdog, int port, double idle) {
+
+	struct ouroboros_liveness *liveness;
+	char tmp[32];
+
+	if ((liveness = malloc(sizeof(struct ouroboros_liveness))) == NULL)
+		return NULL;
+
+	liveness->watchdog = watchdog;
+	liveness->port = port;
+	liveness->idle = idle;
+	liveness->failures = 0;
+	liveness->probe = -1;
+	liveness->cpu = 0;
+
+	if (watchdog > 0) {
+		sprintf(tmp, "%llu", (unsigned long long)(watchdog * 1000000));
+		setenv("WATCHDOG_USEC", tmp, 1);
+	}
+
+	return liveness;
+}
+
+/* Free allocated resources. */
+void ouroboros_liveness_free(struct ouroboros_liveness *liveness) {
+	if (liveness->watchdog > 0)
+		unsetenv("WATCHDOG_USEC");
+	if (liveness->probe != -1)
+		close(liveness->probe);
+	free(liveness);
+}
+
+/* Reset the state of checks. This function shall be called when the newly
+ * started process becomes ready. */
+void ouroboros_liveness_reset(struct ouroboros_liveness *liveness, pid_t pid) {
+	clock_gettime(CLOCK_MONOTONIC, &liveness->heartbeat);
+	liveness->active = liveness->heartbeat;
+	liveness->cpu = _cpu_time(pid);
+	liveness->failures = 0;
+	if (liveness->probe != -1)
+		close(liveness->probe);
+	liveness->probe = -1;
+}
+
+/* Record the heartbeat received from the process. */
+void ouroboros_liveness_heartbeat(struct ouroboros_liveness *liveness) {
+	clock_gettime(CLOCK_MONOTONIC, &liveness->heartbeat);
+}
+
+/* Check whether the process is alive. None of the checks blocks, so this
+ * function can be called from the main loop. If the process is alive, this
+ * function returns NULL, otherwise the reason of the failure. */
+const char *ouroboros_liveness_check(struct ouroboros_liveness *liveness, pid_t pid) {
+
+	unsigned long long cpu;
+	int rv;
+
+	if (liveness->watchdog > 0 &&
+			ouroboros_metrics_since(&liveness->heartbeat) > liveness->watchdog)
+		return "watchdog timeout";
+
+	if (liveness->port > 0) {
+		/* connection which was in progress during the previous check has
+		 * been given the whole interval - it is not awaited any longer */
+		if (liveness->probe != -1) {
+			rv = ouroboros_ready_probe_result(liveness->probe);
+			liveness->probe = -1;
+		}
+		else
+			rv = ouroboros_ready_probe(liveness->port, &liveness->probe);
+		if (rv == 1)
+			liveness->failures = 0;
+		else if (rv == 0 && ++liveness->failures >= OUROBOROS_LIVENESS_FAILURES)
+			return "port probe failed";
+	}
+
+	if (liveness->idle > 0) {
+		if ((cpu = _cpu_time(pid)) != liveness->cpu) {
+			clock_gettime(CLOCK_MONOTONIC, &liveness->active);
+			liveness->cpu = cpu;
+		}
+		else if (ouroboros_metrics_since(&liveness->active) > liveness->idle)
+			return "CPU idle";
+	}
+
+	debug("liveness check passed: pid=%d", pid);
+	return NULL;
+}
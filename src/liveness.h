@@ -0,0 +1,53 @@
+/*
+ * ouroboros - liveness.h
+ * Copyright (c) 2015 Arkadiusz Bokowy
+ *
+ * This file is a part of a ouroboros.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef __LIVENESS_H
+#define __LIVENESS_H
+
+#include <sys/types.h>
+#include <time.h>
+
+
+/* the number of consecutive failed TCP probes which marks the process
+ * as not alive - single failure might be caused by a short load spike */
+#define OUROBOROS_LIVENESS_FAILURES 3
+
+
+/* Liveness checks of the ready process. Process which has deadlocked (or
+ * got stuck in some other way) does not terminate, so it has to be detected
+ * by missing heartbeats, failing probes or the lack of CPU activity. */
+struct ouroboros_liveness {
+
+	/* sd_notify(3) WATCHDOG=1 heartbeat timeout (or 0) */
+	double watchdog;
+	struct timespec heartbeat;
+
+	/* TCP port probed on the loopback interface (or 0) */
+	int port;
+	int failures;
+	/* probe connection which is in progress (or -1) */
+	int probe;
+
+	/* the maximum time (or 0) without consumed CPU time */
+	double idle;
+	unsigned long long cpu;
+	struct timespec active;
+
+};
+
+
+struct ouroboros_liveness *ouroboros_liveness_init(double watchdog, int port, double idle);
+void ouroboros_liveness_free(struct ouroboros_liveness *liveness);
+
+void ouroboros_liveness_reset(struct ouroboros_liveness *liveness, pid_t pid);
+void ouroboros_liveness_heartbeat(struct ouroboros_liveness *liveness);
+const char *ouroboros_liveness_check(struct ouroboros_liveness *liveness, pid_t pid);
+
+#endif
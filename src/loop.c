@@ -0,0 +1,332 @@
+/*
+ * ouroboros - loop.c
+ * Copyright (c) 2015 Arkadiusz Bokowy
+ *
+ * This file is a part of a ouroboros.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+#define _GNU_SOURCE
+#include "loop.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+
+#include "debug.h"
+
+
+/* Initialize event loop. This function returns pointer to the initialized
+ * loop structure or NULL upon error. */
+struct ouroboros_loop *ouroboros_loop_init(void) {
+
+	struct ouroboros_loop *loop;
+
+	if ((loop = malloc(sizeof(struct ouroboros_loop))) == NULL)
+		return NULL;
+
+	memset(loop, 0, sizeof(*loop));
+	loop->sigfd = -1;
+	sigemptyset(&loop->sigmask);
+
+	if ((loop->epfd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+		perror("error: unable to create epoll instance");
+		free(loop);
+		return NULL;
+	}
+
+	return loop;
+}
+
+/* Internal function which releases source resources. */
+static void _source_free(struct ouroboros_loop_source *source) {
+	if (source->timer)
+		close(source->fd);
+	free(source);
+}
+
+/* Free allocated resources. Note, that handled signals are left blocked, so
+ * the one which arrives during the shutdown will not terminate us. */
+void ouroboros_loop_free(struct ouroboros_loop *loop) {
+
+	struct ouroboros_loop_source *source;
+
+	while ((source = loop->sources) != NULL) {
+		loop->sources = source->next;
+		_source_free(source);
+	}
+
+	if (loop->sigfd != -1)
+		close(loop->sigfd);
+	close(loop->epfd);
+	free(loop);
+}
+
+/* Register file descriptor in the event loop. Callback will be called every
+ * time the descriptor becomes ready for given events. Descriptors which are
+ * not supported by the epoll (e.g. regular files) are accepted as well - the
+ * same as poll() does, they are always reported as ready. This function
+ * returns pointer to the source handle or NULL upon error. */
+struct ouroboros_loop_source *ouroboros_loop_add(struct ouroboros_loop *loop,
+		int fd, uint32_t events, ouroboros_loop_callback callback, void *userdata) {
+
+	struct ouroboros_loop_source *source;
+	struct epoll_event event = { 0 };
+
+	if ((source = malloc(sizeof(struct ouroboros_loop_source))) == NULL)
+		return NULL;
+
+	source->loop = loop;
+	source->fd = fd;
+	source->events = events;
+	source->callback = callback;
+	source->userdata = userdata;
+	source->timer = 0;
+	source->always = 0;
+	source->removed = 0;
+
+	event.events = events;
+	event.data.ptr = source;
+	if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &event) == -1) {
+		if (errno != EPERM) {
+			free(source);
+			return NULL;
+		}
+		debug("fd not pollable: fd=%d", fd);
+		source->always = 1;
+		loop->always++;
+	}
+
+	source->next = loop->sources;
+	loop->sources = source;
+	return source;
+}
+
+/* Change events for which the source callback is called. On success this
+ * function returns 0, otherwise -1. */
+int ouroboros_loop_modify(struct ouroboros_loop_source *source, uint32_t events) {
+
+	struct epoll_event event = { 0 };
+
+	event.events = events;
+	event.data.ptr = source;
+	if (!source->always &&
+			epoll_ctl(source->loop->epfd, EPOLL_CTL_MOD, source->fd, &event) == -1)
+		return -1;
+
+	source->events = events;
+	return 0;
+}
+
+/* Remove source from the event loop. The callback of the removed source will
+ * not be called anymore - even for events which have been already received
+ * within the current dispatch. It is safe to call it with NULL. */
+void ouroboros_loop_remove(struct ouroboros_loop_source *source) {
+
+	if (source == NULL || source->removed)
+		return;
+
+	if (source->always)
+		source->loop->always--;
+	else
+		/* descriptor might have been closed already, which is fine */
+		epoll_ctl(source->loop->epfd, EPOLL_CTL_DEL, source->fd, NULL);
+
+	source->removed = 1;
+}
+
+/* Create timer source based on the CLOCK_MONOTONIC, so it is not affected by
+ * the system time changes. Created timer is disarmed. This function returns
+ * pointer to the source handle or NULL upon error. */
+struct ouroboros_loop_source *ouroboros_loop_timer(struct ouroboros_loop *loop,
+		ouroboros_loop_callback callback, void *userdata) {
+
+	struct ouroboros_loop_source *source;
+	int fd;
+
+	if ((fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) == -1) {
+		perror("error: unable to create timer");
+		return NULL;
+	}
+
+	if ((source = ouroboros_loop_add(loop, fd, EPOLLIN, callback, userdata)) == NULL) {
+		close(fd);
+		return NULL;
+	}
+
+	source->timer = 1;
+	return source;
+}
+
+/* Internal function which converts time given in seconds. */
+static void _timespec(struct timespec *ts, double seconds) {
+	ts->tv_sec = (time_t)seconds;
+	ts->tv_nsec = (seconds - ts->tv_sec) * 1e9;
+}
+
+/* Arm timer to expire after given delay (in seconds), and if the interval is
+ * not 0, periodically afterwards. Zero delay expires as soon as possible,
+ * while the negative one disarms the timer. On success this function returns
+ * 0, otherwise -1. */
+int ouroboros_loop_timer_set(struct ouroboros_loop_source *source,
+		double delay, double interval) {
+
+	struct itimerspec its = { 0 };
+
+	if (delay >= 0) {
+		_timespec(&its.it_value, delay);
+		_timespec(&its.it_interval, interval);
+		/* zero value disarms timerfd */
+		if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0)
+			its.it_value.tv_nsec = 1;
+	}
+
+	if (timerfd_settime(source->fd, 0, &its, NULL) == -1) {
+		perror("warning: unable to set timer");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Internal callback which dispatches signals received via the signalfd. */
+static void _loop_signal(struct ouroboros_loop_source *source,
+		uint32_t events, void *userdata) {
+
+	struct ouroboros_loop *loop = userdata;
+	struct signalfd_siginfo info;
+	int sig;
+
+	while (read(loop->sigfd, &info, sizeof(info)) == sizeof(info)) {
+		sig = info.ssi_signo;
+		debug("received signal: %d", sig);
+		if (sig < NSIG && loop->signals[sig].callback != NULL)
+			loop->signals[sig].callback(sig, loop->signals[sig].userdata);
+	}
+
+}
+
+/* Handle given signal in the event loop. The signal is blocked, so it will
+ * be received synchronously by the loop instead of interrupting us. Note,
+ * that not all signals can be handled (e.g. SIGKILL). On success this
+ * function returns 0, otherwise -1. */
+int ouroboros_loop_signal(struct ouroboros_loop *loop, int sig,
+		ouroboros_loop_signal_callback callback, void *userdata) {
+
+	sigset_t sigmask;
+	int fd;
+
+	if (sig <= 0 || sig >= NSIG || sig == SIGKILL || sig == SIGSTOP) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	sigmask = loop->sigmask;
+	sigaddset(&sigmask, sig);
+
+	if (sigprocmask(SIG_BLOCK, &sigmask, NULL) == -1)
+		return -1;
+	if ((fd = signalfd(loop->sigfd, &sigmask, SFD_NONBLOCK | SFD_CLOEXEC)) == -1)
+		return -1;
+
+	if (loop->sigfd == -1) {
+		if (ouroboros_loop_add(loop, fd, EPOLLIN, _loop_signal, loop) == NULL) {
+			close(fd);
+			return -1;
+		}
+		loop->sigfd = fd;
+	}
+
+	loop->sigmask = sigmask;
+	loop->signals[sig].callback = callback;
+	loop->signals[sig].userdata = userdata;
+	return 0;
+}
+
+/* Internal function which calls the source callback. */
+static void _dispatch(struct ouroboros_loop_source *source, uint32_t events) {
+
+	uint64_t expirations;
+
+	if (source->removed)
+		return;
+
+	/* timer might have been re-armed by other callback from this batch */
+	if (source->timer &&
+			read(source->fd, &expirations, sizeof(expirations)) == -1)
+		return;
+
+	source->callback(source, events, source->userdata);
+}
+
+/* Internal function which frees removed sources. */
+static void _collect(struct ouroboros_loop *loop) {
+
+	struct ouroboros_loop_source **tmp = &loop->sources;
+	struct ouroboros_loop_source *source;
+
+	while ((source = *tmp) != NULL) {
+		if (source->removed) {
+			*tmp = source->next;
+			_source_free(source);
+		}
+		else
+			tmp = &source->next;
+	}
+
+}
+
+/* Run the event loop until it is stopped with the ouroboros_loop_stop(). Only
+ * ready sources are visited upon the wakeup, so the cost of the dispatch does
+ * not depend on the number of registered descriptors. Upon error this function
+ * returns -1, otherwise 0. */
+int ouroboros_loop_run(struct ouroboros_loop *loop) {
+
+	struct epoll_event events[OUROBOROS_LOOP_EVENTS];
+	struct ouroboros_loop_source *source;
+	int rv = 0;
+	int i, n;
+
+	loop->running = 1;
+	while (loop->running) {
+
+		if ((n = epoll_wait(loop->epfd, events, OUROBOROS_LOOP_EVENTS,
+						loop->always ? 0 : -1)) == -1) {
+			if (errno == EINTR)
+				/* signal interruption, not a big deal */
+				continue;
+			perror("error: epoll wait failed");
+			rv = -1;
+			break;
+		}
+
+		for (i = 0; i < n; i++)
+			_dispatch(events[i].data.ptr, events[i].events);
+
+		/* Sources added by callbacks are placed at the beginning of the list,
+		 * so they will not be visited until the next iteration. */
+		if (loop->always)
+			for (source = loop->sources; source != NULL; source = source->next)
+				if (source->always)
+					_dispatch(source, source->events & (EPOLLIN | EPOLLOUT));
+
+		_collect(loop);
+	}
+
+	return rv;
+}
+
+/* Stop the event loop. The loop returns after the current dispatch. */
+void ouroboros_loop_stop(struct ouroboros_loop *loop) {
+	loop->running = 0;
+}
@@ -0,0 +1,94 @@
+/*
+ * ouroboros - loop.h
+ * Copyright (c) 2015 Arkadiusz Bokowy
+ *
+ * This file is a part of a ouroboros.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef __LOOP_H
+#define __LOOP_H
+
+#include <signal.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+
+
+/* the maximum number of events dispatched by a single wakeup */
+#define OUROBOROS_LOOP_EVENTS 64
+
+
+struct ouroboros_loop;
+struct ouroboros_loop_source;
+
+/* Callback for the descriptor readiness, where events are epoll(7) flags.
+ * For timers the callback is called once per expiration batch. */
+typedef void (*ouroboros_loop_callback)(struct ouroboros_loop_source *source,
+		uint32_t events, void *userdata);
+/* Callback for the received signal. */
+typedef void (*ouroboros_loop_signal_callback)(int sig, void *userdata);
+
+/* registered file descriptor */
+struct ouroboros_loop_source {
+
+	struct ouroboros_loop *loop;
+	int fd;
+	uint32_t events;
+
+	ouroboros_loop_callback callback;
+	void *userdata;
+
+	/* descriptor is a timerfd owned by the source */
+	int timer;
+	/* descriptor can not be polled (e.g. regular file), so it is always
+	 * considered as ready - in the same way as poll() does it */
+	int always;
+	/* source has been removed, it will be freed after the dispatch */
+	int removed;
+
+	struct ouroboros_loop_source *next;
+
+};
+
+struct ouroboros_loop {
+
+	int epfd;
+	int running;
+
+	/* all registered sources */
+	struct ouroboros_loop_source *sources;
+	int always;
+
+	/* signals are received synchronously via the signalfd */
+	int sigfd;
+	sigset_t sigmask;
+	struct {
+		ouroboros_loop_signal_callback callback;
+		void *userdata;
+	} signals[NSIG];
+
+};
+
+
+struct ouroboros_loop *ouroboros_loop_init(void);
+void ouroboros_loop_free(struct ouroboros_loop *loop);
+
+struct ouroboros_loop_source *ouroboros_loop_add(struct ouroboros_loop *loop,
+		int fd, uint32_t events, ouroboros_loop_callback callback, void *userdata);
+int ouroboros_loop_modify(struct ouroboros_loop_source *source, uint32_t events);
+void ouroboros_loop_remove(struct ouroboros_loop_source *source);
+
+struct ouroboros_loop_source *ouroboros_loop_timer(struct ouroboros_loop *loop,
+		ouroboros_loop_callback callback, void *userdata);
+int ouroboros_loop_timer_set(struct ouroboros_loop_source *source,
+		double delay, double interval);
+
+int ouroboros_loop_signal(struct ouroboros_loop *loop, int sig,
+		ouroboros_loop_signal_callback callback, void *userdata);
+
+int ouroboros_loop_run(struct ouroboros_loop *loop);
+void ouroboros_loop_stop(struct ouroboros_loop *loop);
+
+#endif
@@ -13,6 +13,7 @@
 #endif
 
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <libgen.h>
 #include <poll.h>
@@ -24,35 +25,1398 @@
 #include <sys/wait.h>
 
 #include "config.h"
+#include "crash.h"
 #include "debug.h"
+#include "input.h"
+#include "liveness.h"
+#include "loop.h"
+#include "metrics.h"
 #include "notify.h"
+#include "output.h"
 #include "process.h"
+#include "proxy.h"
+#include "ready.h"
+#include "recycle.h"
+#include "service.h"
+#include "trace.h"
+#include "vcs.h"
+#include "zygote.h"
 #if ENABLE_SERVER
+#include "agent.h"
+#include "http.h"
 #include "server.h"
 #endif
 
 
-/* Global variable and handler (callback) for signal redirections. */
-static pid_t sr_pid = 0;
-static void sr_handler(int sig) {
+/* pending actions of the supervised process */
+enum action {
+	ACTION_NONE = 0,
+	ACTION_KILL,
+	ACTION_START,
+	ACTION_STOP,
+};
+
+/* causes of the process start */
+enum cause {
+	CAUSE_INITIAL = 0,
+	CAUSE_CHANGE,
+	CAUSE_REQUEST,
+	CAUSE_CRASH,
+	CAUSE_DEMAND,
+	CAUSE_LIVENESS,
+	CAUSE_RECYCLE,
+	CAUSE_COUNT,
+};
+
+/* State of the supervisor shared by all event loop callbacks. */
+struct supervisor {
+
+	struct ouroboros_config *config;
+	char **argv;
+	/* command was given in the command line */
+	int command;
+	int verbose;
+
+	struct ouroboros_loop *loop;
+	struct ouroboros_process process;
+	struct ouroboros_crash crash;
+	struct ouroboros_notify *notify;
+	struct ouroboros_server *server;
+	struct ouroboros_http *http;
+	struct ouroboros_proxy *proxy;
+	struct ouroboros_zygote *zygote;
+	struct ouroboros_output *output;
+	struct ouroboros_input *input;
+	struct ouroboros_ready *ready;
+	struct ouroboros_service *services;
+	struct ouroboros_service_scope scope;
+
+	/* event sources which are changed during the operation */
+	struct ouroboros_loop_source *action_timer;
+	struct ouroboros_loop_source *process_source;
+	struct ouroboros_loop_source *kill_timer;
+	struct ouroboros_loop_source *zygote_source;
+	struct ouroboros_loop_source *zygote_timer;
+	struct ouroboros_loop_source *input_source;
+	struct pollfd input_pfd;
+	struct ouroboros_loop_source *dump_timer;
+
+	enum action action;
+	/* start is waiting for the termination of the killed process */
+	int start_pending;
+	/* output dump is waiting for the data pending in the capture pipe */
+	int dump_pending;
+	struct timespec dump_requested;
+	int stopped;
+	int stale;
+	int failed;
+
+	/* stopped on request - not started until requested */
+	int halted;
+	/* changes are deferred until watching is resumed */
+	int paused;
+	char **deferred;
+
+	/* Readiness of the started process is detected (rather than assumed),
+	 * so restarts triggered in the meantime are deferred until then. */
+	int readiness;
+	int restart_deferred;
+	struct ouroboros_loop_source *probe_timer;
+	/* port probe connection which is in progress */
+	struct ouroboros_loop_source *probe_source;
+	struct ouroboros_loop_source *ready_timer;
+
+	/* liveness of the ready process */
+	struct ouroboros_liveness *liveness;
+	struct ouroboros_loop_source *liveness_timer;
+	/* recycling of the long-running process */
+	struct ouroboros_recycle *recycle;
+	struct ouroboros_loop_source *recycle_timer;
+	/* files which are being written are checked with intervals */
+	struct ouroboros_loop_source *settle_timer;
+	int settling;
+	/* changes are deferred while the git operation is in progress */
+	struct ouroboros_vcs *vcs;
+	struct ouroboros_loop_source *vcs_timer;
+	struct timespec vcs_held;
+	int vcs_holding;
+	int vcs_stale;
+
+#if ENABLE_SERVER
+	/* changes injected by the remote agent */
+	char **injected;
+	/* request is an event published by the fleet peer */
+	int relayed;
+	/* the last time when dropped events have been reported */
+	time_t dropped_warning;
+	/* events are forwarded to remote servers */
+	struct ouroboros_agent *agent;
+	struct ouroboros_loop_source *agent_timer;
+#endif
+
+	/* statistics */
+	unsigned int starts;
+	unsigned int changes;
+
+	/* restart latency metrics - timestamps of pending measurements */
+	enum cause cause;
+	unsigned int causes[CAUSE_COUNT];
+	struct timespec detected;
+	int detecting;
+	struct timespec spawned;
+	int spawning;
+	struct ouroboros_metrics_histogram detect_kill;
+	struct ouroboros_metrics_histogram kill_exit;
+	struct ouroboros_metrics_histogram spawn_ready;
+
+};
+
+/* Dump recent output of the process into the given file. If the file name
+ * is not given, the output is dumped to the standard error. */
+static void dump_output(struct ouroboros_output *output, const char *path) {
+
+	int fd = fileno(stderr);
+
+	if (path != NULL &&
+			(fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644)) == -1) {
+		perror("warning: unable to open output dump file");
+		return;
+	}
+
+	ouroboros_output_dump(output, fd);
+
+	if (path != NULL)
+		close(fd);
+}
+
+/* Schedule given action after the delay (in seconds). Pending action is
+ * replaced, so consecutive calls postpone the action. */
+static void schedule_action(struct supervisor *sv, enum action action, double delay) {
+	sv->action = action;
+	sv->start_pending = 0;
+	ouroboros_loop_timer_set(sv->action_timer, delay, 0);
+}
+
+static void process_callback(struct ouroboros_loop_source *source,
+		uint32_t events, void *userdata);
+
+/* Update process termination source, which has to be done upon every start
+ * of the process - every instance has its own pidfd. */
+static void watch_process(struct supervisor *sv) {
+	ouroboros_loop_remove(sv->process_source);
+	sv->process_source = NULL;
+	if (sv->process.pid && sv->process.pidfd != -1)
+		sv->process_source = ouroboros_loop_add(sv->loop, sv->process.pidfd,
+				EPOLLIN, process_callback, sv);
+}
+
+static void zygote_callback(struct ouroboros_loop_source *source,
+		uint32_t events, void *userdata);
+
+/* Update zygote control socket source, which has to be done upon every fork
+ * request - the zygote might have been restarted in the meantime. */
+static void watch_zygote(struct supervisor *sv) {
+	ouroboros_loop_remove(sv->zygote_source);
+	sv->zygote_source = NULL;
+	if (sv->zygote->fd != -1)
+		sv->zygote_source = ouroboros_loop_add(sv->loop, sv->zygote->fd,
+				EPOLLIN, zygote_callback, sv);
+	ouroboros_loop_timer_set(sv->zygote_timer,
+			sv->zygote->worker != NULL ? OUROBOROS_ZYGOTE_TIMEOUT : -1, 0);
+}
+
+/* Dump recent output of the process right away. */
+static void flush_dump(struct supervisor *sv) {
+	ouroboros_loop_timer_set(sv->dump_timer, -1, 0);
+	sv->dump_pending = 0;
+	dump_output(sv->output, sv->config->output_dump);
+}
+
+/* Dump recent output once the data which is still waiting in the capture
+ * pipe reaches the buffer, so the last words of the crashed process will
+ * not be lost. The data is awaited by the loop for at most a moment. */
+static void dump_callback(struct ouroboros_loop_source *source,
+		uint32_t events, void *userdata) {
+	struct supervisor *sv = userdata;
+	if (ouroboros_output_pending(sv->output) > 0 &&
+			ouroboros_metrics_since(&sv->dump_requested) < OUROBOROS_OUTPUT_DUMP_TIMEOUT) {
+		ouroboros_loop_timer_set(sv->dump_timer, OUROBOROS_OUTPUT_DUMP_INTERVAL, 0);
+		return;
+	}
+	flush_dump(sv);
+}
+
+/* Request the dump of the recent output. */
+static void request_dump(struct supervisor *sv) {
+	if (!sv->dump_pending) {
+		clock_gettime(CLOCK_MONOTONIC, &sv->dump_requested);
+		sv->dump_pending = 1;
+	}
+	dump_callback(sv->dump_timer, 0, sv);
+}
+
+/* Drop the port probe connection which is in progress. */
+static void cancel_probe(struct supervisor *sv) {
+	if (sv->probe_source == NULL)
+		return;
+	ouroboros_loop_remove(sv->probe_source);
+	close(sv->probe_source->fd);
+	sv->probe_source = NULL;
+}
+
+/* Start or stop waiting for the readiness of the started process. */
+static void wait_ready(struct supervisor *sv, int value) {
+	if (!sv->readiness)
+		return;
+	cancel_probe(sv);
+	if (sv->output != NULL && sv->config->ready_pattern != NULL)
+		ouroboros_output_arm(sv->output, value);
+	if (sv->probe_timer != NULL)
+		ouroboros_loop_timer_set(sv->probe_timer, value ? OUROBOROS_READY_PROBE_INTERVAL : -1,
+				OUROBOROS_READY_PROBE_INTERVAL);
+	if (sv->config->ready_timeout > 0)
+		ouroboros_loop_timer_set(sv->ready_timer, value ? sv->config->ready_timeout : -1, 0);
+}
+
+/* Start or stop liveness checks and recycling of the supervised process. */
+static void watch_health(struct supervisor *sv, int value) {
+	double interval = sv->config->liveness_interval;
+	if (sv->liveness != NULL) {
+		if (value)
+			ouroboros_liveness_reset(sv->liveness, sv->process.pid);
+		ouroboros_loop_timer_set(sv->liveness_timer, value ? interval : -1, interval);
+	}
+	if (sv->recycle != NULL) {
+		if (value)
+			ouroboros_recycle_reset(sv->recycle, sv->process.pid);
+		ouroboros_loop_timer_set(sv->recycle_timer, value ? OUROBOROS_RECYCLE_INTERVAL : -1,
+				OUROBOROS_RECYCLE_INTERVAL);
+	}
+}
+
+/* Kill the supervised process. New connections will wait for the process
+ * to be started again. The process is reaped by the process_callback() once
+ * it terminates - or killed with SIGKILL if it ignores the kill signal. */
+static void kill_process(struct supervisor *sv) {
+
+	watch_health(sv, 0);
+
+	/* worker which has not been forked yet is not needed anymore */
+	if (sv->zygote != NULL && sv->zygote->worker != NULL) {
+		ouroboros_zygote_cancel(sv->zygote);
+		watch_zygote(sv);
+	}
+
+	/* process will not become ready anymore */
+	if (sv->spawning) {
+		wait_ready(sv, 0);
+		sv->spawning = 0;
+	}
+	sv->restart_deferred = 0;
+
+	ouroboros_proxy_hold(sv->proxy, 1);
+
+	if (sv->process.pid == 0) {
+		/* the process has terminated, but its process group might not */
+		kill_ouroboros_process(&sv->process);
+		return;
+	}
+	if (sv->process.killing)
+		return;
+
+	kill_ouroboros_process(&sv->process);
+	ouroboros_loop_timer_set(sv->kill_timer, OUROBOROS_PROCESS_KILL_TIMEOUT, 0);
+
+}
+
+/* Record the readiness of the started process. */
+static void mark_ready(struct supervisor *sv) {
+	if (!sv->spawning)
+		return;
+	ouroboros_metrics_observe(&sv->spawn_ready, ouroboros_metrics_since(&sv->spawned));
+	sv->spawning = 0;
+	/* the restart is complete, so this is a good moment for the flush */
+	trace_span("ready", &sv->spawned, NULL);
+	if (ouroboros_trace != NULL)
+		ouroboros_trace_flush(ouroboros_trace);
+
+	wait_ready(sv, 0);
+	if (sv->verbose && sv->readiness)
+		fprintf(stderr, "Process is ready\n");
+
+	watch_health(sv, 1);
+
+	/* all restarts triggered during the startup are coalesced into one */
+	if (sv->restart_deferred) {
+		sv->restart_deferred = 0;
+		schedule_action(sv, ACTION_KILL, 0);
+	}
+
+}
+
+/* Restart the supervised process. If the process is still starting up, the
+ * restart is deferred until it becomes ready, so the process will not be
+ * killed over and over again before it has a chance to start. */
+static void trigger_restart(struct supervisor *sv, enum cause cause, double delay) {
+
+	sv->cause = cause;
+
+	if (sv->spawning && sv->readiness) {
+		if (sv->verbose && !sv->restart_deferred)
+			fprintf(stderr, "Process is starting, deferring restart\n");
+		sv->restart_deferred = 1;
+		return;
+	}
+
+	schedule_action(sv, ACTION_KILL, delay);
+}
+
+static void input_callback(struct ouroboros_loop_source *source,
+		uint32_t events, void *userdata);
+
+/* Update input forwarding source according to the forwarding state. */
+static void watch_input(struct supervisor *sv) {
+
+	struct pollfd pfd;
+
+	ouroboros_input_poll(sv->input, &pfd);
+	if (sv->input_source != NULL &&
+			pfd.fd == sv->input_pfd.fd && pfd.events == sv->input_pfd.events)
+		return;
+
+	ouroboros_loop_remove(sv->input_source);
+	sv->input_source = NULL;
+	sv->input_pfd = pfd;
+
+	if (pfd.fd != -1)
+		sv->input_source = ouroboros_loop_add(sv->loop, pfd.fd,
+				pfd.events == POLLOUT ? EPOLLOUT : EPOLLIN, input_callback, sv);
+}
+
+/* Finish the process start - it has been spawned (or forked by the zygote)
+ * or its start has failed. */
+static void spawned_process(struct supervisor *sv) {
+
+	watch_process(sv);
+	ouroboros_proxy_hold(sv->proxy, 0);
+
+	/* Unless the readiness is detected, the process is assumed to be
+	 * ready once spawned - or when connections held by the proxy get
+	 * connected to it. */
+	clock_gettime(CLOCK_MONOTONIC, &sv->spawned);
+	sv->spawning = sv->process.pid != 0;
+	if (sv->readiness)
+		wait_ready(sv, sv->spawning);
+	else if (sv->proxy->size == 0)
+		mark_ready(sv);
+
+	if (sv->verbose && sv->process.pid)
+		fprintf(stderr, "Process ID: %d\n", sv->process.pid);
+
+}
+
+/* Perform pending action of the supervised process. */
+static void action_callback(struct ouroboros_loop_source *source,
+		uint32_t events, void *userdata) {
+
+	struct supervisor *sv = userdata;
+
+	switch (sv->action) {
+	case ACTION_NONE:
+		break;
+
+	case ACTION_KILL:
+		schedule_action(sv, ACTION_START, sv->config->start_latency);
+
+		/* restart on purpose - forget about previous crashes */
+		ouroboros_crash_reset(&sv->crash);
+
+		if (sv->detecting) {
+			ouroboros_metrics_observe(&sv->detect_kill, ouroboros_metrics_since(&sv->detected));
+			trace_span("debounce", &sv->detected, NULL);
+			sv->detecting = 0;
+		}
+
+		kill_process(sv);
+		break;
+
+	case ACTION_STOP:
+		sv->action = ACTION_NONE;
+
+		kill_process(sv);
+		sv->stopped = 1;
+
+		if (sv->verbose)
+			fprintf(stderr, "Process stopped due to inactivity\n");
+
+		break;
+
+	case ACTION_START:
+
+		/* previous instance has to terminate first */
+		if (sv->process.pid != 0) {
+			kill_process(sv);
+			sv->start_pending = 1;
+			return;
+		}
+
+		sv->action = ACTION_NONE;
+		sv->stopped = 0;
+		sv->stale = 0;
+		sv->starts++;
+		sv->causes[sv->cause]++;
+
+		/* show what we are going to start */
+		if (sv->verbose) {
+			char **tmp = sv->argv;
+			fprintf(stderr, "Running command:");
+			for (; *tmp != NULL; tmp++)
+				fprintf(stderr, " %s", *tmp);
+			fprintf(stderr, "\n");
+		}
+
+		/* output of the previous instance is dumped before the new one */
+		if (sv->dump_pending)
+			flush_dump(sv);
+		if (sv->output != NULL)
+			ouroboros_output_mark(sv->output);
+
+		/* leftovers of the crashed process might hold resources (e.g. the
+		 * listening port) needed by the new instance */
+		kill_ouroboros_process(&sv->process);
+
+		if (sv->zygote != NULL) {
+			/* Zygote failure is not fatal - it will be restarted. The worker
+			 * is attached once the zygote replies to the fork request. */
+			int rv = ouroboros_zygote_fork(sv->zygote, &sv->process);
+			watch_zygote(sv);
+			if (rv == 0)
+				return;
+		}
+		else if (start_ouroboros_process(&sv->process)) {
+			fprintf(stderr, "error: process starting failed\n");
+			sv->failed = 1;
+			ouroboros_loop_stop(sv->loop);
+			return;
+		}
+
+		spawned_process(sv);
+
+	}
+
+}
+
+/* Check whether the git operation (e.g. checkout or rebase) is in progress.
+ * If so, the end of the operation is awaited with intervals - but changes
+ * are held for at most OUROBOROS_VCS_MAX_HOLD seconds. */
+static int vcs_busy(struct supervisor *sv) {
+
+	const char *marker;
+
+	if (sv->vcs == NULL || (marker = ouroboros_vcs_busy(sv->vcs)) == NULL)
+		return 0;
+
+	if (!sv->vcs_holding) {
+		if (sv->verbose)
+			fprintf(stderr, "Git operation in progress (%s), holding changes\n", marker);
+		ouroboros_loop_timer_set(sv->vcs_timer, OUROBOROS_VCS_INTERVAL, OUROBOROS_VCS_INTERVAL);
+		clock_gettime(CLOCK_MONOTONIC, &sv->vcs_held);
+		sv->vcs_holding = 1;
+	}
+
+	if (ouroboros_metrics_since(&sv->vcs_held) < OUROBOROS_VCS_MAX_HOLD)
+		return 1;
+
+	if (!sv->vcs_stale) {
+		fprintf(stderr, "warning: git operation in progress for more than %d s (%s), "
+				"not holding changes anymore\n", OUROBOROS_VCS_MAX_HOLD, marker);
+		sv->vcs_stale = 1;
+	}
+
+	return 0;
+}
+
+/* Route detected changes to services which are affected by them. */
+static void route_changes(struct supervisor *sv, char **changes) {
+
+	int i;
+
+	if (sv->paused || vcs_busy(sv)) {
+		for (; *changes != NULL; changes++)
+			ouroboros_config_add_string(&sv->deferred, *changes);
+		return;
+	}
+
+	sv->changes++;
+	trace_instant("changes", *changes);
+
+	for (i = 0; i < sv->config->services_size; i++)
+		if (ouroboros_service_scope_match(&sv->services[i].scope, changes))
+			ouroboros_service_trigger(&sv->services[i]);
+
+	if (!sv->command || !ouroboros_service_scope_match(&sv->scope, changes))
+		return;
+
+	if (sv->zygote != NULL)
+		ouroboros_zygote_check(sv->zygote, changes);
+
+	if (sv->stopped) {
+		/* Stopped process will be started from scratch with the next incoming
+		 * connection, so there is no need to restart it right now. */
+		if (sv->verbose && !sv->stale)
+			fprintf(stderr, "Process is stopped, marking it as stale\n");
+		sv->stale = 1;
+		sv->cause = CAUSE_DEMAND;
+		return;
+	}
+
+	/* measure from the first change which has not been handled yet */
+	if (!sv->detecting) {
+		clock_gettime(CLOCK_MONOTONIC, &sv->detected);
+		sv->detecting = 1;
+	}
+
+	trigger_restart(sv, CAUSE_CHANGE, sv->config->kill_latency);
+}
+
+#if ENABLE_SERVER
+/* Forward changes detected by this instance to remote servers. Changes are
+ * sent in batches, so bursts will not flood the network. Note, that changes
+ * injected by remote instances are not forwarded, so peers which publish to
+ * each other will not bounce events back and forth. */
+static void publish_changes(struct supervisor *sv, char **changes) {
+	if (sv->agent == NULL)
+		return;
+	for (; *changes != NULL; changes++)
+		ouroboros_agent_add(sv->agent, sv->notify->paths, *changes);
+	ouroboros_loop_timer_set(sv->agent_timer, OUROBOROS_AGENT_FLUSH_DELAY, 0);
+}
+#endif /* ENABLE_SERVER */
+
+/* Check files which are being written as long as there are any. The timer
+ * is not re-armed by consecutive events, so it will fire even when the tree
+ * is changed continuously. */
+static void watch_settle(struct supervisor *sv) {
+	int value = sv->notify->pending_size > 0;
+	if (sv->settle_timer == NULL || sv->settling == value)
+		return;
+	ouroboros_loop_timer_set(sv->settle_timer, value ? OUROBOROS_NOTIFY_SETTLE_INTERVAL : -1,
+			OUROBOROS_NOTIFY_SETTLE_INTERVAL);
+	sv->settling = value;
+}
+
+/* Handle changes held during the git operation at once, so the whole
+ * operation triggers a single restart. */
+static void vcs_callback(struct ouroboros_loop_source *source,
+		uint32_t events, void *userdata) {
+
+	struct supervisor *sv = userdata;
+	char **tmp;
+
+	/* changes held for too long are released, however the marker is still
+	 * checked, so the hold is reset when the operation is finished */
+	if (ouroboros_vcs_busy(sv->vcs) != NULL) {
+		if (vcs_busy(sv))
+			return;
+	}
+	else {
+		ouroboros_loop_timer_set(sv->vcs_timer, -1, 0);
+		sv->vcs_holding = 0;
+		sv->vcs_stale = 0;
+		if (sv->verbose)
+			fprintf(stderr, "Git operation finished\n");
+	}
+
+	/* changes are still deferred if watching is paused */
+	if (!sv->paused && (tmp = sv->deferred) != NULL) {
+		sv->deferred = NULL;
+		route_changes(sv, tmp);
+		ouroboros_config_free_strings(&tmp);
+	}
+
+}
+
+/* Dispatch notification event. */
+static void notify_callback(struct ouroboros_loop_source *source,
+		uint32_t events, void *userdata) {
+	struct supervisor *sv = userdata;
+	if (ouroboros_notify_dispatch(sv->notify) == 1) {
+#if ENABLE_SERVER
+		publish_changes(sv, sv->notify->changes);
+#endif
+		route_changes(sv, sv->notify->changes);
+	}
+	watch_settle(sv);
+}
+
+/* Release changes of files which have been written completely. */
+static void settle_callback(struct ouroboros_loop_source *source,
+		uint32_t events, void *userdata) {
+	struct supervisor *sv = userdata;
+	if (ouroboros_notify_settle(sv->notify) == 1) {
+#if ENABLE_SERVER
+		publish_changes(sv, sv->notify->changes);
+#endif
+		route_changes(sv, sv->notify->changes);
+	}
+	watch_settle(sv);
+}
+
+/* Maintain intervals for poll notification type - the scan itself is done
+ * in the background and its results are dispatched by the notify_callback. */
+static void interval_callback(struct ouroboros_loop_source *source,
+		uint32_t events, void *userdata) {
+	struct supervisor *sv = userdata;
+	if (sv->action != ACTION_START)
+		ouroboros_notify_scan(sv->notify);
+}
+
+#if ENABLE_SERVER
+/* Get the service addressed by the command argument. The supervised command
+ * is addressed by its name. If the name is not given, or it is not known,
+ * NULL is returned and the primary flag tells whether the command shall be
+ * applied to the supervised command. */
+static struct ouroboros_service *get_service(struct supervisor *sv,
+		const char *name, int *primary) {
+
+	int i;
+
+	*primary = sv->command && (name == NULL || strcmp(name, sv->argv[0]) == 0);
+	for (i = 0; name != NULL && i < sv->config->services_size; i++)
+		if (strcmp(name, sv->services[i].name) == 0) {
+			*primary = 0;
+			return &sv->services[i];
+		}
+
+	return NULL;
+}
+
+/* Write the state of the given process into the stream. The state is
+ * followed by the most recent crashes - the latest one first. */
+static void print_status(FILE *f, const char *name, const struct ouroboros_process *process,
+		const char *state, unsigned int starts, const struct ouroboros_crash *crash) {
+
+	const struct ouroboros_crash_record *record;
+	char date[32];
+	unsigned int i;
+
+	fprintf(f, "ok name=%s state=%s pid=%d uptime=%.1f starts=%u crashes=%u\n",
+			name, state, process->pid,
+			process->pid ? get_ouroboros_process_uptime(process) : 0.0,
+			starts, crash->count);
+
+	for (i = 0; i < OUROBOROS_CRASH_STATUS &&
+			(record = ouroboros_crash_history(crash, i)) != NULL; i++) {
+		strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&record->time.tv_sec));
+		if (WIFSIGNALED(record->status))
+			fprintf(f, "crash time=%s uptime=%.1f signal=%d\n", date, record->uptime,
+					WTERMSIG(record->status));
+		else
+			fprintf(f, "crash time=%s uptime=%.1f exit=%d\n", date, record->uptime,
+					WEXITSTATUS(record->status));
+	}
+
+}
+
+/* Execute single command of the control protocol. Response (one line which
+ * starts with "ok" or "error") is written into the given stream. */
+static void server_command(struct supervisor *sv,
+		const struct ouroboros_server_command *command, FILE *f) {
+
+	struct ouroboros_service *service = NULL;
+	const char *name = NULL;
+	int primary = 0;
+	int sig = 0;
+	char **tmp;
+	int i;
+
+	switch (command->request) {
+	case OSR_RESTART:
+	case OSR_STOP:
+	case OSR_START:
+	case OSR_STATUS:
+		name = command->args[0];
+		break;
+	case OSR_SIGNAL:
+		if (command->args[0] == NULL ||
+				(sig = ouroboros_config_get_signal(command->args[0])) == 0) {
+			fprintf(f, "error invalid signal\n");
+			return;
+		}
+		name = command->args[1];
+		break;
+	case OSR_WATCH_ADD:
+	case OSR_WATCH_REMOVE:
+	case OSR_CHANGE:
+		if (command->args[0] == NULL) {
+			fprintf(f, "error missing path\n");
+			return;
+		}
+		break;
+	default:
+		break;
+	}
+
+	service = get_service(sv, name, &primary);
+	if (name != NULL && service == NULL && !primary) {
+		fprintf(f, "error unknown service: %s\n", name);
+		return;
+	}
+
+	switch (command->request) {
+	case OSR_NONE:
+	case OSR_UNKNOWN:
+		fprintf(f, "error unknown command: %s\n", command->name);
+		break;
+
+	case OSR_EVENT:
+		fprintf(f, "error unexpected event header\n");
+		break;
+
+	case OSR_RESTART:
+		/* requested restart is propagated to the whole fleet */
+		if (sv->agent != NULL && !sv->relayed) {
+			ouroboros_agent_restart(sv->agent, name);
+			ouroboros_loop_timer_set(sv->agent_timer, OUROBOROS_AGENT_FLUSH_DELAY, 0);
+		}
+		if (service != NULL)
+			ouroboros_service_trigger(service);
+		for (i = 0; name == NULL && i < sv->config->services_size; i++)
+			ouroboros_service_trigger(&sv->services[i]);
+		if (primary && !sv->halted)
+			trigger_restart(sv, CAUSE_REQUEST, 0);
+		fprintf(f, "ok\n");
+		break;
+
+	case OSR_SIGNAL:
+		if (service != NULL && service->process.pid)
+			kill(service->process.pid, sig);
+		else if (primary && sv->process.pid)
+			kill(sv->process.pid, sig);
+		else {
+			fprintf(f, "error not running\n");
+			break;
+		}
+		fprintf(f, "ok\n");
+		break;
+
+	case OSR_STOP:
+		if (service != NULL)
+			ouroboros_service_stop(service);
+		else if (primary) {
+			schedule_action(sv, ACTION_NONE, -1);
+			kill_process(sv);
+			sv->stopped = 1;
+			sv->halted = 1;
+		}
+		fprintf(f, "ok\n");
+		break;
+
+	case OSR_START:
+		if (service != NULL ? ouroboros_service_start(service) == -1 :
+				(!primary || sv->process.pid)) {
+			fprintf(f, "error already running\n");
+			break;
+		}
+		if (primary) {
+			sv->halted = 0;
+			sv->cause = CAUSE_REQUEST;
+			schedule_action(sv, ACTION_START, 0);
+		}
+		fprintf(f, "ok\n");
+		break;
+
+	case OSR_PAUSE:
+		sv->paused = 1;
+		fprintf(f, "ok\n");
+		break;
+
+	case OSR_RESUME:
+		sv->paused = 0;
+		/* changes made during the pause are handled at once */
+		if ((tmp = sv->deferred) != NULL) {
+			sv->deferred = NULL;
+			route_changes(sv, tmp);
+			ouroboros_config_free_strings(&tmp);
+		}
+		fprintf(f, "ok\n");
+		break;
+
+	case OSR_WATCH_ADD:
+		if (ouroboros_notify_watch_add(sv->notify, command->args[0]) == -1)
+			fprintf(f, "error %s\n", strerror(errno));
+		else
+			fprintf(f, "ok\n");
+		break;
+
+	case OSR_WATCH_REMOVE:
+		if (ouroboros_notify_watch_remove(sv->notify, command->args[0]) == -1)
+			fprintf(f, "error %s\n", strerror(errno));
+		else
+			fprintf(f, "ok\n");
+		break;
+
+	case OSR_CHANGE:
+		/* injected changes are routed once the whole request is processed */
+		ouroboros_config_add_string(&sv->injected, command->args[0]);
+		fprintf(f, "ok\n");
+		break;
+
+	case OSR_STATUS:
+		if (service != NULL)
+			print_status(f, service->name, &service->process,
+					service->halted ? "stopped" : service->process.pid ? "running" : "starting",
+					service->starts, &service->crash);
+		else if (primary)
+			print_status(f, sv->argv[0], &sv->process,
+					sv->halted ? "stopped" : sv->stopped ? "idle" :
+					sv->process.pid ? "running" : "starting",
+					sv->starts, &sv->crash);
+		else
+			fprintf(f, "error no command\n");
+		break;
+
+	case OSR_STATS:
+		for (i = 0, tmp = sv->notify->paths; tmp != NULL && *tmp != NULL; tmp++)
+			i++;
+		fprintf(f, "ok starts=%u crashes=%u changes=%u paused=%d paths=%d services=%d"
+				" input=%llu proxy=%llu\n",
+				sv->starts, sv->crash.count, sv->changes, sv->paused, i,
+				sv->config->services_size,
+				sv->input != NULL ? sv->input->bytes : 0,
+				(unsigned long long)sv->proxy->bytes);
+		for (tmp = sv->notify->paths; tmp != NULL && *tmp != NULL; tmp++)
+			fprintf(f, "watch engine=%s path=%s\n",
+					ouroboros_notify_engine(sv->notify, *tmp), *tmp);
+		break;
+
+	case OSR_DUMP: {
+		char *data = NULL;
+		ssize_t len = 0;
+		/* The output might contain secrets and the reply is much bigger than
+		 * the request, so it is not sent to the (spoofable) network peer. */
+		if (sv->server->peerfd != sv->server->ufd) {
+			fprintf(f, "error dump is available via the server socket only\n");
+			break;
+		}
+		if (sv->output != NULL && (len = ouroboros_output_snapshot(sv->output, &data)) == -1)
+			len = 0;
+		fprintf(f, "ok %zd\n", len);
+		fwrite(data, 1, len, f);
+		free(data);
+		break;
+	}
+	}
+
+}
+
+/* Dispatch server incoming data. All commands of the request are answered
+ * with a single reply - except events published by fleet peers, which are
+ * not answered at all. */
+static void server_callback(struct ouroboros_loop_source *source,
+		uint32_t events, void *userdata) {
+
+	struct supervisor *sv = userdata;
+	struct ouroboros_server_command *commands = sv->server->commands;
+	char *data = NULL;
+	size_t len = 0;
+	int relayed;
+	FILE *f;
+	int i, n;
+
+	if ((n = ouroboros_server_dispatch(sv->server, source->fd)) <= 0)
+		return;
+
+	if ((relayed = commands[0].request == OSR_EVENT)) {
+		/* our own event looped back via the multicast group */
+		if (sv->agent != NULL && commands[0].args[0] != NULL &&
+				strcmp(commands[0].args[0], sv->agent->origin) == 0)
+			return;
+		switch (ouroboros_server_event(sv->server, commands[0].args[0],
+					commands[0].args[1], commands[0].args[2])) {
+		case 0:
+			debug("dropping event: %s %s", commands[0].args[0], commands[0].args[1]);
+			return;
+		case -1:
+			/* dropped events are lost changes, so report them even when we are
+			 * not verbose - but at most once per second */
+			debug("rate limit exceeded: %s %s", commands[0].args[0], commands[0].args[1]);
+			if (sv->dropped_warning != time(NULL)) {
+				sv->dropped_warning = time(NULL);
+				fprintf(stderr, "warning: dropping events from %s - rate limit exceeded\n",
+						commands[0].args[0]);
+			}
+			return;
+		}
+	}
+
+	if ((f = open_memstream(&data, &len)) == NULL)
+		return;
+	sv->relayed = relayed;
+	for (i = relayed; i < n; i++)
+		server_command(sv, &commands[i], f);
+	sv->relayed = 0;
+	fclose(f);
+
+	if (!relayed)
+		ouroboros_server_reply(sv->server, data, len);
+	free(data);
+
+	/* changes from the remote agent are handled in the same way as local
+	 * ones, so they are filtered and debounced as well */
+	if (sv->injected != NULL) {
+		if (ouroboros_notify_inject(sv->notify, sv->injected) == 1)
+			route_changes(sv, sv->notify->changes);
+		ouroboros_config_free_strings(&sv->injected);
+	}
+
+}
+
+/* Forward changes queued for the remote server. */
+static void agent_flush_callback(struct ouroboros_loop_source *source,
+		uint32_t events, void *userdata) {
+	struct supervisor *sv = userdata;
+	ouroboros_agent_flush(sv->agent);
+}
+
+/* Read replies of the remote server. */
+static void agent_callback(struct ouroboros_loop_source *source,
+		uint32_t events, void *userdata) {
+	struct supervisor *sv = userdata;
+	ouroboros_agent_dispatch(sv->agent, source->fd);
+}
+
+/* Write metrics in the Prometheus text exposition format. */
+static void print_metrics(struct supervisor *sv, FILE *f) {
+
+	static const char *cause_names[CAUSE_COUNT] = {
+		"initial", "change", "request", "crash",
+		"demand", "liveness", "recycle",
+	};
+	struct ouroboros_notify_stats stats;
+	char name[64];
+	int i;
+
+	for (i = 0; i < CAUSE_COUNT; i++) {
+		sprintf(name, "ouroboros_process_starts_total{cause=\"%s\"}", cause_names[i]);
+		ouroboros_metrics_print_value(f, name, "counter",
+				i == 0 ? "Number of process starts by the cause." : NULL, sv->causes[i]);
+	}
+	ouroboros_metrics_print_value(f, "ouroboros_changes_total", "counter",
+			"Number of detected changes.", sv->changes);
+
+	ouroboros_metrics_print_histogram(f, "ouroboros_detect_to_kill_seconds",
+			"Time from the change detection to the kill signal.", &sv->detect_kill);
+	ouroboros_metrics_print_histogram(f, "ouroboros_kill_to_exit_seconds",
+			"Time from the kill signal to the process exit.", &sv->kill_exit);
+	ouroboros_metrics_print_histogram(f, "ouroboros_spawn_to_ready_seconds",
+			"Time from the process spawn to the readiness.", &sv->spawn_ready);
+
+	ouroboros_metrics_print_value(f, "ouroboros_proxy_relayed_bytes_total", "counter",
+			"Number of bytes relayed by the proxy.", sv->proxy->bytes);
+	ouroboros_metrics_print_histogram(f, "ouroboros_proxy_relay_seconds",
+			"Time from receiving data by the proxy to sending it out.", &sv->proxy->relay);
+
+	ouroboros_notify_stats(sv->notify, &stats);
+	ouroboros_metrics_print_value(f, "ouroboros_watched_nodes", "gauge",
+			"Number of watched file system nodes.", stats.watched);
+	ouroboros_metrics_print_histogram(f, "ouroboros_scan_seconds",
+			"Duration of the watched tree scan.", &stats.scans);
+	ouroboros_metrics_print_value(f, "ouroboros_polled_paths", "gauge",
+			"Number of subtrees polled due to the file system type.", stats.polled);
+	ouroboros_metrics_print_value(f, "ouroboros_inotify_overflows_total", "counter",
+			"Number of inotify event queue overflows.", stats.overflows);
+	ouroboros_metrics_print_value(f, "ouroboros_unchanged_total", "counter",
+			"Number of changes dropped due to the unchanged content.", stats.unchanged);
+
+	ouroboros_metrics_print_value(f, "ouroboros_rss_bytes", "gauge",
+			"Resident set size of the supervisor.", ouroboros_metrics_rss());
+
+}
+
+/* Close HTTP connection and remove its event sources. */
+static void http_client_close(struct ouroboros_http_client *client) {
+	ouroboros_loop_remove(client->source);
+	ouroboros_loop_remove(client->timer);
+	ouroboros_http_close(client);
+}
+
+/* Handle single HTTP request - there is no keep-alive, so the connection
+ * is closed right after the response. */
+static void http_client_callback(struct ouroboros_loop_source *source,
+		uint32_t events, void *userdata) {
+
+	struct ouroboros_http_client *client = userdata;
+	struct supervisor *sv = client->userdata;
+	struct ouroboros_server_command command = { OSR_RESTART, "restart", { NULL, NULL } };
+	char *data = NULL;
+	size_t len = 0;
+	char tmp[128];
+	int status;
+	FILE *f;
+	int rv;
+
+	/* socket has become writable - send the rest of the response */
+	if (client->response != NULL) {
+		if (ouroboros_http_write(client) == 0)
+			return;
+		goto final;
+	}
+
+	if ((rv = ouroboros_http_read(client)) == 0)
+		return;
+	if (rv == -1)
+		goto final;
+
+	if ((f = open_memstream(&data, &len)) == NULL)
+		goto final;
+
+	if (strcmp(client->path, "/metrics") == 0) {
+		if ((status = strcmp(client->method, "GET") == 0 ? 200 : 405) == 200)
+			print_metrics(sv, f);
+	}
+	else if (strcmp(client->path, "/restart") == 0) {
+		/* the trigger shares the logic with the control server command */
+		if ((status = strcmp(client->method, "POST") == 0 ? 200 : 405) == 200) {
+			command.args[0] = ouroboros_http_param(client, "name", tmp, sizeof(tmp));
+			server_command(sv, &command, f);
+			fflush(f);
+			if (strncmp(data, "error", 5) == 0)
+				status = 400;
+		}
+	}
+	else
+		status = 404;
+
+	fclose(f);
+	rv = ouroboros_http_respond(client, status, "text/plain; version=0.0.4", data, len);
+	free(data);
+
+	if (rv == 0 && ouroboros_loop_modify(source, EPOLLOUT) == 0)
+		return;
+
+final:
+	http_client_close(client);
+}
+
+/* Close HTTP connection which has not been served in time. */
+static void http_timeout_callback(struct ouroboros_loop_source *source,
+		uint32_t events, void *userdata) {
+	debug("HTTP connection timeout");
+	http_client_close(userdata);
+}
+
+/* Accept new HTTP connection. */
+static void http_callback(struct ouroboros_loop_source *source,
+		uint32_t events, void *userdata) {
+
+	struct supervisor *sv = userdata;
+	struct ouroboros_http_client *client;
+
+	if ((client = ouroboros_http_accept(sv->http)) == NULL)
+		return;
+
+	client->userdata = sv;
+	if ((client->source = ouroboros_loop_add(sv->loop, client->fd, EPOLLIN,
+					http_client_callback, client)) == NULL ||
+			(client->timer = ouroboros_loop_timer(sv->loop,
+					http_timeout_callback, client)) == NULL) {
+		http_client_close(client);
+		return;
+	}
+
+	ouroboros_loop_timer_set(client->timer, OUROBOROS_HTTP_TIMEOUT, 0);
+
+}
+#endif /* ENABLE_SERVER */
+
+/* Dispatch readiness notification of the started process. */
+static void ready_callback(struct ouroboros_loop_source *source,
+		uint32_t events, void *userdata) {
+	struct supervisor *sv = userdata;
+	int rv = ouroboros_ready_dispatch(sv->ready);
+	if (rv & ORM_WATCHDOG && sv->liveness != NULL)
+		ouroboros_liveness_heartbeat(sv->liveness);
+	if (rv & ORM_READY)
+		mark_ready(sv);
+}
+
+/* Get the result of the port probe connection which was in progress. */
+static void probe_result_callback(struct ouroboros_loop_source *source,
+		uint32_t events, void *userdata) {
+	struct supervisor *sv = userdata;
+	ouroboros_loop_remove(sv->probe_source);
+	sv->probe_source = NULL;
+	if (ouroboros_ready_probe_result(source->fd) == 1)
+		mark_ready(sv);
+}
+
+/* Check whether the started process accepts connections. Connection which
+ * is in progress is awaited by the loop - until the next probe. */
+static void probe_callback(struct ouroboros_loop_source *source,
+		uint32_t events, void *userdata) {
+	struct supervisor *sv = userdata;
+	int fd;
+	cancel_probe(sv);
+	switch (ouroboros_ready_probe(sv->ready->port, &fd)) {
+	case 1:
+		mark_ready(sv);
+		break;
+	case -1:
+		if ((sv->probe_source = ouroboros_loop_add(sv->loop, fd, EPOLLOUT,
+						probe_result_callback, sv)) == NULL)
+			close(fd);
+		break;
+	}
+}
+
+/* Handle the match of the readiness pattern in the process output. */
+static void pattern_callback(struct ouroboros_loop_source *source,
+		uint32_t events, void *userdata) {
+	struct supervisor *sv = userdata;
+	uint64_t value;
+	if (read(source->fd, &value, sizeof(value)) == sizeof(value))
+		mark_ready(sv);
+}
+
+/* Give up waiting for the readiness of the started process. */
+static void ready_timeout_callback(struct ouroboros_loop_source *source,
+		uint32_t events, void *userdata) {
+	struct supervisor *sv = userdata;
+	if (!sv->spawning)
+		return;
+	fprintf(stderr, "warning: process has not become ready in %.2f s\n",
+			sv->config->ready_timeout);
+	mark_ready(sv);
+}
+
+/* Check liveness of the ready process and restart it if it is hung. */
+static void liveness_callback(struct ouroboros_loop_source *source,
+		uint32_t events, void *userdata) {
+
+	struct supervisor *sv = userdata;
+	const char *reason;
+
+	if (sv->process.pid == 0 || sv->spawning || sv->action != ACTION_NONE)
+		return;
+	if ((reason = ouroboros_liveness_check(sv->liveness, sv->process.pid)) == NULL)
+		return;
+
+	fprintf(stderr, "warning: process is not alive (%s), restarting\n", reason);
+	watch_health(sv, 0);
+	sv->cause = CAUSE_LIVENESS;
+	schedule_action(sv, ACTION_KILL, 0);
+
+}
+
+/* Restart the process which has been running for too long or which uses
+ * too much memory. The restart is a regular one, so held connections will
+ * be relayed to the new instance. */
+static void recycle_callback(struct ouroboros_loop_source *source,
+		uint32_t events, void *userdata) {
+
+	struct supervisor *sv = userdata;
+	const char *reason;
+
+	if (sv->process.pid == 0 || sv->spawning || sv->action != ACTION_NONE)
+		return;
+	if ((reason = ouroboros_recycle_check(sv->recycle, &sv->process)) == NULL)
+		return;
+
+	if (sv->verbose)
+		fprintf(stderr, "Recycling process (%s)\n", reason);
+	watch_health(sv, 0);
+	sv->cause = CAUSE_RECYCLE;
+	schedule_action(sv, ACTION_KILL, 0);
+
+}
+
+/* Relay proxied connections. */
+static void proxy_callback(struct ouroboros_loop_source *source,
+		uint32_t events, void *userdata) {
+
+	struct supervisor *sv = userdata;
+	int rv;
+
+	if ((rv = ouroboros_proxy_dispatch(sv->proxy)) == -1)
+		rv = 0;
+
+	/* held connections have reached the started process */
+	if (rv & OPE_CONNECT && !sv->readiness)
+		mark_ready(sv);
+	/* start stopped process for the first incoming connection */
+	if (rv & OPE_ACCEPT && sv->stopped && !sv->halted && sv->action == ACTION_NONE) {
+		if (!sv->stale)
+			sv->cause = CAUSE_DEMAND;
+		schedule_action(sv, ACTION_START, 0);
+	}
+	/* stop running process if there was no traffic for a while - if some
+	 * other action is pending, check the inactivity once it is done */
+	if (rv & OPE_IDLE && !sv->stopped) {
+		if (sv->action == ACTION_NONE)
+			schedule_action(sv, ACTION_STOP, 0);
+		else
+			ouroboros_proxy_idle_check(sv->proxy, 1.0);
+	}
+
+}
+
+/* Attach the worker forked by the zygote. */
+static void zygote_callback(struct ouroboros_loop_source *source,
+		uint32_t events, void *userdata) {
+
+	struct supervisor *sv = userdata;
+	int rv;
+
+	rv = ouroboros_zygote_dispatch(sv->zygote);
+	watch_zygote(sv);
+
+	/* worker has been attached or the fork has failed */
+	if (rv != 0)
+		spawned_process(sv);
+
+}
+
+/* Retry the fork request which has not been answered in time. */
+static void zygote_timeout_callback(struct ouroboros_loop_source *source,
+		uint32_t events, void *userdata) {
+
+	struct supervisor *sv = userdata;
+	int rv;
+
+	if (sv->zygote->worker == NULL)
+		return;
+
+	fprintf(stderr, "warning: zygote response timeout\n");
+	rv = ouroboros_zygote_retry(sv->zygote);
+	watch_zygote(sv);
+
+	if (rv == -1)
+		spawned_process(sv);
+
+}
+
+/* Kill the process with SIGKILL if it has not terminated in time. */
+static void kill_timeout_callback(struct ouroboros_loop_source *source,
+		uint32_t events, void *userdata) {
+	struct supervisor *sv = userdata;
+	if (sv->process.pid == 0 || !sv->process.killing)
+		return;
+	fprintf(stderr, "warning: process has not terminated, sending SIGKILL\n");
+	force_kill_ouroboros_process(&sv->process);
+}
+
+/* Reap terminated process, so it will not become a zombie. */
+static void process_callback(struct ouroboros_loop_source *source,
+		uint32_t events, void *userdata) {
+
+	struct supervisor *sv = userdata;
+	struct ouroboros_process *process = &sv->process;
+	struct timespec killed = process->killed;
+	int killing = process->killing;
+
+	ouroboros_loop_remove(sv->process_source);
+	sv->process_source = NULL;
+
+	if (!reap_ouroboros_process(process))
+		return;
+
+	watch_health(sv, 0);
+
+	/* process has been killed on purpose */
+	if (killing) {
+		ouroboros_loop_timer_set(sv->kill_timer, -1, 0);
+		ouroboros_metrics_observe(&sv->kill_exit, ouroboros_metrics_since(&killed));
+		trace_span("kill", &killed, NULL);
+		if (sv->start_pending)
+			schedule_action(sv, ACTION_START, 0);
+		return;
+	}
+
+	if (sv->verbose) {
+		if (WIFSIGNALED(process->status))
+			fprintf(stderr, "Process killed by signal: %s\n", strsignal(WTERMSIG(process->status)));
+		else
+			fprintf(stderr, "Process exited with status: %d\n", WEXITSTATUS(process->status));
+	}
+
+	/* post-mortem output of the crashed process */
+	if (sv->output != NULL && sv->output->ring.size &&
+			ouroboros_crash_is_failure(process->status))
+		request_dump(sv);
+
+	/* process has terminated before becoming ready - if there were changes
+	 * in the meantime, it is started again (with the new code) right away */
+	if (sv->spawning && sv->readiness) {
+		wait_ready(sv, 0);
+		sv->spawning = 0;
+		if (sv->restart_deferred && sv->action == ACTION_NONE)
+			schedule_action(sv, ACTION_START, 0);
+		sv->restart_deferred = 0;
+	}
+
+	/* restart crashed process unless some action is already pending */
+	if (sv->config->crash_restart && sv->action == ACTION_NONE &&
+			ouroboros_crash_is_failure(process->status)) {
+		double delay = ouroboros_crash_record(&sv->crash, process->status,
+				get_ouroboros_process_uptime(process));
+		if (delay < 0)
+			fprintf(stderr, "warning: restart limit reached, waiting for modifications\n");
+		else {
+			if (sv->verbose)
+				fprintf(stderr, "Restarting crashed process in %.2f s\n", delay);
+			sv->cause = CAUSE_CRASH;
+			schedule_action(sv, ACTION_START, delay);
+		}
+	}
+
+}
+
+/* Forward received input to the process. */
+static void input_callback(struct ouroboros_loop_source *source,
+		uint32_t events, void *userdata) {
+	struct supervisor *sv = userdata;
+	if (ouroboros_input_dispatch(sv->input) == -1) {
+		ouroboros_loop_stop(sv->loop);
+		return;
+	}
+	watch_input(sv);
+}
+
+/* Redirect received signal to the supervised process. */
+static void redirect_signal_callback(int sig, void *userdata) {
+	struct supervisor *sv = userdata;
 	debug("redirecting signal: %d", sig);
-	if (sr_pid)
-		kill(sr_pid, sig);
+	if (sv->process.pid)
+		kill(sv->process.pid, sig);
+}
+
+/* Reap terminated processes which can not be watched with the pidfd (e.g.
+ * the kernel does not support it) - the SIGCHLD is the fallback. */
+static void child_signal_callback(int sig, void *userdata) {
+	struct supervisor *sv = userdata;
+	int i;
+	if (sv->process.pid && sv->process.pidfd == -1)
+		process_callback(NULL, 0, sv);
+	for (i = 0; i < sv->config->services_size; i++)
+		ouroboros_service_reap(&sv->services[i]);
+}
+
+/* Dump recent output upon request. */
+static void dump_signal_callback(int sig, void *userdata) {
+	request_dump(userdata);
 }
 
 /* Initialize signal redirections. Note, that not all signals can be
  * caught and therefore redirected. This restriction is beyond our
  * power, so we will simply show appropriate warning in such cases. */
-static void setup_signals(int *signals) {
+static void setup_signals(struct supervisor *sv, int *signals) {
 
 	if (signals == NULL)
 		return;
 
-	struct sigaction sigact = { 0 };
-	sigact.sa_handler = sr_handler;
-
 	while (*signals) {
-		if (sigaction(*signals, &sigact, NULL) == -1)
+		if (ouroboros_loop_signal(sv->loop, *signals, redirect_signal_callback, sv) == -1)
 			perror("warning: unable to install signal handler");
 		signals++;
 	}
@@ -83,6 +1447,43 @@ int main(int argc, char **argv) {
 		{ OCKD_REDIRECT_INPUT, required_argument, NULL, 't' },
 		{ OCKD_REDIRECT_OUTPUT, required_argument, NULL, 'o' },
 		{ OCKD_REDIRECT_SIGNAL, required_argument, NULL, 's' },
+		{ OCKD_PROXY_PORT, required_argument, NULL, 2 },
+		{ OCKD_PROXY_TARGET_PORT, required_argument, NULL, 3 },
+		{ OCKD_START_ON_DEMAND, required_argument, NULL, 4 },
+		{ OCKD_IDLE_TIMEOUT, required_argument, NULL, 5 },
+		{ OCKD_CRASH_RESTART, required_argument, NULL, 6 },
+		{ OCKD_CRASH_RESTART_LIMIT, required_argument, NULL, 7 },
+		{ OCKD_OUTPUT_TEE, required_argument, NULL, 8 },
+		{ OCKD_OUTPUT_TIMESTAMPS, required_argument, NULL, 9 },
+		{ OCKD_OUTPUT_MARKERS, required_argument, NULL, 10 },
+		{ OCKD_OUTPUT_BUFFER_SIZE, required_argument, NULL, 11 },
+#if ENABLE_SERVER
+		{ OCKD_SERVER_INTERFACE, required_argument, NULL, 12 },
+		{ OCKD_SERVER_PORT, required_argument, NULL, 13 },
+		{ OCKD_SERVER_SOCKET, required_argument, NULL, 14 },
+		{ OCKD_AGENT_TARGET, required_argument, NULL, 15 },
+		{ OCKD_FLEET_PEER, required_argument, NULL, 16 },
+		{ OCKD_FLEET_GROUP, required_argument, NULL, 17 },
+		{ OCKD_FLEET_RATE_LIMIT, required_argument, NULL, 18 },
+		{ OCKD_HTTP_PORT, required_argument, NULL, 19 },
+#endif /* ENABLE_SERVER */
+		{ OCKD_TRACE_FILE, required_argument, NULL, 20 },
+		{ OCKD_READY_NOTIFY, required_argument, NULL, 21 },
+		{ OCKD_READY_PORT, required_argument, NULL, 22 },
+		{ OCKD_READY_PATTERN, required_argument, NULL, 23 },
+		{ OCKD_READY_TIMEOUT, required_argument, NULL, 24 },
+		{ OCKD_WATCHDOG_TIMEOUT, required_argument, NULL, 25 },
+		{ OCKD_LIVENESS_PORT, required_argument, NULL, 26 },
+		{ OCKD_LIVENESS_IDLE, required_argument, NULL, 27 },
+		{ OCKD_LIVENESS_INTERVAL, required_argument, NULL, 28 },
+		{ OCKD_RECYCLE_MEMORY, required_argument, NULL, 29 },
+		{ OCKD_RECYCLE_LIFETIME, required_argument, NULL, 30 },
+		{ OCKD_WATCH_VERIFY_CONTENT, required_argument, NULL, 31 },
+		{ OCKD_WATCH_IGNORE_TEMP, required_argument, NULL, 32 },
+		{ OCKD_WATCH_WRITE_TIMEOUT, required_argument, NULL, 33 },
+		{ OCKD_WATCH_VCS_GATE, required_argument, NULL, 34 },
+		{ OCKD_WATCH_REMOTE_POLL, required_argument, NULL, 35 },
+		{ OCKD_WATCH_FOLLOW_SYMLINKS, required_argument, NULL, 36 },
 		{ 0, 0, 0, 0 },
 	};
 
@@ -92,6 +1493,8 @@ int main(int argc, char **argv) {
 	char *config_file = NULL;
 	int config_ini = 0;
 #endif
+	int command;
+	int forward = 0;
 	int verbose = 0;
 	int rv;
 
@@ -115,12 +1518,50 @@ return_usage:
 					"  -u, --watch-update-nodes=BOOL\n"
 					"  -i, --watch-include=REGEXP\n"
 					"  -e, --watch-exclude=REGEXP\n"
+					"  --watch-verify-content=BOOL\n"
+					"  --watch-ignore-temp=BOOL\n"
+					"  --watch-write-timeout=VALUE\n"
+					"  --watch-vcs-gate=BOOL\n"
+					"  --watch-remote-poll=BOOL\n"
+					"  --watch-follow-symlinks=BOOL\n"
 					"  -k, --kill-signal=SIG\n"
 					"  -l, --kill-latency=VALUE\n"
 					"  -a, --start-latency=VALUE\n"
 					"  -t, --redirect-input=BOOL\n"
 					"  -o, --redirect-output=FILE\n"
-					"  -s, --redirect-signal=SIG\n",
+					"  -s, --redirect-signal=SIG\n"
+					"  --proxy-port=PORT\n"
+					"  --proxy-target-port=PORT\n"
+					"  --start-on-demand=BOOL\n"
+					"  --idle-timeout=VALUE\n"
+					"  --crash-restart=BOOL\n"
+					"  --crash-restart-limit=VALUE\n"
+					"  --output-tee=BOOL\n"
+					"  --output-timestamps=BOOL\n"
+					"  --output-markers=BOOL\n"
+					"  --output-buffer-size=KIB\n"
+#if ENABLE_SERVER
+					"  --server-interface=IFACE\n"
+					"  --server-port=PORT\n"
+					"  --server-socket=FILE\n"
+					"  --agent-target=ADDR\n"
+					"  --fleet-peer=ADDR\n"
+					"  --fleet-group=ADDR\n"
+					"  --fleet-rate-limit=VALUE\n"
+					"  --http-port=PORT\n"
+#endif /* ENABLE_SERVER */
+					"  --trace-file=FILE\n"
+					"  --ready-notify=BOOL\n"
+					"  --ready-port=PORT\n"
+					"  --ready-pattern=REGEXP\n"
+					"  --ready-timeout=VALUE\n"
+					"  --watchdog-timeout=VALUE\n"
+					"  --liveness-port=PORT\n"
+					"  --liveness-idle=VALUE\n"
+					"  --liveness-interval=VALUE\n"
+					"  --recycle-memory=KIB\n"
+					"  --recycle-lifetime=VALUE\n"
+					,
 					argv[0]);
 			return EXIT_SUCCESS;
 
@@ -145,10 +1586,6 @@ return_usage:
 			return EXIT_FAILURE;
 		}
 
-	if (optind == argc)
-		/* we want to run some command, don't we? */
-		goto return_usage;
-
 	/* initialize default configuration */
 	ouroboros_config_init(&config);
 
@@ -156,7 +1593,7 @@ return_usage:
 	/* load configuration from the given file or default one */
 	if (config_file == NULL)
 		config_file = get_ouroboros_config_file();
-	config_appname = strdup(argv[optind]);
+	config_appname = strdup(optind < argc ? argv[optind] : "");
 	if (verbose)
 		fprintf(stderr, "Loading configuration: %s\n", config_file);
 #if ENABLE_INIPARSER
@@ -164,7 +1601,7 @@ return_usage:
 		rv = load_ouroboros_ini_config(config_file, &config);
 	else
 #endif /* ENABLE_INIPARSER */
-		rv = load_ouroboros_config(config_file, basename(argv[optind]), &config);
+		rv = load_ouroboros_config(config_file, basename(config_appname), &config);
 	if (rv)
 		fprintf(stderr, "warning: unable to load configuration file\n");
 	free(config_appname);
@@ -221,32 +1658,169 @@ return_usage:
 			else
 				ouroboros_config_add_int(&config.redirect_signals, opt);
 			break;
+		case 2:
+			config.proxy_port = atoi(optarg);
+			break;
+		case 3:
+			config.proxy_target_port = atoi(optarg);
+			break;
+		case 4:
+			config.start_on_demand = ouroboros_config_get_bool(optarg);
+			break;
+		case 5:
+			config.idle_timeout = strtod(optarg, NULL);
+			break;
+		case 6:
+			config.crash_restart = ouroboros_config_get_bool(optarg);
+			break;
+		case 7:
+			config.crash_restart_limit = atoi(optarg);
+			break;
+		case 8:
+			config.output_tee = ouroboros_config_get_bool(optarg);
+			break;
+		case 9:
+			config.output_timestamps = ouroboros_config_get_bool(optarg);
+			break;
+		case 10:
+			config.output_markers = ouroboros_config_get_bool(optarg);
+			break;
+		case 11:
+			config.output_buffer_size = atoi(optarg);
+			break;
+#if ENABLE_SERVER
+		case 12:
+			free(config.server_iface);
+			config.server_iface = strcmp(optarg, "none") != 0 ? strdup(optarg) : NULL;
+			break;
+		case 13:
+			config.server_port = atoi(optarg);
+			break;
+		case 14:
+			free(config.server_socket);
+			config.server_socket = strdup(optarg);
+			break;
+		case 15:
+			free(config.agent_target);
+			config.agent_target = strdup(optarg);
+			break;
+		case 16:
+			ouroboros_config_add_string(&config.fleet_peers, optarg);
+			break;
+		case 17:
+			free(config.fleet_group);
+			config.fleet_group = strdup(optarg);
+			break;
+		case 18:
+			config.fleet_rate_limit = atoi(optarg);
+			break;
+		case 19:
+			config.http_port = atoi(optarg);
+			break;
+#endif /* ENABLE_SERVER */
+		case 20:
+			free(config.trace_file);
+			config.trace_file = strdup(optarg);
+			break;
+		case 21:
+			config.ready_notify = ouroboros_config_get_bool(optarg);
+			break;
+		case 22:
+			config.ready_port = atoi(optarg);
+			break;
+		case 23:
+			free(config.ready_pattern);
+			config.ready_pattern = strdup(optarg);
+			break;
+		case 24:
+			config.ready_timeout = atof(optarg);
+			break;
+		case 25:
+			config.watchdog_timeout = atof(optarg);
+			break;
+		case 26:
+			config.liveness_port = atoi(optarg);
+			break;
+		case 27:
+			config.liveness_idle = atof(optarg);
+			break;
+		case 28:
+			config.liveness_interval = atof(optarg);
+			break;
+		case 29:
+			config.recycle_memory = atoi(optarg);
+			break;
+		case 30:
+			config.recycle_lifetime = atof(optarg);
+			break;
+		case 31:
+			config.watch_verify_content = ouroboros_config_get_bool(optarg);
+			break;
+		case 32:
+			config.watch_ignore_temp = ouroboros_config_get_bool(optarg);
+			break;
+		case 33:
+			config.watch_write_timeout = atof(optarg);
+			break;
+		case 34:
+			config.watch_vcs_gate = ouroboros_config_get_bool(optarg);
+			break;
+		case 35:
+			config.watch_remote_poll = ouroboros_config_get_bool(optarg);
+			break;
+		case 36:
+			config.watch_follow_symlinks = ouroboros_config_get_bool(optarg);
+			break;
 		}
 
+	/* command line options shall affect services as well */
+	ouroboros_config_inherit(&config);
+
+#if ENABLE_SERVER
+	forward = config.agent_target != NULL;
+#endif
+
+	/* we want to run some command, don't we? - either the one given in the
+	 * command line or services defined in the configuration file, unless
+	 * we are supposed to forward changes to the remote server only */
+	command = optind < argc;
+	if (!command && config.services_size == 0 && !forward) {
+		ouroboros_config_free(&config);
+		goto return_usage;
+	}
+
 	if (verbose >= 2)
 		dump_ouroboros_config(&config);
 
-	enum action {
-		ACTION_NONE = 0,
-		ACTION_KILL,
-		ACTION_START,
-	};
+	struct supervisor sv = { 0 };
+	char *defaults[] = { ".", NULL };
+	char **paths;
+	int i;
 
-	struct ouroboros_process process;
-	struct ouroboros_notify *notify;
-	struct ouroboros_server *server;
-	struct pollfd pfds[3];
-	char buffer[1024];
-	enum action action;
-	int timeout;
+	sv.config = &config;
+	sv.argv = &argv[optind];
+	sv.command = command;
+	sv.verbose = verbose;
 
 	/* try to place ourself in a new (our own) process group ID, so we will
 	 * have a better control over supervised processes */
 	if (setpgid(0, 0) == -1)
 		perror("warning: setting process group failed");
 
+	if ((sv.loop = ouroboros_loop_init()) == NULL)
+		return EXIT_FAILURE;
+
+	/* tracer has to be ready before any background thread is started */
+	if (config.trace_file != NULL)
+		if ((ouroboros_trace = ouroboros_trace_init(config.trace_file)) == NULL)
+			return EXIT_FAILURE;
+	if ((sv.action_timer = ouroboros_loop_timer(sv.loop, action_callback, &sv)) == NULL)
+		return EXIT_FAILURE;
+	if ((sv.kill_timer = ouroboros_loop_timer(sv.loop, kill_timeout_callback, &sv)) == NULL)
+		return EXIT_FAILURE;
+
 	/* it is our crucial subsystem - running without it is pointless */
-	if ((notify = ouroboros_notify_init(config.engine)) == NULL)
+	if ((sv.notify = ouroboros_notify_init(config.engine)) == NULL)
 		return EXIT_FAILURE;
 
 	/* non-recursive mode implicitly excludes updates */
@@ -257,160 +1831,284 @@ return_usage:
 	 * a nice addition to disable the buffering on the standard output */
 	setvbuf(stdout, NULL, _IONBF, 0);
 
-	ouroboros_notify_recursive(notify, config.watch_recursive);
-	ouroboros_notify_update_nodes(notify, config.watch_update_nodes);
-	ouroboros_notify_dirs_only(notify, config.watch_dirs_only);
-	ouroboros_notify_files_only(notify, config.watch_files_only);
-	ouroboros_notify_include_patterns(notify, config.watch_includes);
-	ouroboros_notify_exclude_patterns(notify, config.watch_excludes);
-	ouroboros_notify_watch(notify, config.watch_paths);
+	ouroboros_notify_recursive(sv.notify, config.watch_recursive);
+	ouroboros_notify_update_nodes(sv.notify, config.watch_update_nodes);
+	ouroboros_notify_dirs_only(sv.notify, config.watch_dirs_only);
+	ouroboros_notify_files_only(sv.notify, config.watch_files_only);
+	ouroboros_notify_verify_content(sv.notify, config.watch_verify_content);
+	ouroboros_notify_ignore_temp(sv.notify, config.watch_ignore_temp);
+	ouroboros_notify_write_timeout(sv.notify, config.watch_write_timeout);
+	ouroboros_notify_remote_poll(sv.notify, config.watch_remote_poll);
+	ouroboros_notify_follow_symlinks(sv.notify, config.watch_follow_symlinks);
+	ouroboros_notify_verbose(sv.notify, verbose);
+	ouroboros_notify_include_patterns(sv.notify, config.watch_includes);
+	ouroboros_notify_exclude_patterns(sv.notify, config.watch_excludes);
+
+	if (config.services_size == 0) {
+		ouroboros_notify_watch(sv.notify, config.watch_paths);
+		/* single process is restarted upon every change */
+		ouroboros_service_scope_init(&sv.scope, NULL, NULL, NULL);
+	}
+	else {
+		/* All services share one notification subsystem, so we have to watch
+		 * the union of their scopes. Changes are routed to services later. */
+		paths = ouroboros_service_watch_paths(&config, command);
+		ouroboros_notify_watch(sv.notify, paths);
+		ouroboros_service_watch_paths_free(paths);
+		ouroboros_service_scope_init(&sv.scope,
+				config.watch_paths != NULL ? config.watch_paths : defaults, NULL, NULL);
+	}
 
 #if ENABLE_SERVER
-	server = ouroboros_server_init(config.server_iface, config.server_port);
-	if (server == NULL)
+	sv.server = ouroboros_server_init(config.server_iface, config.server_port,
+			config.server_socket, config.fleet_group);
+	if (sv.server == NULL)
 		return EXIT_FAILURE;
+	sv.server->rate_limit = config.fleet_rate_limit;
+	/* metrics are exposed on the server interface (loopback by default) */
+	if (config.http_port > 0) {
+		sv.http = ouroboros_http_init(sv.server->fd != -1 ? &sv.server->ifaddr : NULL,
+				config.http_port);
+		if (sv.http == NULL)
+			return EXIT_FAILURE;
+	}
+	if (forward || config.fleet_peers != NULL) {
+		/* changes are forwarded to the agent target and fleet peers alike */
+		paths = NULL;
+		if (config.agent_target != NULL)
+			ouroboros_config_add_string(&paths, config.agent_target);
+		for (i = 0; config.fleet_peers != NULL && config.fleet_peers[i] != NULL; i++)
+			ouroboros_config_add_string(&paths, config.fleet_peers[i]);
+		sv.agent = ouroboros_agent_init(paths);
+		ouroboros_config_free_strings(&paths);
+		if (sv.agent == NULL)
+			return EXIT_FAILURE;
+		if ((sv.agent_timer = ouroboros_loop_timer(sv.loop, agent_flush_callback, &sv)) == NULL)
+			return EXIT_FAILURE;
+	}
 #endif /* ENABLE_SERVER */
 
-	ouroboros_process_init(&process, argv[optind], &argv[optind]);
-	process.output = config.redirect_output;
-	process.signal = config.kill_signal;
-
-	/* set up signal redirections */
-	setup_signals(config.redirect_signals);
-
-	/* poll standard input - IO redirection */
-	pfds[0].events = POLLIN;
-	pfds[0].fd = config.redirect_input ? fileno(stdin) : -1;
+	if ((sv.proxy = ouroboros_proxy_init(config.proxy_port, config.proxy_target_port)) == NULL)
+		return EXIT_FAILURE;
+	ouroboros_proxy_hold_timeout(sv.proxy, config.proxy_hold_timeout);
 
-	/* setup inotify subsystem */
-	pfds[1].events = POLLIN;
-	pfds[1].fd = -1;
-#if HAVE_SYS_INOTIFY_H
-	if (config.engine == ONT_INOTIFY)
-		pfds[1].fd = notify->s.inotify.fd;
-#endif /* HAVE_SYS_INOTIFY_H */
+	/* on-demand mode requires someone to hold the listening socket */
+	if (!command)
+		config.start_on_demand = 0;
+	if (config.start_on_demand && sv.proxy->fd == -1) {
+		fprintf(stderr, "warning: on-demand start requires proxy to be enabled\n");
+		config.start_on_demand = 0;
+	}
+	if (config.start_on_demand)
+		ouroboros_proxy_idle_timeout(sv.proxy, config.idle_timeout);
 
-	/* setup server subsystem */
-	pfds[2].events = POLLIN;
-	pfds[2].fd = -1;
-#if ENABLE_SERVER
-	pfds[2].fd = server->fd;
-#endif
+	ouroboros_process_init(&sv.process, argv[optind], &argv[optind]);
+	if ((sv.services = calloc(config.services_size, sizeof(*sv.services))) == NULL)
+		return EXIT_FAILURE;
+	for (i = 0; i < config.services_size; i++) {
+		if (ouroboros_service_init(&sv.services[i], &config.services[i], &config, sv.loop) == -1)
+			return EXIT_FAILURE;
+		sv.services[i].verbose = verbose;
+	}
 
-	/* run main maintenance loop */
-	action = ACTION_START;
-	timeout = -1;
-	for (;;) {
+	sv.process.signal = config.kill_signal;
 
-		if (timeout == -1)
-			switch (action) {
+	/* capture process output, so it can be decorated - otherwise the log file
+	 * is written by the process directly */
+	if (config.output_timestamps || config.output_markers || config.output_tee ||
+			config.output_rotate_size > 0 || config.output_buffer_size > 0 ||
+			config.ready_pattern != NULL) {
+		if ((sv.output = ouroboros_output_init(config.redirect_output, config.output_tee)) == NULL)
+			return EXIT_FAILURE;
+		ouroboros_output_timestamps(sv.output, config.output_timestamps);
+		ouroboros_output_markers(sv.output, config.output_markers);
+		ouroboros_output_rotate(sv.output, (off_t)config.output_rotate_size * 1024,
+				config.output_rotate_count);
+		if (ouroboros_output_buffer(sv.output, (size_t)config.output_buffer_size * 1024) == -1)
+			return EXIT_FAILURE;
+		if (config.ready_pattern != NULL) {
+			if (ouroboros_output_pattern(sv.output, config.ready_pattern) == -1)
+				return EXIT_FAILURE;
+			ouroboros_loop_add(sv.loop, sv.output->efd, EPOLLIN, pattern_callback, &sv);
+		}
+		if (ouroboros_output_start(sv.output) == -1)
+			return EXIT_FAILURE;
+		sv.process.outfd = sv.output->pipe[1];
+	}
+	else if (config.redirect_output != NULL)
+		if ((sv.process.outfd = ouroboros_output_open(config.redirect_output)) == -1)
+			return EXIT_FAILURE;
 
-			case ACTION_KILL:
-				action = ACTION_START;
-				timeout = config.start_latency * 1000;
+	/* readiness detection - the notify socket has to be exported before
+	 * the zygote is started, so forked processes will inherit it */
+	sv.readiness = config.ready_notify || config.ready_port > 0 || config.ready_pattern != NULL;
+	if (config.ready_notify || config.ready_port > 0 || config.watchdog_timeout > 0) {
+		/* watchdog heartbeats are received via the notify socket as well */
+		sv.ready = ouroboros_ready_init(config.ready_notify || config.watchdog_timeout > 0,
+				config.ready_port);
+		if (sv.ready == NULL)
+			return EXIT_FAILURE;
+		if (sv.ready->fd != -1)
+			ouroboros_loop_add(sv.loop, sv.ready->fd, EPOLLIN, ready_callback, &sv);
+		if (sv.ready->port > 0 &&
+				(sv.probe_timer = ouroboros_loop_timer(sv.loop, probe_callback, &sv)) == NULL)
+			return EXIT_FAILURE;
+	}
+	if (sv.readiness &&
+			(sv.ready_timer = ouroboros_loop_timer(sv.loop, ready_timeout_callback, &sv)) == NULL)
+		return EXIT_FAILURE;
 
-				kill_ouroboros_process(&process);
+	if (config.watchdog_timeout > 0 || config.liveness_port > 0 || config.liveness_idle > 0) {
+		sv.liveness = ouroboros_liveness_init(config.watchdog_timeout,
+				config.liveness_port, config.liveness_idle);
+		if (sv.liveness == NULL)
+			return EXIT_FAILURE;
+		if ((sv.liveness_timer = ouroboros_loop_timer(sv.loop, liveness_callback, &sv)) == NULL)
+			return EXIT_FAILURE;
+	}
 
-				break;
+	if (config.watch_vcs_gate) {
+		if ((sv.vcs = ouroboros_vcs_init(sv.notify->paths)) == NULL)
+			return EXIT_FAILURE;
+		if ((sv.vcs_timer = ouroboros_loop_timer(sv.loop, vcs_callback, &sv)) == NULL)
+			return EXIT_FAILURE;
+	}
 
-			case ACTION_START:
-				action = ACTION_NONE;
-				timeout = -1;
+	if (config.watch_write_timeout > 0 &&
+			(sv.settle_timer = ouroboros_loop_timer(sv.loop, settle_callback, &sv)) == NULL)
+		return EXIT_FAILURE;
 
-				/* show what we are going to start */
-				if (verbose) {
-					char **tmp = &argv[optind];
-					fprintf(stderr, "Running command:");
-					for (; *tmp != NULL; tmp++)
-						fprintf(stderr, " %s", *tmp);
-					fprintf(stderr, "\n");
-				}
+	if (config.recycle_memory > 0 || config.recycle_lifetime > 0) {
+		if ((sv.recycle = ouroboros_recycle_init(config.recycle_memory, config.recycle_lifetime)) == NULL)
+			return EXIT_FAILURE;
+		if ((sv.recycle_timer = ouroboros_loop_timer(sv.loop, recycle_callback, &sv)) == NULL)
+			return EXIT_FAILURE;
+	}
 
-				if (start_ouroboros_process(&process)) {
-					fprintf(stderr, "error: process starting failed\n");
-					return EXIT_FAILURE;
-				}
+	/* dump recent output upon request - unless this signal is redirected */
+	if (sv.output != NULL && sv.output->ring.size) {
+		if ((sv.dump_timer = ouroboros_loop_timer(sv.loop, dump_callback, &sv)) == NULL)
+			return EXIT_FAILURE;
+		ouroboros_loop_signal(sv.loop, SIGUSR2, dump_signal_callback, &sv);
+	}
 
-				/* update pid for signal redirection */
-				sr_pid = process.pid;
+	ouroboros_crash_init(&sv.crash, config.crash_restart_limit, config.crash_restart_window,
+			config.crash_backoff_min, config.crash_backoff_max);
 
-				if (verbose)
-					fprintf(stderr, "Process ID: %d\n", process.pid);
+	/* preloader which forks workers instead of spawning them from scratch */
+	if (config.zygote != NULL) {
+		if ((sv.zygote = ouroboros_zygote_init(config.zygote, config.zygote_invalidate)) == NULL)
+			return EXIT_FAILURE;
+		sv.zygote->process.signal = config.kill_signal;
+		if ((sv.zygote_timer = ouroboros_loop_timer(sv.loop, zygote_timeout_callback, &sv)) == NULL)
+			return EXIT_FAILURE;
+	}
 
-			}
+	/* reap processes without the pidfd - unless this signal is redirected */
+	if (ouroboros_loop_signal(sv.loop, SIGCHLD, child_signal_callback, &sv) == -1)
+		perror("warning: unable to install SIGCHLD handler");
 
-		/* update interval for poll notification type */
-		if (config.engine == ONT_POLL && timeout == -1)
-			/* TODO: dedicated value for polling interval */
-			timeout = config.kill_latency * 1000;
+	/* set up signal redirections */
+	setup_signals(&sv, config.redirect_signals);
 
-		debug("poll timeout: %d", timeout);
-		if ((rv = poll(pfds, 3, timeout)) == -1) {
-			if (errno == EINTR)
-				/* signal interruption, not a big deal */
-				continue;
-			perror("error: poll failed");
-			break;
-		}
+	/* standard input - IO redirection */
+	if (config.redirect_input) {
+		if ((sv.input = ouroboros_input_init(fileno(stdin), sv.process.stdinfd[1])) == NULL)
+			return EXIT_FAILURE;
+		watch_input(&sv);
+	}
 
-		/* timeout handling */
-		if (rv == 0) {
-			timeout = -1;
-			/* maintain intervals for poll notification type */
-			if (config.engine == ONT_POLL && action != ACTION_START) {
-				if (ouroboros_notify_dispatch(notify)) {
-					action = ACTION_KILL;
-					timeout = config.kill_latency * 1000;
-				}
-			}
-			continue;
-		}
+	/* setup notification subsystem - poll type is maintained with intervals,
+	 * and so are subtrees on network file systems for other types */
+	ouroboros_loop_add(sv.loop, ouroboros_notify_fd(sv.notify), EPOLLIN, notify_callback, &sv);
+	if (config.engine == ONT_POLL || config.watch_remote_poll) {
+		struct ouroboros_loop_source *timer;
+		/* TODO: dedicated value for polling interval */
+		if ((timer = ouroboros_loop_timer(sv.loop, interval_callback, &sv)) == NULL)
+			return EXIT_FAILURE;
+		ouroboros_loop_timer_set(timer, config.kill_latency, config.kill_latency);
+	}
 
-		/* forward received input to the process */
-		if (pfds[0].revents & POLLIN) {
-			ssize_t rlen = read(pfds[0].fd, buffer, sizeof(buffer));
-			if (write(process.stdinfd[1], buffer, rlen) != rlen)
-				fprintf(stderr, "warning: data lost during input forwarding\n");
-		}
+	/* setup server subsystem */
+#if ENABLE_SERVER
+	if (sv.server->fd != -1)
+		ouroboros_loop_add(sv.loop, sv.server->fd, EPOLLIN, server_callback, &sv);
+	if (sv.server->ufd != -1)
+		ouroboros_loop_add(sv.loop, sv.server->ufd, EPOLLIN, server_callback, &sv);
+	for (i = 0; sv.agent != NULL && i < sv.agent->fds_size; i++)
+		ouroboros_loop_add(sv.loop, sv.agent->fds[i], EPOLLIN, agent_callback, &sv);
+	if (sv.http != NULL)
+		ouroboros_loop_add(sv.loop, sv.http->fd, EPOLLIN, http_callback, &sv);
+#endif
 
-		/* dispatch notification event */
-		if (pfds[1].revents & POLLIN) {
-			if (ouroboros_notify_dispatch(notify) == 1) {
-				action = ACTION_KILL;
-				timeout = config.kill_latency * 1000;
-			}
-		}
+	/* setup proxy subsystem */
+	if (sv.proxy->epfd != -1)
+		ouroboros_loop_add(sv.loop, sv.proxy->epfd, EPOLLIN, proxy_callback, &sv);
 
-#if ENABLE_SERVER
-		/* dispatch server incoming data */
-		if (pfds[2].revents & POLLIN) {
-			if (ouroboros_server_dispatch(server) == 1) {
-				action = ACTION_KILL;
-				timeout = -1;
-			}
-		}
-#endif /* ENABLE_SERVER */
+	/* in the on-demand mode process is started upon the first connection */
+	sv.stopped = config.start_on_demand;
+	if (sv.stopped)
+		ouroboros_proxy_hold(sv.proxy, 1);
 
-	}
+	/* run main maintenance loop */
+	if (command && !sv.stopped)
+		schedule_action(&sv, ACTION_START, 0);
+	ouroboros_loop_run(sv.loop);
 
 	/* use signal from the configuration to kill process */
-	kill_ouroboros_process(&process);
+	ouroboros_loop_remove(sv.process_source);
+	terminate_ouroboros_process(&sv.process);
+	if (sv.dump_pending)
+		flush_dump(&sv);
 
 	/* get the return value of watched process, if possible */
-	rv = EXIT_SUCCESS;
-	if (process.status && WIFEXITED(process.status)) {
-		rv = WEXITSTATUS(process.status);
+	rv = sv.failed ? EXIT_FAILURE : EXIT_SUCCESS;
+	if (sv.process.status && WIFEXITED(sv.process.status)) {
+		rv = WEXITSTATUS(sv.process.status);
 		debug("process exit status: %d", rv);
 	}
 
 	if (verbose)
 		fprintf(stderr, "Exiting gracefully!\n");
 
-	ouroboros_process_free(&process);
+	for (i = 0; i < config.services_size; i++)
+		ouroboros_service_free(&sv.services[i]);
+	free(sv.services);
+	ouroboros_service_scope_free(&sv.scope);
+	ouroboros_config_free_strings(&sv.deferred);
+
+	/* output file used by the process directly */
+	if (sv.output == NULL && sv.process.outfd != -1)
+		close(sv.process.outfd);
+	ouroboros_process_free(&sv.process);
+	if (sv.input != NULL)
+		ouroboros_input_free(sv.input);
+	if (sv.output != NULL)
+		ouroboros_output_free(sv.output);
+	if (sv.zygote != NULL)
+		ouroboros_zygote_free(sv.zygote);
+	if (sv.ready != NULL)
+		ouroboros_ready_free(sv.ready);
+	if (sv.liveness != NULL)
+		ouroboros_liveness_free(sv.liveness);
+	if (sv.recycle != NULL)
+		ouroboros_recycle_free(sv.recycle);
+	if (sv.vcs != NULL)
+		ouroboros_vcs_free(sv.vcs);
+	ouroboros_proxy_free(sv.proxy);
 #if ENABLE_SERVER
-	ouroboros_server_free(server);
+	ouroboros_server_free(sv.server);
+	if (sv.agent != NULL)
+		ouroboros_agent_free(sv.agent);
+	if (sv.http != NULL)
+		ouroboros_http_free(sv.http);
 #endif
-	ouroboros_notify_free(notify);
+	ouroboros_notify_free(sv.notify);
+	ouroboros_loop_free(sv.loop);
+	if (ouroboros_trace != NULL) {
+		ouroboros_trace_flush(ouroboros_trace);
+		ouroboros_trace_free(ouroboros_trace);
+	}
 	ouroboros_config_free(&config);
 	return rv;
 }
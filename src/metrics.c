@@ -0,0 +1,120 @@
+/*
+ * ouroboros - metrics.c
+ * Copyright (c) 2015 Arkadiusz Bokowy
+ *
+ * This file is a part of a ouroboros.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include "metrics.h"
+
+#include <string.h>
+#include <unistd.h>
+
+
+/* Internal function which gets the lower bound of the given power of two
+ * range (octave) of the histogram. */
+static double _octave_base(int octave) {
+	double value = 1.0;
+	int exp = OUROBOROS_METRICS_MIN_EXP + octave;
+	for (; exp < 0; exp++)
+		value /= 2;
+	for (; exp > 0; exp--)
+		value *= 2;
+	return value;
+}
+
+/* Internal function which gets the upper bound of the given bucket. */
+static double _bucket_bound(int index) {
+	int sub = index % OUROBOROS_METRICS_SUB_BUCKETS + 1;
+	return _octave_base(index / OUROBOROS_METRICS_SUB_BUCKETS) *
+		(1.0 + (double)sub / OUROBOROS_METRICS_SUB_BUCKETS);
+}
+
+/* Record given value (in seconds) in the histogram. The value is accounted
+ * in the first bucket which upper bound is not less than the value, so the
+ * bucket boundaries follow the "le" semantic of the Prometheus. Values which
+ * exceed the range of the histogram are accounted in the count and the sum
+ * only. */
+void ouroboros_metrics_observe(struct ouroboros_metrics_histogram *histogram, double value) {
+
+	double base = _octave_base(0);
+	double sub;
+	int octave = 0;
+	int index = 0;
+
+	histogram->count++;
+	histogram->sum += value;
+
+	if (value > base) {
+		/* find the power of two range (base, 2 * base] of the value */
+		while (octave < OUROBOROS_METRICS_MAX_EXP - OUROBOROS_METRICS_MIN_EXP - 1 &&
+				value > base * 2) {
+			base *= 2;
+			octave++;
+		}
+		if (value > base * 2)
+			return;
+		/* the value on the boundary belongs to the lower sub-bucket */
+		sub = (value / base - 1) * OUROBOROS_METRICS_SUB_BUCKETS;
+		index = (int)sub;
+		if (index == sub)
+			index--;
+		index += octave * OUROBOROS_METRICS_SUB_BUCKETS;
+	}
+
+	histogram->buckets[index]++;
+}
+
+/* Get the time (in seconds) elapsed since the given moment. */
+double ouroboros_metrics_since(const struct timespec *ts) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec - ts->tv_sec + (now.tv_nsec - ts->tv_nsec) / 1e9;
+}
+
+/* Write the histogram in the Prometheus text exposition format. */
+void ouroboros_metrics_print_histogram(FILE *f, const char *name, const char *help,
+		const struct ouroboros_metrics_histogram *histogram) {
+
+	unsigned long long count = 0;
+	int i;
+
+	fprintf(f, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+	for (i = 0; i < OUROBOROS_METRICS_BUCKETS; i++) {
+		count += histogram->buckets[i];
+		fprintf(f, "%s_bucket{le=\"%g\"} %llu\n", name, _bucket_bound(i), count);
+	}
+	fprintf(f, "%s_bucket{le=\"+Inf\"} %llu\n", name, histogram->count);
+	fprintf(f, "%s_sum %g\n%s_count %llu\n", name, histogram->sum, name, histogram->count);
+
+}
+
+/* Write single value (a counter or a gauge) in the Prometheus text format.
+ * If the help text is NULL, the value is a next sample of the metric (e.g.
+ * with different labels), so the header is omitted. */
+void ouroboros_metrics_print_value(FILE *f, const char *name, const char *type,
+		const char *help, double value) {
+	if (help != NULL)
+		fprintf(f, "# HELP %.*s %s\n# TYPE %.*s %s\n",
+				(int)strcspn(name, "{"), name, help, (int)strcspn(name, "{"), name, type);
+	fprintf(f, "%s %.17g\n", name, value);
+}
+
+/* Get the resident set size (in bytes) of our process. Upon error this
+ * function returns -1. */
+long ouroboros_metrics_rss(void) {
+
+	long pages = -1;
+	FILE *f;
+
+	if ((f = fopen("/proc/self/statm", "r")) == NULL)
+		return -1;
+	if (fscanf(f, "%*s %ld", &pages) != 1)
+		pages = -1;
+	fclose(f);
+
+	return pages == -1 ? -1 : pages * sysconf(_SC_PAGESIZE);
+}
@@ -0,0 +1,47 @@
+/*
+ * ouroboros - metrics.h
+ * Copyright (c) 2015 Arkadiusz Bokowy
+ *
+ * This file is a part of a ouroboros.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef __METRICS_H
+#define __METRICS_H
+
+#include <stdio.h>
+#include <time.h>
+
+
+/* Histogram buckets are log-linear (in the HDR histogram fashion): every
+ * power of two is split into the same number of linear sub-buckets, so the
+ * relative error is bounded for the whole range. The range spans from
+ * 2^MIN_EXP seconds (~1 ms) up to 2^MAX_EXP seconds (~2 min). */
+#define OUROBOROS_METRICS_MIN_EXP -10
+#define OUROBOROS_METRICS_MAX_EXP 7
+#define OUROBOROS_METRICS_SUB_BUCKETS 4
+#define OUROBOROS_METRICS_BUCKETS \
+	((OUROBOROS_METRICS_MAX_EXP - OUROBOROS_METRICS_MIN_EXP) * OUROBOROS_METRICS_SUB_BUCKETS)
+
+
+/* latency histogram (values are in seconds) */
+struct ouroboros_metrics_histogram {
+	unsigned long long buckets[OUROBOROS_METRICS_BUCKETS];
+	unsigned long long count;
+	double sum;
+};
+
+
+void ouroboros_metrics_observe(struct ouroboros_metrics_histogram *histogram, double value);
+double ouroboros_metrics_since(const struct timespec *ts);
+
+void ouroboros_metrics_print_histogram(FILE *f, const char *name, const char *help,
+		const struct ouroboros_metrics_histogram *histogram);
+void ouroboros_metrics_print_value(FILE *f, const char *name, const char *type,
+		const char *help, double value);
+
+long ouroboros_metrics_rss(void);
+
+#endif
@@ -11,18 +11,49 @@
 #include "notify.h"
 
 #include <dirent.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/stat.h>
+#include <sys/vfs.h>
 #if HAVE_SYS_INOTIFY_H
 #include <sys/inotify.h>
 #endif
 
+#include "config.h"
 #include "debug.h"
+#include "trace.h"
 
 
+/* Name patterns of temporary files created by editors upon saving - swap,
+ * backup and lock files, and temporary files of the atomic save. */
+static char *temp_patterns[] = {
+	"~$",                              /* backup files (Emacs, Vim, gedit) */
+	"(^|/)\\.[^/]*\\.sw[a-p]$",        /* Vim swap files */
+	"(^|/)4913$",                      /* Vim writability probe */
+	"(^|/)\\.#[^/]*$",                 /* Emacs lock files */
+	"(^|/)#[^/]*#$",                   /* Emacs auto-save files */
+	"(^|/)\\.goutputstream-[^/]*$",    /* GIO atomic save */
+	"___jb_(tmp|old)___$",             /* JetBrains safe write */
+	"\\.kate-swp$",                    /* Kate swap files */
+	NULL,
+};
+
+
+#if HAVE_SYS_INOTIFY_H
+/* Internal function which adds given file descriptor to the epoll set. */
+static int _epoll_add(int efd, int fd) {
+	struct epoll_event event = { .events = EPOLLIN, .data.fd = fd };
+	return epoll_ctl(efd, EPOLL_CTL_ADD, fd, &event);
+}
+#endif /* HAVE_SYS_INOTIFY_H */
+
 /* Initialize file system monitoring for given type. This function returns
  * pointer to the initialized notify structure or NULL upon error. */
 struct ouroboros_notify *ouroboros_notify_init(enum ouroboros_notify_type type) {
@@ -39,23 +70,77 @@ struct ouroboros_notify *ouroboros_notify_init(enum ouroboros_notify_type type)
 	notify->update_nodes = 1;
 	notify->dirs_only = 0;
 	notify->files_only = 0;
+	notify->verify_content = 0;
+	notify->remote_poll = 1;
+	notify->follow_symlinks = 1;
+	notify->verbose = 0;
 
 	notify->include.regex = NULL;
 	notify->include.size = 0;
 	notify->exclude.regex = NULL;
 	notify->exclude.size = 0;
+	notify->temp.regex = NULL;
+	notify->temp.size = 0;
 
 	notify->paths = NULL;
+	notify->polled = NULL;
+
+	notify->changes = NULL;
+	notify->changes_size = 0;
+	notify->overflows = 0;
+
+	notify->digest.entries = NULL;
+	notify->digest.size = 0;
+	notify->unchanged = 0;
+
+	notify->write_timeout = 0;
+	notify->pending = NULL;
+	notify->pending_size = 0;
+
+	pthread_mutex_init(&notify->worker.mutex, NULL);
+	pthread_cond_init(&notify->worker.cond, NULL);
+	notify->worker.running = 0;
+	notify->worker.queue = NULL;
+	notify->worker.queue_size = 0;
+	notify->worker.roots = 0;
+	notify->worker.scan = 0;
+	notify->worker.rebase = 0;
+	notify->worker.changes = NULL;
+	notify->worker.changes_size = 0;
+	memset(&notify->worker.scans, 0, sizeof(notify->worker.scans));
+	notify->worker.watched = 0;
+
+	if ((notify->worker.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) {
+		perror("error: unable to create eventfd");
+		free(notify);
+		return NULL;
+	}
+
+	/* poll type is used by other types as a fall-back */
+	notify->s.poll.watched = NULL;
+	notify->s.poll.size = 0;
+	notify->s.poll.scanned = 0;
 
 	switch (type) {
 	case ONT_POLL:
-		notify->s.poll.watched = NULL;
-		notify->s.poll.size = 0;
 		break;
 #if HAVE_SYS_INOTIFY_H
 	case ONT_INOTIFY:
-		if ((notify->s.inotify.fd = inotify_init1(IN_CLOEXEC)) == -1) {
+		if ((notify->s.inotify.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1) {
 			perror("warning: unable to initialize inotify subsystem");
+			close(notify->worker.fd);
+			free(notify);
+			return NULL;
+		}
+		/* events of polled subtrees are merged with inotify events */
+		if ((notify->s.inotify.efd = epoll_create1(EPOLL_CLOEXEC)) == -1 ||
+				_epoll_add(notify->s.inotify.efd, notify->s.inotify.fd) == -1 ||
+				_epoll_add(notify->s.inotify.efd, notify->worker.fd) == -1) {
+			perror("warning: unable to initialize inotify subsystem");
+			if (notify->s.inotify.efd != -1)
+				close(notify->s.inotify.efd);
+			close(notify->s.inotify.fd);
+			close(notify->worker.fd);
 			free(notify);
 			return NULL;
 		}
@@ -71,13 +156,30 @@ struct ouroboros_notify *ouroboros_notify_init(enum ouroboros_notify_type type)
 /* Free allocated resources. */
 void ouroboros_notify_free(struct ouroboros_notify *notify) {
 
-	while (notify->include.size--)
-		regfree(&notify->include.regex[notify->include.size]);
-	free(notify->include.regex);
+	struct ouroboros_notify_worker *worker = &notify->worker;
+
+	if (worker->running) {
+		/* scanning is interrupted, so we will not wait for it */
+		pthread_mutex_lock(&worker->mutex);
+		__atomic_store_n(&worker->running, 0, __ATOMIC_RELAXED);
+		pthread_cond_signal(&worker->cond);
+		pthread_mutex_unlock(&worker->mutex);
+		pthread_join(worker->thread, NULL);
+	}
+
+	while (worker->queue_size--)
+		free(worker->queue[worker->queue_size]);
+	free(worker->queue);
+	while (worker->changes_size--)
+		free(worker->changes[worker->changes_size]);
+	free(worker->changes);
+	close(worker->fd);
+	pthread_cond_destroy(&worker->cond);
+	pthread_mutex_destroy(&worker->mutex);
 
-	while (notify->exclude.size--)
-		regfree(&notify->exclude.regex[notify->exclude.size]);
-	free(notify->exclude.regex);
+	ouroboros_notify_patterns_free(&notify->include);
+	ouroboros_notify_patterns_free(&notify->exclude);
+	ouroboros_notify_patterns_free(&notify->temp);
 
 	if (notify->paths) {
 		char **ptr = notify->paths;
@@ -87,18 +189,31 @@ void ouroboros_notify_free(struct ouroboros_notify *notify) {
 		}
 	}
 	free(notify->paths);
+	ouroboros_config_free_strings(&notify->polled);
+
+	while (notify->changes_size--)
+		free(notify->changes[notify->changes_size]);
+	free(notify->changes);
+
+	ouroboros_digest_free(&notify->digest);
+
+	while (notify->pending_size--)
+		free(notify->pending[notify->pending_size].path);
+	free(notify->pending);
+
+	while (notify->s.poll.size--)
+		free(notify->s.poll.watched[notify->s.poll.size].path);
+	free(notify->s.poll.watched);
 
 	switch (notify->type) {
 	case ONT_POLL:
-		while (notify->s.poll.size--)
-			free(notify->s.poll.watched[notify->s.poll.size].path);
-		free(notify->s.poll.watched);
 		break;
 #if HAVE_SYS_INOTIFY_H
 	case ONT_INOTIFY:
 		while (notify->s.inotify.size--)
 			free(notify->s.inotify.watched[notify->s.inotify.size].path);
 		free(notify->s.inotify.watched);
+		close(notify->s.inotify.efd);
 		close(notify->s.inotify.fd);
 		break;
 #endif /* HAVE_SYS_INOTIFY_H */
@@ -107,13 +222,17 @@ void ouroboros_notify_free(struct ouroboros_notify *notify) {
 	free(notify);
 }
 
-/* Internal function for regex patterns compilation. On success this
- * function returns the number of compiled patterns. */
-static int _compile_regex(regex_t **array, char **values) {
+/* Compile ERE patterns from the given NULL-terminated array of strings.
+ * Invalid patterns are reported and discarded. On success this function
+ * returns the number of compiled patterns. */
+int ouroboros_notify_patterns_compile(struct ouroboros_notify_patterns *patterns, char **values) {
 
 	int size = 0;
 	int i, j;
 
+	patterns->regex = NULL;
+	patterns->size = 0;
+
 	/* count the number of patterns */
 	if (values)
 		while (values[size])
@@ -121,23 +240,41 @@ static int _compile_regex(regex_t **array, char **values) {
 
 	/* allocate memory for all given patters, even though some
 	 * of them might be invalid - we will discard them later */
-	if ((*array = malloc(sizeof(regex_t) * size)) == NULL)
+	if ((patterns->regex = malloc(sizeof(regex_t) * size)) == NULL)
 		return 0;
 
 	for (i = j = 0; i < size; i++, j++) {
-		int rv = regcomp(&(*array)[j], values[i], REG_EXTENDED | REG_NOSUB);
+		int rv = regcomp(&patterns->regex[j], values[i], REG_EXTENDED | REG_NOSUB);
 		if (rv != 0) {
 			/* report compilation error and discard current pattern */
-			int len = regerror(rv, &(*array)[j], NULL, 0);
+			int len = regerror(rv, &patterns->regex[j], NULL, 0);
 			char *msg = malloc(len);
-			regerror(rv, &(*array)[j], msg, len);
+			regerror(rv, &patterns->regex[j], msg, len);
 			fprintf(stderr, "warning: invalid pattern '%s': %s\n", values[i], msg);
 			free(msg);
 			j--;
 		}
 	}
 
-	return j;
+	return patterns->size = j;
+}
+
+/* Free compiled patterns. */
+void ouroboros_notify_patterns_free(struct ouroboros_notify_patterns *patterns) {
+	while (patterns->size > 0)
+		regfree(&patterns->regex[--patterns->size]);
+	free(patterns->regex);
+	patterns->regex = NULL;
+}
+
+/* Check whether given name matches any of compiled patterns. If so, this
+ * function returns 1, otherwise 0. */
+int ouroboros_notify_patterns_match(const struct ouroboros_notify_patterns *patterns, const char *name) {
+	int i;
+	for (i = patterns->size; i--; )
+		if (regexec(&patterns->regex[i], name, 0, NULL, 0) == 0)
+			return 1;
+	return 0;
 }
 
 /* Enable or disable recursive directory scanning upon adding new nodes to
@@ -174,6 +311,66 @@ int ouroboros_notify_files_only(struct ouroboros_notify *notify, int value) {
 	return tmp;
 }
 
+/* Enable or disable verification of the file content. If enabled, changes
+ * of files which content has not changed are not reported. Note, that the
+ * digest of the file is computed upon its first change, so such a change is
+ * always reported. This function returns the previous value. */
+int ouroboros_notify_verify_content(struct ouroboros_notify *notify, int value) {
+	int tmp = notify->verify_content;
+	notify->verify_content = value;
+	if (!value)
+		ouroboros_digest_free(&notify->digest);
+	return tmp;
+}
+
+/* Enable or disable ignoring temporary files of editors, e.g. swap files
+ * or temporary files of the write-and-rename save. Such files tend to match
+ * broad include patterns, but changing them is not a modification of the
+ * watched tree. This function returns the previous value. */
+int ouroboros_notify_ignore_temp(struct ouroboros_notify *notify, int value) {
+	int tmp = notify->temp.size > 0;
+	ouroboros_notify_patterns_free(&notify->temp);
+	if (value)
+		ouroboros_notify_patterns_compile(&notify->temp, temp_patterns);
+	return tmp;
+}
+
+/* Set the maximum time (in seconds) of waiting for the write completion of
+ * changed files. If set to 0, changes are reported right away. This function
+ * returns the previous value. */
+double ouroboros_notify_write_timeout(struct ouroboros_notify *notify, double value) {
+	double tmp = notify->write_timeout;
+	notify->write_timeout = value;
+	return tmp;
+}
+
+/* Enable or disable polling of subtrees located on network file systems,
+ * on which other notification types do not report changes made by other
+ * hosts. This function returns the previous value. */
+int ouroboros_notify_remote_poll(struct ouroboros_notify *notify, int value) {
+	int tmp = notify->remote_poll;
+	notify->remote_poll = value;
+	return tmp;
+}
+
+/* Enable or disable following symbolic links during the directory scan.
+ * Directories reachable by many paths are scanned once regardless of this
+ * setting, so symbolic link loops are safe. This function returns the
+ * previous value. */
+int ouroboros_notify_follow_symlinks(struct ouroboros_notify *notify, int value) {
+	int tmp = notify->follow_symlinks;
+	notify->follow_symlinks = value;
+	return tmp;
+}
+
+/* Enable or disable reporting of the notification engine which is used for
+ * every watched path. This function returns the previous value. */
+int ouroboros_notify_verbose(struct ouroboros_notify *notify, int value) {
+	int tmp = notify->verbose;
+	notify->verbose = value;
+	return tmp;
+}
+
 /* Set include pattern values. If given array is empty (passed NULL pointer
  * or first element is NULL), then accept-all regex is assumed as a sane
  * default. This function returns the number of processed patterns. */
@@ -185,70 +382,95 @@ int ouroboros_notify_include_patterns(struct ouroboros_notify *notify, char **va
 	if (values == NULL || *values == NULL)
 		values = all;
 
-	notify->include.size = _compile_regex(&notify->include.regex, values);
-	return notify->include.size;
+	return ouroboros_notify_patterns_compile(&notify->include, values);
 }
 
 /* Set exclude pattern values. This function returns the number of
  * successfully processed patterns. */
 int ouroboros_notify_exclude_patterns(struct ouroboros_notify *notify, char **values) {
-	notify->exclude.size = _compile_regex(&notify->exclude.regex, values);
-	return notify->exclude.size;
+	return ouroboros_notify_patterns_compile(&notify->exclude, values);
 }
 
-/* Recursively add directories into the notify monitoring subsystem. If
- * given directory array is empty, then current working directory is used
- * instead. */
-int ouroboros_notify_watch(struct ouroboros_notify *notify, char **dirs) {
+/* Internal function for sorting monitored nodes by their paths. */
+static int _poll_cmp(const void *a, const void *b) {
+	return strcmp(((const struct ouroboros_notify_poll_node *)a)->path,
+			((const struct ouroboros_notify_poll_node *)b)->path);
+}
 
-	char cwd[128];
-	char *defaults[] = { cwd, NULL };
-	int size = 0;
+/* Internal function which sorts monitoring pool, so two snapshots can be
+ * compared in the linear time. */
+static void _poll_sort(struct ouroboros_notify_data_poll *data) {
+	qsort(data->watched, data->size, sizeof(*data->watched), _poll_cmp);
+}
 
-	if (dirs == NULL) {
-		dirs = defaults;
-		if (getcwd(cwd, sizeof(cwd)) == NULL) {
-			fprintf(stderr, "error: unable to get current working directory\n");
-			return -1;
-		}
-	}
+/* Internal function to check name against the regex patterns. If given
+ * name should trigger notification 1 is returned, otherwise 0. */
+static int _check_patterns(struct ouroboros_notify *notify, const char *name) {
 
-	/* get the number of elements in the array */
-	while (dirs[size])
-		size++;
+	if (ouroboros_notify_patterns_match(&notify->temp, name))
+		return 0;
 
-	if ((notify->paths = malloc(sizeof(char *) * (size + 1))) == NULL)
-		return -1;
+	/* check the name against include patterns, if matched, then check against
+	 * exclude patterns - exclude takes precedence over include */
+	if (ouroboros_notify_patterns_match(&notify->include, name))
+		return !ouroboros_notify_patterns_match(&notify->exclude, name);
+
+	return 0;
+}
 
-	/* list terminator */
-	notify->paths[size] = NULL;
+/* Internal function which records path of the node which has triggered the
+ * notification. On success this function returns 0, otherwise -1. */
+static int _add_change(char ***changes, int *size, const char *path) {
 
-	/* iterate over given directories */
-	while (size--) {
-		ouroboros_notify_watch_path(notify, dirs[size]);
-		notify->paths[size] = strdup(dirs[size]);
-	}
+	char **tmp;
 
+	if ((tmp = realloc(*changes, sizeof(char *) * (*size + 2))) == NULL)
+		return -1;
+
+	*changes = tmp;
+	(*changes)[(*size)++] = strdup(path);
+	(*changes)[*size] = NULL;
 	return 0;
 }
 
-/* Internal function to check name against the regex patterns. If given
- * name should trigger notification 1 is returned, otherwise 0. */
-static int _check_patterns(struct ouroboros_notify *notify, const char *name) {
+/* Internal function which forgets recorded changes. */
+static void _clear_changes(char **changes, int *size) {
+	while (*size > 0)
+		free(changes[--*size]);
+	if (changes)
+		changes[0] = NULL;
+}
 
-	int i;
+/* Internal function which drops changes of files which content has not
+ * changed. The number of bytes hashed at once is bounded, so a large batch
+ * of changes (e.g. a checkout) does not stall the main loop - changes above
+ * the limit are reported without the verification. If there is no change
+ * left, this function returns 0, otherwise 1. This function shall be called
+ * by the main thread only. */
+static int _verify_changes(struct ouroboros_notify *notify) {
 
-	/* check the name against include patterns, if matched, then check against
-	 * exclude patterns - exclude takes precedence over include */
-	for (i = notify->include.size; i--; )
-		if (regexec(&notify->include.regex[i], name, 0, NULL, 0) == 0) {
-			for (i = notify->exclude.size; i--; )
-				if (regexec(&notify->exclude.regex[i], name, 0, NULL, 0) == 0)
-					return 0;
-			return 1;
+	off_t budget = OUROBOROS_DIGEST_BATCH_SIZE;
+	struct timespec ts;
+	int i, j;
+
+	if (!notify->verify_content || notify->changes_size == 0)
+		return notify->changes_size > 0;
+
+	trace_mark(&ts);
+	for (i = j = 0; i < notify->changes_size; i++) {
+		if (ouroboros_digest_verify(&notify->digest, notify->changes[i], &budget))
+			notify->changes[j++] = notify->changes[i];
+		else {
+			debug("content not changed: %s", notify->changes[i]);
+			free(notify->changes[i]);
+			notify->unchanged++;
 		}
+	}
+	notify->changes[j] = NULL;
+	notify->changes_size = j;
+	trace_span("verify content", &ts, j > 0 ? notify->changes[0] : NULL);
 
-	return 0;
+	return notify->changes_size > 0;
 }
 
 /* Internal function to add new path to the monitoring pool. On success this
@@ -267,26 +489,264 @@ static int _poll_add_path(struct ouroboros_notify_data_poll *data,
 	return 0;
 }
 
-/* Add given location with all subdirectories (if configured so) into the
- * monitoring subsystem. Upon error this function returns -1. */
-int ouroboros_notify_watch_path(struct ouroboros_notify *notify, const char *path) {
+/* Internal function which gets the index of the held change of the given
+ * file. If the change of the file is not held, -1 is returned. */
+static int _pending_lookup(const struct ouroboros_notify *notify, const char *path) {
+	int i;
+	for (i = notify->pending_size; i--; )
+		if (strcmp(notify->pending[i].path, path) == 0)
+			break;
+	return i;
+}
+
+/* Internal function which holds the change of the given file until its
+ * write is completed. If the file is already held, its sample is updated. */
+static void _pending_add(struct ouroboros_notify *notify, const char *path,
+		const struct stat *s, int open) {
+
+	struct ouroboros_notify_pending *tmp;
+	int i;
+
+	if ((i = _pending_lookup(notify, path)) == -1) {
+		i = notify->pending_size;
+		if ((tmp = realloc(notify->pending, sizeof(*tmp) * (i + 1))) == NULL)
+			return;
+		notify->pending = tmp;
+		notify->pending[i].path = strdup(path);
+		notify->pending[i].open = 0;
+		clock_gettime(CLOCK_MONOTONIC, &notify->pending[i].since);
+		notify->pending_size++;
+		debug("waiting for write completion: %s", path);
+	}
+
+	notify->pending[i].size = s->st_size;
+	notify->pending[i].mtime = s->st_mtim;
+	clock_gettime(CLOCK_MONOTONIC, &notify->pending[i].sampled);
+	notify->pending[i].open |= open;
+}
+
+/* Internal function which stops holding the change at the given index. */
+static void _pending_remove(struct ouroboros_notify *notify, int i) {
+	free(notify->pending[i].path);
+	notify->pending[i] = notify->pending[--notify->pending_size];
+}
+
+/* Internal function which holds changes of regular files, until they are
+ * confirmed to be stable by the ouroboros_notify_settle(). This function
+ * shall be called for changes detected by the poll type only - inotify
+ * reports the write completion by itself. */
+static void _settle_changes(struct ouroboros_notify *notify) {
+
+	struct stat s;
+	int i, j;
+
+	if (notify->write_timeout <= 0 || notify->changes_size == 0)
+		return;
+
+	for (i = j = 0; i < notify->changes_size; i++) {
+		if (lstat(notify->changes[i], &s) == 0 && S_ISREG(s.st_mode)) {
+			_pending_add(notify, notify->changes[i], &s, 0);
+			free(notify->changes[i]);
+		}
+		else
+			notify->changes[j++] = notify->changes[i];
+	}
+	notify->changes[j] = NULL;
+	notify->changes_size = j;
+
+}
+
+#if HAVE_SYS_INOTIFY_H
+/* Internal function which adds inotify watch for the given path. If the
+ * parent flag is set, the directory is watched only for nodes which are
+ * watched paths by themselves. This function shall be called with the
+ * worker mutex locked. Upon error this function returns -1. */
+static int _inotify_add(struct ouroboros_notify *notify, const char *path, int parent) {
+
+	struct ouroboros_notify_data_inotify *data = &notify->s.inotify;
+	int wd;
+	int i;
+
+	if ((wd = inotify_add_watch(data->fd, path, IN_ATTRIB | IN_CREATE |
+					IN_DELETE | IN_CLOSE_WRITE | IN_MOVE | IN_MOVE_SELF)) == -1) {
+		perror("warning: unable to add inotify watch");
+		return -1;
+	}
+
+	/* check for already stored watch descriptor */
+	for (i = data->size; i--; )
+		if (data->watched[i].wd == wd)
+			break;
+
+	/* add new watched location (full patch) */
+	if (i == -1) {
+		data->size++;
+		data->watched = realloc(data->watched, sizeof(*data->watched) * data->size);
+		data->watched[data->size - 1].wd = wd;
+		data->watched[data->size - 1].path = strdup(path);
+		data->watched[data->size - 1].parent = parent;
+	}
+	/* directory is watched as a whole from now on */
+	else if (!parent)
+		data->watched[i].parent = 0;
+
+	return wd;
+}
+#endif /* HAVE_SYS_INOTIFY_H */
+
+/* Internal function which computes the hash of the file system node. */
+static inline size_t _visited_hash(dev_t dev, ino_t ino) {
+	uint64_t h = ((uint64_t)ino ^ ((uint64_t)dev << 32)) * 0x9E3779B97F4A7C15ULL;
+	return h ^ (h >> 29);
+}
+
+/* Internal function which adds the node to the set of visited ones. If the
+ * node has been visited already, this function returns 0, otherwise 1. */
+static int _visited_add(struct ouroboros_notify_visited *visited, dev_t dev, ino_t ino) {
+
+	struct ouroboros_notify_visited_node *nodes;
+	size_t i, mask;
+
+	/* keep the load factor of the open addressing table below 1/2 */
+	if (2 * (visited->used + 1) > visited->size) {
+
+		size_t size = visited->size ? 2 * visited->size : 64;
+
+		if ((nodes = calloc(size, sizeof(*nodes))) == NULL)
+			return 1;
+
+		for (i = 0; i < visited->size; i++)
+			if (visited->nodes[i].ino != 0) {
+				mask = _visited_hash(visited->nodes[i].dev, visited->nodes[i].ino) & (size - 1);
+				while (nodes[mask].ino != 0)
+					mask = (mask + 1) & (size - 1);
+				nodes[mask] = visited->nodes[i];
+			}
+
+		free(visited->nodes);
+		visited->nodes = nodes;
+		visited->size = size;
+	}
+
+	mask = visited->size - 1;
+	for (i = _visited_hash(dev, ino) & mask; visited->nodes[i].ino != 0; i = (i + 1) & mask)
+		if (visited->nodes[i].ino == ino && visited->nodes[i].dev == dev)
+			return 0;
+
+	visited->nodes[i].dev = dev;
+	visited->nodes[i].ino = ino;
+	visited->used++;
+	return 1;
+}
+
+/* Internal function which checks whether given path is located on the
+ * network (or otherwise shared) file system. If so, the name of the file
+ * system is returned, otherwise NULL. */
+static const char *_remote_fs(const char *path) {
+
+	static const struct {
+		unsigned long magic;
+		const char *name;
+	} types[] = {
+		{ 0x6969, "nfs" },
+		{ 0x517B, "smb" },
+		{ 0xFF534D42, "cifs" },
+		{ 0xFE534D42, "smb2" },
+		{ 0x65735546, "fuse" },
+		{ 0x01021997, "9p" },
+		{ 0x00C36400, "ceph" },
+		{ 0x5346414F, "afs" },
+		{ 0x73757245, "coda" },
+		{ 0x01161970, "gfs2" },
+		{ 0x7461636F, "ocfs2" },
+		{ 0x0BD00BD0, "lustre" },
+		{ 0x786F4256, "vboxsf" },
+		{ 0x7C7C6673, "prl_fs" },
+	};
+
+	struct statfs s;
+	size_t i;
+
+	if (statfs(path, &s) == -1)
+		return NULL;
+
+	for (i = 0; i < sizeof(types) / sizeof(*types); i++)
+		if ((unsigned long)s.f_type == types[i].magic)
+			return types[i].name;
+
+	return NULL;
+}
+
+/* Internal function which adds given path to the list of subtrees which are
+ * polled, because the configured notification type can not be used there. */
+static void _poll_root(struct ouroboros_notify *notify, const char *path, const char *fs) {
+
+	struct ouroboros_notify_worker *worker = &notify->worker;
+	char **tmp;
+
+	pthread_mutex_lock(&worker->mutex);
+	for (tmp = notify->polled; tmp != NULL && *tmp != NULL; tmp++)
+		if (strcmp(*tmp, path) == 0)
+			break;
+	if (tmp == NULL || *tmp == NULL) {
+		fprintf(stderr, "warning: events are not reported by %s file system, "
+				"using poll engine for: %s\n", fs, path);
+		ouroboros_config_add_string(&notify->polled, path);
+		/* new nodes are not modifications */
+		worker->rebase = 1;
+	}
+	pthread_mutex_unlock(&worker->mutex);
+
+}
+
+/* Internal function which adds given location with all subdirectories (if
+ * configured so) into the monitoring subsystem of the given type. The file
+ * system is checked for the root path and upon crossing the mount point - the
+ * device of the parent directory is given (or 0 for the root). Upon error
+ * this function returns -1. */
+static int _watch_path(struct ouroboros_notify *notify, const char *path,
+		const struct stat *st, enum ouroboros_notify_type type, dev_t parent,
+		struct ouroboros_notify_visited *visited) {
 	debug("adding new path: %s", path);
 
+	const char *fs;
 	struct stat s;
+	dev_t dev;
+	int isdir;
 
-	if (stat(path, &s) == -1) {
+	/* the status of nodes found during the scan is already known */
+	if (st != NULL)
+		s = *st;
+	else if (stat(path, &s) == -1) {
 		perror("warning: unable to stat pathname");
 		return -1;
 	}
 
+	isdir = S_ISDIR(s.st_mode);
+	dev = s.st_dev;
+
+	/* directory reachable by many paths (symbolic link, bind mount or nested
+	 * watched path) is scanned once - it also breaks symbolic link loops */
+	if (isdir && !_visited_add(visited, s.st_dev, s.st_ino)) {
+		debug("already visited: %s", path);
+		return 0;
+	}
+
+	/* inotify does not report changes made by other hosts */
+	if (type != ONT_POLL && notify->remote_poll && (parent == 0 || parent != dev) &&
+			(fs = _remote_fs(path)) != NULL) {
+		_poll_root(notify, path, fs);
+		return 0;
+	}
+
 	/* add current path to the monitoring pool */
-	if (notify->type == ONT_POLL)
+	if (type == ONT_POLL)
 		if (!(notify->files_only && S_ISDIR(s.st_mode)))
 			if (_check_patterns(notify, path))
 				_poll_add_path(&notify->s.poll, path, &s.st_mtim);
 
 	/* iterate over all nodes if path is a directory */
-	if (S_ISDIR(s.st_mode) && (notify->recursive || notify->type == ONT_POLL)) {
+	if (S_ISDIR(s.st_mode) && (notify->recursive || type == ONT_POLL)) {
 
 		DIR *dir;
 		struct dirent *dp;
@@ -295,6 +755,10 @@ int ouroboros_notify_watch_path(struct ouroboros_notify *notify, const char *pat
 		if ((dir = opendir(path)) != NULL) {
 			while ((dp = readdir(dir)) != NULL) {
 
+				/* worker is being terminated - there is no point to go on */
+				if (!__atomic_load_n(&notify->worker.running, __ATOMIC_RELAXED))
+					break;
+
 				/* omit special directories */
 				if (strcmp(dp->d_name, ".") == 0 || strcmp(dp->d_name, "..") == 0)
 					continue;
@@ -302,18 +766,18 @@ int ouroboros_notify_watch_path(struct ouroboros_notify *notify, const char *pat
 				tmp = malloc(strlen(path) + strlen(dp->d_name) + 2);
 				sprintf(tmp, "%s/%s", path, dp->d_name);
 
-				if (stat(tmp, &s) != -1) {
+				if ((notify->follow_symlinks ? stat(tmp, &s) : lstat(tmp, &s)) != -1) {
 					if (S_ISDIR(s.st_mode)) {
 
 						/* recursive mode, so go deeper */
 						if (notify->recursive)
-							ouroboros_notify_watch_path(notify, tmp);
+							_watch_path(notify, tmp, &s, type, dev, visited);
 
 					}
 					else {
 
 						/* add node to the monitoring pool */
-						if (notify->type == ONT_POLL && !notify->dirs_only)
+						if (type == ONT_POLL && !notify->dirs_only)
 							if (_check_patterns(notify, tmp))
 								_poll_add_path(&notify->s.poll, tmp, &s.st_mtim);
 
@@ -326,7 +790,7 @@ int ouroboros_notify_watch_path(struct ouroboros_notify *notify, const char *pat
 		}
 	}
 
-	switch (notify->type) {
+	switch (type) {
 	case ONT_POLL:
 		/* Poll-based notification type is incorporated in the main code base of
 		 * this function. It has some penalty on the readability. Nonetheless it
@@ -335,32 +799,25 @@ int ouroboros_notify_watch_path(struct ouroboros_notify *notify, const char *pat
 		break;
 #if HAVE_SYS_INOTIFY_H
 	case ONT_INOTIFY:
-		{
-			int wd;
-			int i;
-
-			/* add path to the monitoring subsystem */
-			if ((wd = inotify_add_watch(notify->s.inotify.fd, path, IN_ATTRIB |
-							IN_CREATE | IN_DELETE | IN_CLOSE_WRITE | IN_MOVE_SELF)) == -1)
-				perror("warning: unable to add inotify watch");
+		/* Add path to the monitoring subsystem. Events for the new watch
+		 * descriptor might be dispatched before we store it, so it has to be
+		 * done while holding the lock. */
+		pthread_mutex_lock(&notify->worker.mutex);
+		_inotify_add(notify, path, 0);
+		/* Single file replaced by the rename (atomic save) loses its watch,
+		 * so its directory is watched too - in order to re-arm the watch. */
+		if (!isdir) {
+			char *tmp = strdup(path);
+			char *slash = strrchr(tmp, '/');
+			if (slash == NULL)
+				_inotify_add(notify, ".", 1);
 			else {
-
-				/* check for already stored watch descriptor */
-				for (i = notify->s.inotify.size; i--; )
-					if (notify->s.inotify.watched[i].wd == wd)
-						break;
-
-				/* add new watched location (full patch) */
-				if (i == -1) {
-					notify->s.inotify.size++;
-					notify->s.inotify.watched = realloc(notify->s.inotify.watched,
-							sizeof(*notify->s.inotify.watched) * notify->s.inotify.size);
-					notify->s.inotify.watched[notify->s.inotify.size - 1].wd = wd;
-					notify->s.inotify.watched[notify->s.inotify.size - 1].path = strdup(path);
-				}
-
+				*(slash == tmp ? slash + 1 : slash) = '\0';
+				_inotify_add(notify, tmp, 1);
 			}
+			free(tmp);
 		}
+		pthread_mutex_unlock(&notify->worker.mutex);
 		break;
 #endif /* HAVE_SYS_INOTIFY_H */
 	}
@@ -368,88 +825,742 @@ int ouroboros_notify_watch_path(struct ouroboros_notify *notify, const char *pat
 	return 0;
 }
 
-/* Dispatch notification event and optionally add new directories into the
- * monitoring subsystem. If current event matches given patterns, then this
- * function returns 1. Upon error this function returns -1. */
-int ouroboros_notify_dispatch(struct ouroboros_notify *notify) {
-	debug("dispatch");
+/* Add given location with all subdirectories (if configured so) into the
+ * monitoring subsystem. Upon error this function returns -1. */
+int ouroboros_notify_watch_path(struct ouroboros_notify *notify, const char *path) {
+	struct ouroboros_notify_visited visited = { 0 };
+	int rv = _watch_path(notify, path, NULL, notify->type, 0, &visited);
+	free(visited.nodes);
+	return rv;
+}
 
-	switch (notify->type) {
-	case ONT_POLL:
-		{
-			if (notify->update_nodes) {
+/* Internal function which takes a snapshot of the watched tree and compares
+ * it with the previous one. Paths of changed nodes are stored in the given
+ * changes array. This function shall be called by the worker only. */
+static void _poll_scan(struct ouroboros_notify *notify, char ***changes, int *size) {
+
+	struct ouroboros_notify_worker *worker = &notify->worker;
+	char **dirs = NULL;
+	char **tmp;
+
+	/* watched paths might be modified in the meantime - other types poll
+	 * only subtrees on which they can not be used */
+	pthread_mutex_lock(&worker->mutex);
+	for (tmp = notify->type == ONT_POLL ? notify->paths : notify->polled;
+			tmp != NULL && *tmp != NULL; tmp++)
+		ouroboros_config_add_string(&dirs, *tmp);
+	if (worker->rebase)
+		notify->s.poll.scanned = 0;
+	worker->rebase = 0;
+	pthread_mutex_unlock(&worker->mutex);
+
+	if (notify->update_nodes || !notify->s.poll.scanned) {
+
+		struct ouroboros_notify_data_poll olddata;
+		int i, j, rv;
+
+		/* save current data snapshot and clear original */
+		memcpy(&olddata, &notify->s.poll, sizeof(olddata));
+		notify->s.poll.watched = NULL;
+		notify->s.poll.size = 0;
+		notify->s.poll.scanned = 1;
+
+		/* get fresh data snapshot */
+		struct ouroboros_notify_visited visited = { 0 };
+
+		for (tmp = dirs; tmp != NULL && *tmp != NULL; tmp++)
+			_watch_path(notify, *tmp, NULL, ONT_POLL, 0, &visited);
+		free(visited.nodes);
+
+		_poll_sort(&notify->s.poll);
+
+		/* both snapshots are sorted, so we can merge them in order to find
+		 * added, removed and modified nodes - the initial one is a baseline */
+		for (i = j = 0; olddata.scanned && (i < olddata.size || j < notify->s.poll.size); ) {
+			if (j == notify->s.poll.size)
+				rv = -1;
+			else if (i == olddata.size)
+				rv = 1;
+			else
+				rv = strcmp(olddata.watched[i].path, notify->s.poll.watched[j].path);
+			if (rv < 0)
+				_add_change(changes, size, olddata.watched[i++].path);
+			else if (rv > 0)
+				_add_change(changes, size, notify->s.poll.watched[j++].path);
+			else {
+				/* check if file time-stamp has changed */
+				if (notify->s.poll.watched[j].mtime.tv_sec != olddata.watched[i].mtime.tv_sec ||
+						notify->s.poll.watched[j].mtime.tv_nsec != olddata.watched[i].mtime.tv_nsec)
+					_add_change(changes, size, notify->s.poll.watched[j].path);
+				i++, j++;
+			}
+		}
 
-				struct ouroboros_notify_data_poll olddata;
-				char **dirs = notify->paths;
-				int rv = 0;
+		while (olddata.size--)
+			free(olddata.watched[olddata.size].path);
+		free(olddata.watched);
 
-				/* save current data snapshot and clear original */
-				memcpy(&olddata, &notify->s.poll, sizeof(olddata));
-				notify->s.poll.watched = NULL;
-				notify->s.poll.size = 0;
+	}
+	else {
+
+		struct stat s;
+		int i;
+
+		for (i = notify->s.poll.size; i--; ) {
+			if (stat(notify->s.poll.watched[i].path, &s) == -1)
+				/* the most probable reason for this fail is that the file has
+				 * been removed, however we are working in the non-update mode,
+				 * so drop this error silently */
+				continue;
+			/* check if file time-stamp has changed */
+			if (notify->s.poll.watched[i].mtime.tv_sec != s.st_mtim.tv_sec ||
+					notify->s.poll.watched[i].mtime.tv_nsec != s.st_mtim.tv_nsec) {
+				notify->s.poll.watched[i].mtime.tv_sec = s.st_mtim.tv_sec;
+				notify->s.poll.watched[i].mtime.tv_nsec = s.st_mtim.tv_nsec;
+				_add_change(changes, size, notify->s.poll.watched[i].path);
+			}
+		}
 
-				/* get fresh data snapshot */
-				while (*dirs) {
-					ouroboros_notify_watch_path(notify, *dirs);
-					dirs++;
-				}
+	}
 
-				if (olddata.size != notify->s.poll.size)
-					rv = 1;
-				else
-					/* this logic exploits the fact, that the order of returned nodes
-					 * from the stream is constant - if FS has not been modified */
-					while (olddata.size) {
-						olddata.size--;
-						free(olddata.watched[olddata.size].path);
-						/* check if file time-stamp has changed */
-						if (notify->s.poll.watched[olddata.size].mtime.tv_sec != olddata.watched[olddata.size].mtime.tv_sec ||
-								notify->s.poll.watched[olddata.size].mtime.tv_nsec != olddata.watched[olddata.size].mtime.tv_nsec) {
-							rv = 1;
-							break;
-						}
-					}
+	for (tmp = dirs; tmp != NULL && *tmp != NULL; tmp++)
+		free(*tmp);
+	free(dirs);
+}
 
-				while (olddata.size--)
-					free(olddata.watched[olddata.size].path);
-				free(olddata.watched);
+/* Internal function which runs in the background and performs requested
+ * scans. Detected changes are posted back with the eventfd, so the main
+ * loop does not have to wait for the file system. */
+static void *_worker_thread(void *arg) {
+
+	struct ouroboros_notify *notify = arg;
+	struct ouroboros_notify_worker *worker = &notify->worker;
+	char **changes = NULL;
+	int changes_size = 0;
+	struct timespec ts;
+	uint64_t one = 1;
+	char **dirs, **tmp;
+	char *path;
+	int i;
 
-				return rv;
+	pthread_mutex_lock(&worker->mutex);
+	while (worker->running) {
+
+		if (worker->roots) {
+			worker->roots = 0;
+			for (dirs = NULL, tmp = notify->paths; tmp != NULL && *tmp != NULL; tmp++)
+				ouroboros_config_add_string(&dirs, *tmp);
+			pthread_mutex_unlock(&worker->mutex);
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			struct ouroboros_notify_visited visited = { 0 };
+			for (tmp = dirs; tmp != NULL && *tmp != NULL; tmp++) {
+				_watch_path(notify, *tmp, NULL, notify->type, 0, &visited);
+				if (notify->verbose)
+					fprintf(stderr, "Watching with %s engine: %s\n",
+							ouroboros_notify_engine(notify, *tmp), *tmp);
 			}
-			else {
+			free(visited.nodes);
+			trace_span("watch", &ts, NULL);
+			ouroboros_config_free_strings(&dirs);
+			pthread_mutex_lock(&worker->mutex);
+			ouroboros_metrics_observe(&worker->scans, ouroboros_metrics_since(&ts));
+			continue;
+		}
 
-				struct stat s;
-				int rv = 0;
-				int i;
-
-				for (i = notify->s.poll.size; i--; ) {
-					if (stat(notify->s.poll.watched[i].path, &s) == -1)
-						/* the most probable reason for this fail is that the file has
-						 * been removed, however we are working in the non-update mode,
-						 * so drop this error silently */
-						continue;
-					/* check if file time-stamp has changed */
-					if (notify->s.poll.watched[i].mtime.tv_sec != s.st_mtim.tv_sec ||
-							notify->s.poll.watched[i].mtime.tv_nsec != s.st_mtim.tv_nsec) {
-						notify->s.poll.watched[i].mtime.tv_sec = s.st_mtim.tv_sec;
-						notify->s.poll.watched[i].mtime.tv_nsec = s.st_mtim.tv_nsec;
-						rv = 1;
-					}
-				}
+		if (worker->queue_size > 0) {
+			path = worker->queue[--worker->queue_size];
+			pthread_mutex_unlock(&worker->mutex);
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			ouroboros_notify_watch_path(notify, path);
+			trace_span("watch", &ts, path);
+			free(path);
+			pthread_mutex_lock(&worker->mutex);
+			ouroboros_metrics_observe(&worker->scans, ouroboros_metrics_since(&ts));
+			continue;
+		}
+
+		if (worker->scan) {
+			worker->scan = 0;
+			pthread_mutex_unlock(&worker->mutex);
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			_poll_scan(notify, &changes, &changes_size);
+			trace_span("scan", &ts, NULL);
+			pthread_mutex_lock(&worker->mutex);
+			ouroboros_metrics_observe(&worker->scans, ouroboros_metrics_since(&ts));
+			worker->watched = notify->s.poll.size;
+
+			/* merge with changes which have not been dispatched yet */
+			for (i = 0; i < changes_size; i++)
+				_add_change(&worker->changes, &worker->changes_size, changes[i]);
+			_clear_changes(changes, &changes_size);
+
+			if (worker->changes_size > 0 &&
+					write(worker->fd, &one, sizeof(one)) == -1)
+				debug("unable to signal scan results: %s", strerror(errno));
+			continue;
+		}
+
+		pthread_cond_wait(&worker->cond, &worker->mutex);
+	}
+	pthread_mutex_unlock(&worker->mutex);
+
+	free(changes);
+	return NULL;
+}
+
+/* Internal function which starts the background worker. On success this
+ * function returns 0, otherwise -1. */
+static int _worker_start(struct ouroboros_notify *notify) {
+
+	sigset_t sigset, oldset;
+	int rv;
+
+	if (notify->worker.running)
+		return 0;
 
-				return rv;
+	/* all signals shall be handled by the main thread */
+	sigfillset(&sigset);
+	pthread_sigmask(SIG_SETMASK, &sigset, &oldset);
+	notify->worker.running = 1;
+	rv = pthread_create(&notify->worker.thread, NULL, _worker_thread, notify);
+	pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+
+	if (rv != 0) {
+		notify->worker.running = 0;
+		errno = rv;
+		perror("error: unable to start scanning worker");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Internal function which queues given path for the background scanning. */
+static void _worker_queue(struct ouroboros_notify *notify, const char *path) {
+
+	struct ouroboros_notify_worker *worker = &notify->worker;
+	char **tmp;
+
+	pthread_mutex_lock(&worker->mutex);
+	if ((tmp = realloc(worker->queue, sizeof(char *) * (worker->queue_size + 1))) != NULL) {
+		worker->queue = tmp;
+		worker->queue[worker->queue_size++] = strdup(path);
+		pthread_cond_signal(&worker->cond);
+	}
+	pthread_mutex_unlock(&worker->mutex);
+}
+
+/* Request full scan of the watched tree. The scan is performed by the
+ * background worker and consecutive requests are coalesced, so a scan which
+ * takes longer than the polling interval will not pile up. Detected changes
+ * are reported with the ouroboros_notify_dispatch(). */
+int ouroboros_notify_scan(struct ouroboros_notify *notify) {
+	pthread_mutex_lock(&notify->worker.mutex);
+	if (notify->type == ONT_POLL || (notify->polled != NULL && *notify->polled != NULL)) {
+		notify->worker.scan = 1;
+		pthread_cond_signal(&notify->worker.cond);
+	}
+	pthread_mutex_unlock(&notify->worker.mutex);
+	return 0;
+}
+
+/* Internal function which checks whether given path is located within the
+ * given directory (but it is not the directory itself). */
+static int _path_within(const char *path, const char *dir) {
+	size_t len = strlen(dir);
+	if (strcmp(dir, "/") == 0)
+		return path[0] == '/' && path[1] != '\0';
+	return strncmp(path, dir, len) == 0 && path[len] == '/';
+}
+
+/* Recursively add directories into the notify monitoring subsystem. If
+ * given directory array is empty, then current working directory is used
+ * instead. Directories are added in the background, so this function does
+ * not wait for the registration to finish. */
+int ouroboros_notify_watch(struct ouroboros_notify *notify, char **dirs) {
+
+	char cwd[128];
+	char *defaults[] = { cwd, NULL };
+	char **canonical;
+	int size = 0;
+	int i, j;
+
+	if (dirs == NULL) {
+		dirs = defaults;
+		if (getcwd(cwd, sizeof(cwd)) == NULL) {
+			fprintf(stderr, "error: unable to get current working directory\n");
+			return -1;
+		}
+	}
+
+	/* get the number of elements in the array */
+	while (dirs[size])
+		size++;
+
+	if ((canonical = calloc(size + 1, sizeof(char *))) == NULL)
+		return -1;
+	for (i = 0; i < size; i++)
+		if ((canonical[i] = realpath(dirs[i], NULL)) == NULL)
+			canonical[i] = strdup(dirs[i]);
+
+	/* The same location might be given many times (e.g. via symbolic link),
+	 * and in the recursive mode nested locations are watched anyway. Such
+	 * paths are dropped, so the tree is not registered (and reported) twice,
+	 * regardless of the order in which paths were given. */
+	for (i = 0; i < size; i++) {
+		for (j = 0; j < size; j++) {
+			if (i == j || canonical[i] == NULL || canonical[j] == NULL)
+				continue;
+			if (strcmp(canonical[i], canonical[j]) == 0 ? j < i :
+					notify->recursive && _path_within(canonical[i], canonical[j]))
+				break;
+		}
+		if (j == size)
+			ouroboros_config_add_string(&notify->paths, dirs[i]);
+		else
+			debug("already watched: %s", dirs[i]);
+	}
+
+	for (i = 0; i < size; i++)
+		free(canonical[i]);
+	free(canonical);
+
+	if (_worker_start(notify) == -1)
+		return -1;
+
+	/* the initial snapshot of the poll type is taken with the first scan,
+	 * while inotify watches are registered one directory at a time */
+	if (notify->type == ONT_POLL) {
+		for (i = 0; notify->verbose && notify->paths != NULL && notify->paths[i] != NULL; i++)
+			fprintf(stderr, "Watching with poll engine: %s\n", notify->paths[i]);
+		return ouroboros_notify_scan(notify);
+	}
+
+	pthread_mutex_lock(&notify->worker.mutex);
+	notify->worker.roots = 1;
+	pthread_cond_signal(&notify->worker.cond);
+	pthread_mutex_unlock(&notify->worker.mutex);
+
+	return 0;
+}
+
+/* Get the file descriptor which becomes readable when there is an event to
+ * be dispatched with the ouroboros_notify_dispatch(). */
+int ouroboros_notify_fd(const struct ouroboros_notify *notify) {
+#if HAVE_SYS_INOTIFY_H
+	if (notify->type == ONT_INOTIFY)
+		return notify->s.inotify.efd;
+#endif
+	return notify->worker.fd;
+}
+
+#if HAVE_SYS_INOTIFY_H
+/* Internal function which gets the index of the given watch descriptor. If
+ * the descriptor is not known, -1 is returned. */
+static int _inotify_lookup(const struct ouroboros_notify_data_inotify *data, int wd) {
+	int i;
+	for (i = data->size; i--; )
+		if (data->watched[i].wd == wd)
+			break;
+	return i;
+}
+#endif /* HAVE_SYS_INOTIFY_H */
+
+/* Add given path into the set of watched paths at runtime. The path is
+ * canonicalized in the same way as in the ouroboros_notify_watch(), so the
+ * location which is already watched (e.g. via symbolic link, or within the
+ * watched tree in the recursive mode) is not added again. On success this
+ * function returns 0, otherwise -1 (e.g. path is already watched). */
+int ouroboros_notify_watch_add(struct ouroboros_notify *notify, const char *path) {
+
+	struct ouroboros_notify_worker *worker = &notify->worker;
+	char *canonical, *dir;
+	int exists = 0;
+	char **tmp;
+
+	if ((canonical = realpath(path, NULL)) == NULL)
+		return -1;
+
+	/* the list of watched paths is modified by the main thread only */
+	for (tmp = notify->paths; !exists && tmp != NULL && *tmp != NULL; tmp++) {
+		if ((dir = realpath(*tmp, NULL)) == NULL)
+			continue;
+		exists = strcmp(canonical, dir) == 0 ||
+			(notify->recursive && _path_within(canonical, dir));
+		free(dir);
+	}
+
+	free(canonical);
+
+	if (exists) {
+		debug("already watched: %s", path);
+		errno = EEXIST;
+		return -1;
+	}
+
+	pthread_mutex_lock(&worker->mutex);
+	ouroboros_config_add_string(&notify->paths, path);
+	/* new nodes are not modifications */
+	worker->rebase = 1;
+	pthread_mutex_unlock(&worker->mutex);
+
+	if (notify->type == ONT_POLL)
+		return ouroboros_notify_scan(notify);
+
+	_worker_queue(notify, path);
+	return 0;
+}
+
+/* Internal function which checks whether given paths overlap - one of them
+ * is located within the other one. Paths shall be canonical. */
+static int _path_overlaps(const char *a, const char *b) {
+	return strcmp(a, b) == 0 || _path_within(a, b) || _path_within(b, a);
+}
+
+/* Remove given path from the set of watched paths at runtime. The path is
+ * canonicalized in the same way as in the ouroboros_notify_watch_add(), so it
+ * does not have to be spelled in the same way as when it was added. Note,
+ * that nodes which are also reachable from other watched paths are still
+ * watched. On success this function returns 0, otherwise -1. */
+int ouroboros_notify_watch_remove(struct ouroboros_notify *notify, const char *path) {
+
+	struct ouroboros_notify_worker *worker = &notify->worker;
+	char *canonical, *dir;
+	char *removed = NULL;
+	char **tmp;
+	size_t len;
+
+	/* removed location might not exist anymore */
+	canonical = realpath(path, NULL);
+
+	/* the list of watched paths is modified by the main thread only */
+	for (tmp = notify->paths; removed == NULL && tmp != NULL && *tmp != NULL; tmp++) {
+		if (strcmp(*tmp, path) == 0)
+			removed = *tmp;
+		else if (canonical != NULL && (dir = realpath(*tmp, NULL)) != NULL) {
+			if (strcmp(canonical, dir) == 0)
+				removed = *tmp;
+			free(dir);
+		}
+	}
+
+	if (removed == NULL) {
+		free(canonical);
+		errno = ENOENT;
+		return -1;
+	}
+
+	pthread_mutex_lock(&worker->mutex);
+
+	for (tmp = notify->paths; *tmp != removed; tmp++)
+		continue;
+	/* move the rest of the list - including the terminator */
+	do
+		tmp[0] = tmp[1];
+	while (*tmp++ != NULL);
+
+	/* removed nodes are not modifications */
+	worker->rebase = 1;
+
+	/* polled subtrees within the removed path */
+	len = strlen(removed);
+	for (tmp = notify->polled; tmp != NULL && *tmp != NULL; )
+		if (strncmp(*tmp, removed, len) == 0 &&
+				((*tmp)[len] == '\0' || (*tmp)[len] == '/')) {
+			char **next = tmp;
+			free(*tmp);
+			do
+				next[0] = next[1];
+			while (*next++ != NULL);
+		}
+		else
+			tmp++;
+
+#if HAVE_SYS_INOTIFY_H
+	if (notify->type == ONT_INOTIFY) {
+		struct ouroboros_notify_data_inotify *data = &notify->s.inotify;
+		int i;
+		/* Remove watches of the path and its subdirectories. They are dropped
+		 * from the table right away, so the IN_IGNORED event which will be
+		 * generated for them will not be taken as the deletion. */
+		for (i = data->size; i--; )
+			if (strncmp(data->watched[i].path, removed, len) == 0 &&
+					(data->watched[i].path[len] == '\0' || data->watched[i].path[len] == '/')) {
+				inotify_rm_watch(data->fd, data->watched[i].wd);
+				free(data->watched[i].path);
+				data->watched[i] = data->watched[--data->size];
 			}
+	}
+#endif /* HAVE_SYS_INOTIFY_H */
+
+	pthread_mutex_unlock(&worker->mutex);
+
+	/* Watches are shared between overlapping paths (e.g. the directory and
+	 * the single file within it), so remaining paths which overlap with the
+	 * removed one are registered again - existing watches are reused. */
+	for (tmp = notify->paths; notify->type != ONT_POLL && tmp != NULL && *tmp != NULL; tmp++) {
+		int overlaps = 0;
+		if (canonical == NULL)
+			overlaps = _path_overlaps(removed, *tmp);
+		else if ((dir = realpath(*tmp, NULL)) != NULL) {
+			overlaps = _path_overlaps(canonical, dir);
+			free(dir);
 		}
-		break;
+		if (overlaps)
+			_worker_queue(notify, *tmp);
+	}
+
+	free(canonical);
+	free(removed);
+	return 0;
+}
+
+#if HAVE_SYS_INOTIFY_H
+/* Internal function which records the change, unless the same path has been
+ * recorded already. Newly created files are held until they are closed. */
+static void _inotify_change(struct ouroboros_notify *notify, const char *path, uint32_t mask) {
+
+	struct stat s;
+	int i;
+
+	if (notify->write_timeout > 0) {
+		i = _pending_lookup(notify, path);
+		if (mask & IN_CREATE && !(mask & IN_ISDIR) &&
+				lstat(path, &s) == 0 && S_ISREG(s.st_mode)) {
+			_pending_add(notify, path, &s, 1);
+			return;
+		}
+		if (i != -1) {
+			/* attributes might be changed while writing */
+			if (!(mask & (IN_CLOSE_WRITE | IN_MOVE | IN_DELETE)))
+				return;
+			_pending_remove(notify, i);
+		}
+	}
+
+	for (i = 0; i < notify->changes_size; i++)
+		if (strcmp(notify->changes[i], path) == 0)
+			return;
+	_add_change(&notify->changes, &notify->changes_size, path);
+}
+
+/* Internal function which handles single inotify event. Paths of matched
+ * nodes are stored in the changes array. */
+static void _inotify_event(struct ouroboros_notify *notify, const struct inotify_event *e) {
+
+	struct timespec ts;
+	char *tmp = NULL;
+	char **root;
+	int i;
+
+	debug("notify event: wd=%d, mask=%x, name=%s", e->wd, e->mask, e->len ? e->name : "");
+	trace_instant("event read", e->len ? e->name : NULL);
+
+	/* lost events are reported as an unknown change */
+	if (e->mask & IN_Q_OVERFLOW) {
+		fprintf(stderr, "warning: inotify queue overflow\n");
+		notify->overflows++;
+	}
+
+	/* watch descriptors table is shared with the worker */
+	pthread_mutex_lock(&notify->worker.mutex);
+
+	/* directory watched for the sake of single-file paths only */
+	if ((i = _inotify_lookup(&notify->s.inotify, e->wd)) != -1 &&
+			notify->s.inotify.watched[i].parent && !(e->mask & IN_IGNORED)) {
+
+		/* Parent directory has been taken verbatim from the watched path, so
+		 * joining them back gives the watched path - except the current
+		 * directory, which is used for paths without any slash. */
+		const char *dir = notify->s.inotify.watched[i].path;
+		size_t len = strlen(dir);
+		int bare = strcmp(dir, ".") == 0;
+
+		if (e->len) {
+			tmp = malloc(len + strlen(e->name) + 2);
+			sprintf(tmp, "%s%s%s", dir, dir[len - 1] == '/' ? "" : "/", e->name);
+		}
+
+		pthread_mutex_unlock(&notify->worker.mutex);
+
+		/* the list of watched paths is modified by the main thread only */
+		for (root = notify->paths; tmp != NULL && root != NULL && *root != NULL; root++)
+			if (strcmp(*root, tmp) == 0 || (bare && strcmp(*root, e->name) == 0))
+				break;
+
+		if (tmp != NULL && root != NULL && *root != NULL) {
+			/* file has been (re)created - re-arm its watch */
+			if (e->mask & (IN_CREATE | IN_MOVED_TO))
+				_worker_queue(notify, *root);
+			if (_check_patterns(notify, e->name))
+				_inotify_change(notify, *root, e->mask);
+		}
+
+		free(tmp);
+		return;
+	}
+
+	/* update new nodes - directory created, moved in or permission changed */
+	if (notify->update_nodes && e->mask & IN_ISDIR &&
+			e->mask & (IN_CREATE | IN_MOVED_TO | IN_ATTRIB)) {
+
+		/* get the index of watch descriptor from the current event */
+		if (i != -1) {
+			tmp = malloc(strlen(notify->s.inotify.watched[i].path) + strlen(e->name) + 2);
+			sprintf(tmp, "%s/%s", notify->s.inotify.watched[i].path, e->name);
+		}
+
+	}
+	/* delete node - it seems that the path has been deleted */
+	else if (e->mask & IN_IGNORED) {
+
+		/* watch removed on purpose is not in the table anymore */
+		if (i != -1) {
+			notify->s.inotify.size--;
+			free(notify->s.inotify.watched[i].path);
+			if (notify->s.inotify.size)
+				memcpy(&notify->s.inotify.watched[i],
+						&notify->s.inotify.watched[notify->s.inotify.size],
+						sizeof(*notify->s.inotify.watched));
+		}
+
+		/* removal of the node itself has been already reported - either via
+		 * its parent directory or via the attribute change of the node */
+		pthread_mutex_unlock(&notify->worker.mutex);
+		return;
+
+	}
+
+	pthread_mutex_unlock(&notify->worker.mutex);
+
+	/* new directory (possibly with a whole tree) is scanned in the
+	 * background - the worker takes the lock by itself */
+	if (tmp != NULL) {
+		_worker_queue(notify, tmp);
+		free(tmp);
+	}
+
+	trace_mark(&ts);
+	i = _check_patterns(notify, e->len ? e->name : "");
+	trace_span("pattern match", &ts, e->len ? e->name : NULL);
+	if (!i)
+		return;
+
+	pthread_mutex_lock(&notify->worker.mutex);
+
+	/* get the index of watch descriptor from the current event */
+	i = _inotify_lookup(&notify->s.inotify, e->wd);
+
+	if (i == -1) {
+		/* events of the removed watch are not associated with any path -
+		 * except the queue overflow, which is reported as unknown change */
+		if (e->mask & IN_Q_OVERFLOW)
+			_inotify_change(notify, "", e->mask);
+	}
+	else if (e->len == 0)
+		_inotify_change(notify, notify->s.inotify.watched[i].path, e->mask);
+	else {
+		tmp = malloc(strlen(notify->s.inotify.watched[i].path) + strlen(e->name) + 2);
+		sprintf(tmp, "%s/%s", notify->s.inotify.watched[i].path, e->name);
+		_inotify_change(notify, tmp, e->mask);
+		free(tmp);
+	}
+
+	pthread_mutex_unlock(&notify->worker.mutex);
+}
+#endif /* HAVE_SYS_INOTIFY_H */
+
+/* Inject changes reported by the remote agent, e.g. when the tree is shared
+ * with a VM and local events are not generated at all. Relative paths are
+ * resolved against the first watched path, and injected paths are filtered
+ * with the same patterns as local events ("." denotes the watched path
+ * itself). If any path has matched, then this
+ * function returns 1 and matched paths are stored in the changes array. */
+int ouroboros_notify_inject(struct ouroboros_notify *notify, char **paths) {
+
+	const char *name;
+	char *tmp;
+
+	_clear_changes(notify->changes, &notify->changes_size);
+
+	/* the list of watched paths is modified by the main thread only */
+	for (; paths != NULL && *paths != NULL; paths++) {
+
+		name = strrchr(*paths, '/');
+		if (!_check_patterns(notify, name != NULL ? name + 1 : *paths))
+			continue;
+
+		if (**paths == '/' || notify->paths == NULL || notify->paths[0] == NULL) {
+			_add_change(&notify->changes, &notify->changes_size, *paths);
+			continue;
+		}
+
+		if (strcmp(*paths, ".") == 0) {
+			_add_change(&notify->changes, &notify->changes_size, notify->paths[0]);
+			continue;
+		}
+
+		tmp = malloc(strlen(notify->paths[0]) + strlen(*paths) + 2);
+		sprintf(tmp, "%s/%s", notify->paths[0], *paths);
+		_add_change(&notify->changes, &notify->changes_size, tmp);
+		free(tmp);
+	}
+
+	return _verify_changes(notify);
+}
+
+/* Internal function which takes over changes detected by the worker. */
+static void _worker_changes(struct ouroboros_notify *notify) {
+
+	struct ouroboros_notify_worker *worker = &notify->worker;
+	uint64_t value;
+
+	if (read(worker->fd, &value, sizeof(value)) == -1)
+		return;
+
+	pthread_mutex_lock(&worker->mutex);
+	free(notify->changes);
+	notify->changes = worker->changes;
+	notify->changes_size = worker->changes_size;
+	worker->changes = NULL;
+	worker->changes_size = 0;
+	pthread_mutex_unlock(&worker->mutex);
+
+	if (notify->changes_size > 0)
+		trace_instant("event read", notify->changes[0]);
+	_settle_changes(notify);
+
+}
+
+/* Dispatch notification event and optionally add new directories into the
+ * monitoring subsystem. If current event matches given patterns, then this
+ * function returns 1 and paths of matched nodes are stored in the changes
+ * array. Upon error this function returns -1. */
+int ouroboros_notify_dispatch(struct ouroboros_notify *notify) {
+	debug("dispatch");
+
+	_clear_changes(notify->changes, &notify->changes_size);
+
+	switch (notify->type) {
+	case ONT_POLL:
+		_worker_changes(notify);
+		return _verify_changes(notify);
 #if HAVE_SYS_INOTIFY_H
 	case ONT_INOTIFY:
 		{
-			char buffer[sizeof(struct inotify_event) + NAME_MAX + 1];
-			struct inotify_event *e = (struct inotify_event *)buffer;
+			/* single read returns as many events as fit in the buffer */
+			char buffer[16 * (sizeof(struct inotify_event) + NAME_MAX + 1)]
+				__attribute__((aligned(__alignof__(struct inotify_event))));
+			const struct inotify_event *e;
 			ssize_t rlen;
-			int i;
+			char *ptr;
 
-			rlen = read(notify->s.inotify.fd, e, sizeof(buffer));
+			/* changes of polled subtrees (if any) come first */
+			_worker_changes(notify);
+
+			rlen = read(notify->s.inotify.fd, buffer, sizeof(buffer));
+			if (rlen == -1 && errno == EAGAIN)
+				return _verify_changes(notify);
 
 			/* we need to read at least the size of the inotify event structure */
 			if (rlen < (signed)sizeof(struct inotify_event)) {
@@ -457,44 +1568,105 @@ int ouroboros_notify_dispatch(struct ouroboros_notify *notify) {
 				return -1;
 			}
 
-			debug("notify event: wd=%d, mask=%x, name=%s", e->wd, e->mask, e->name);
+			/* All events of the batch are merged into the single notification,
+			 * so the write-and-rename save (which generates a couple of events)
+			 * yields one change of the target file. */
+			for (ptr = buffer; ptr < buffer + rlen; ptr += sizeof(*e) + e->len) {
+				e = (const struct inotify_event *)ptr;
+				_inotify_event(notify, e);
+			}
 
-			/* update new nodes - directory created or permission changed */
-			if (notify->update_nodes && e->mask & IN_ISDIR && e->mask & (IN_CREATE | IN_ATTRIB)) {
+			return _verify_changes(notify);
+		}
+		break;
+#endif /* HAVE_SYS_INOTIFY_H */
+	}
 
-				/* get the index of watch descriptor from the current event */
-				i = notify->s.inotify.size;
-				while (i && notify->s.inotify.watched[--i].wd != e->wd)
-					continue;
+	return 0;
+}
 
-				char *tmp = malloc(strlen(notify->s.inotify.watched[i].path) + strlen(e->name) + 2);
-				sprintf(tmp, "%s/%s", notify->s.inotify.watched[i].path, e->name);
-				ouroboros_notify_watch_path(notify, tmp);
-				free(tmp);
+/* Check files which are being written. Changes of files which have been
+ * written completely - the file has been closed, or it has not changed since
+ * the last check - are released. Changes are released also when the write
+ * timeout expires. If any change has been released, this function returns 1
+ * and paths are stored in the changes array. */
+int ouroboros_notify_settle(struct ouroboros_notify *notify) {
 
-			}
-			/* delete node - it seems that the path has been deleted */
-			else if (e->mask & IN_IGNORED) {
+	struct ouroboros_notify_pending *p;
+	struct stat s;
+	int done;
+	int i;
 
-				/* get the index of watch descriptor from the current event */
-				i = notify->s.inotify.size;
-				while (i && notify->s.inotify.watched[--i].wd != e->wd)
-					continue;
+	_clear_changes(notify->changes, &notify->changes_size);
+
+	for (i = notify->pending_size; i--; ) {
+		p = &notify->pending[i];
+
+		/* removed file will not be written anymore */
+		if (lstat(p->path, &s) == -1)
+			done = 1;
+		/* file has not changed between two samples */
+		else if (!p->open && s.st_size == p->size &&
+				s.st_mtim.tv_sec == p->mtime.tv_sec &&
+				s.st_mtim.tv_nsec == p->mtime.tv_nsec)
+			/* samples have to be taken the interval apart */
+			done = ouroboros_metrics_since(&p->sampled) >= OUROBOROS_NOTIFY_SETTLE_INTERVAL;
+		else if ((done = ouroboros_metrics_since(&p->since) >= notify->write_timeout))
+			fprintf(stderr, "warning: write not completed in %.2f s: %s\n",
+					notify->write_timeout, p->path);
+		else {
+			p->size = s.st_size;
+			p->mtime = s.st_mtim;
+			clock_gettime(CLOCK_MONOTONIC, &p->sampled);
+		}
 
-				notify->s.inotify.size--;
-				free(notify->s.inotify.watched[i].path);
-				if (notify->s.inotify.size)
-					memcpy(&notify->s.inotify.watched[i],
-							&notify->s.inotify.watched[notify->s.inotify.size],
-							sizeof(*notify->s.inotify.watched));
+		if (done) {
+			_add_change(&notify->changes, &notify->changes_size, p->path);
+			_pending_remove(notify, i);
+		}
+	}
 
-			}
+	return _verify_changes(notify);
+}
 
-			return _check_patterns(notify, e->name);
-		}
-		break;
-#endif /* HAVE_SYS_INOTIFY_H */
+/* Get statistics of the monitoring subsystem. */
+void ouroboros_notify_stats(struct ouroboros_notify *notify, struct ouroboros_notify_stats *stats) {
+
+	pthread_mutex_lock(&notify->worker.mutex);
+
+	stats->watched = notify->worker.watched;
+#if HAVE_SYS_INOTIFY_H
+	if (notify->type == ONT_INOTIFY)
+		stats->watched += notify->s.inotify.size;
+#endif
+	for (stats->polled = 0; notify->polled != NULL && notify->polled[stats->polled] != NULL; )
+		stats->polled++;
+	stats->overflows = notify->overflows;
+	stats->unchanged = notify->unchanged;
+	stats->scans = notify->worker.scans;
+
+	pthread_mutex_unlock(&notify->worker.mutex);
+
+}
+
+/* Get the name of the notification engine which is used for the given
+ * watched path. Paths on network file systems are polled regardless of the
+ * configured notification type. */
+const char *ouroboros_notify_engine(struct ouroboros_notify *notify, const char *path) {
+
+	const char *engine = "poll";
+
+#if HAVE_SYS_INOTIFY_H
+	if (notify->type == ONT_INOTIFY) {
+		char **tmp;
+		engine = "inotify";
+		pthread_mutex_lock(&notify->worker.mutex);
+		for (tmp = notify->polled; tmp != NULL && *tmp != NULL; tmp++)
+			if (strcmp(*tmp, path) == 0)
+				engine = "poll";
+		pthread_mutex_unlock(&notify->worker.mutex);
 	}
+#endif
 
-	return 0;
+	return engine;
 }
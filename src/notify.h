@@ -15,8 +15,13 @@
 #include "../config.h"
 #endif
 
+#include <pthread.h>
 #include <regex.h>
 #include <time.h>
+#include <sys/types.h>
+
+#include "digest.h"
+#include "metrics.h"
 
 
 /* available notification types (might be OS specific) */
@@ -28,6 +33,10 @@ enum ouroboros_notify_type {
 };
 
 
+/* interval (in seconds) between samples of files which are being written */
+#define OUROBOROS_NOTIFY_SETTLE_INTERVAL 0.25
+
+
 /* data structure definition for ERE patterns */
 struct ouroboros_notify_patterns {
 	regex_t *regex;
@@ -35,28 +44,104 @@ struct ouroboros_notify_patterns {
 };
 
 
+struct ouroboros_notify_poll_node {
+	struct timespec mtime;
+	char *path;
+};
+
 struct ouroboros_notify_data_poll {
 	/* internal filenames tracking */
-	struct {
-		struct timespec mtime;
-		char *path;
-	} *watched;
+	struct ouroboros_notify_poll_node *watched;
 	int size;
+	/* the initial snapshot has been taken */
+	int scanned;
 };
 
 
 struct ouroboros_notify_data_inotify {
 	/* inotify file descriptor */
 	int fd;
+	/* epoll set of inotify and worker descriptors */
+	int efd;
 	/* internal filenames tracking */
 	struct {
 		int wd;
 		char *path;
+		/* directory watched only for single-file paths within it */
+		int parent;
 	} *watched;
 	int size;
 };
 
 
+/* set of file system nodes visited during the single scan */
+struct ouroboros_notify_visited_node {
+	dev_t dev;
+	ino_t ino;
+};
+
+struct ouroboros_notify_visited {
+	/* open addressing hash table - inode 0 marks an empty slot */
+	struct ouroboros_notify_visited_node *nodes;
+	size_t size;
+	size_t used;
+};
+
+
+/* file which has changed, but it might not have been written completely */
+struct ouroboros_notify_pending {
+	char *path;
+	/* the last sample of the file metadata */
+	off_t size;
+	struct timespec mtime;
+	struct timespec sampled;
+	/* file has been created, completion will be reported by IN_CLOSE_WRITE */
+	int open;
+	struct timespec since;
+};
+
+
+/* monitoring subsystem statistics */
+struct ouroboros_notify_stats {
+	int watched;
+	int polled;
+	unsigned long long overflows;
+	unsigned long long unchanged;
+	struct ouroboros_metrics_histogram scans;
+};
+
+/* background scanning of the watched tree */
+struct ouroboros_notify_worker {
+
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int running;
+
+	/* eventfd signaling that scan results are ready */
+	int fd;
+
+	/* paths which shall be added to the monitoring subsystem */
+	char **queue;
+	int queue_size;
+	/* watched paths shall be added at once, with the shared set of visited
+	 * directories, so the tree reachable via many paths is walked once */
+	int roots;
+	/* full scan has been requested */
+	int scan;
+	/* watched paths have changed - the next scan is a new baseline */
+	int rebase;
+
+	/* changes detected by the worker, not dispatched yet */
+	char **changes;
+	int changes_size;
+
+	/* duration of scans and the number of nodes watched by poll type */
+	struct ouroboros_metrics_histogram scans;
+	int watched;
+
+};
+
 struct ouroboros_notify {
 
 	/* configured notification type */
@@ -67,16 +152,50 @@ struct ouroboros_notify {
 	int update_nodes;
 	int dirs_only;
 	int files_only;
+	int verify_content;
+	int remote_poll;
+	int follow_symlinks;
+	/* report the engine used for every watched path */
+	int verbose;
 
 	/* compiled ERE patterns */
 	struct ouroboros_notify_patterns include;
 	struct ouroboros_notify_patterns exclude;
+	/* temporary files of editors (or empty) */
+	struct ouroboros_notify_patterns temp;
 
 	/* watched paths - entry points */
 	char **paths;
-
-	/* data storage for configured type */
-	union {
+	/* subtrees on network file systems - polled regardless of the type */
+	char **polled;
+
+	/* paths which have triggered the last notification */
+	char **changes;
+	int changes_size;
+
+	/* events lost due to the queue overflow */
+	unsigned long long overflows;
+
+	/* Content digests of changed files. Editors and build tools often touch
+	 * files without changing them, so such changes are dropped. */
+	struct ouroboros_digest digest;
+	unsigned long long unchanged;
+
+	/* Changes of files which are being written are held until the write is
+	 * completed (or the timeout expires), so the process will not be started
+	 * with a partially written file. */
+	double write_timeout;
+	struct ouroboros_notify_pending *pending;
+	int pending_size;
+
+	/* Scanning is done in the background, so the main loop does not block
+	 * on the file system I/O. Note, that the watch descriptors table of the
+	 * inotify type is shared with the worker and guarded by its mutex. */
+	struct ouroboros_notify_worker worker;
+
+	/* data storage for configured type - poll type data is used by other
+	 * types for subtrees on which they can not be used */
+	struct {
 		struct ouroboros_notify_data_poll poll;
 #if HAVE_SYS_INOTIFY_H
 		struct ouroboros_notify_data_inotify inotify;
@@ -86,6 +205,10 @@ struct ouroboros_notify {
 };
 
 
+int ouroboros_notify_patterns_compile(struct ouroboros_notify_patterns *patterns, char **values);
+void ouroboros_notify_patterns_free(struct ouroboros_notify_patterns *patterns);
+int ouroboros_notify_patterns_match(const struct ouroboros_notify_patterns *patterns, const char *name);
+
 struct ouroboros_notify *ouroboros_notify_init(enum ouroboros_notify_type type);
 void ouroboros_notify_free(struct ouroboros_notify *notify);
 
@@ -93,12 +216,26 @@ int ouroboros_notify_recursive(struct ouroboros_notify *notify, int value);
 int ouroboros_notify_update_nodes(struct ouroboros_notify *notify, int value);
 int ouroboros_notify_dirs_only(struct ouroboros_notify *notify, int value);
 int ouroboros_notify_files_only(struct ouroboros_notify *notify, int value);
+int ouroboros_notify_verify_content(struct ouroboros_notify *notify, int value);
+int ouroboros_notify_ignore_temp(struct ouroboros_notify *notify, int value);
+int ouroboros_notify_remote_poll(struct ouroboros_notify *notify, int value);
+int ouroboros_notify_follow_symlinks(struct ouroboros_notify *notify, int value);
+int ouroboros_notify_verbose(struct ouroboros_notify *notify, int value);
+double ouroboros_notify_write_timeout(struct ouroboros_notify *notify, double value);
 int ouroboros_notify_include_patterns(struct ouroboros_notify *notify, char **values);
 int ouroboros_notify_exclude_patterns(struct ouroboros_notify *notify, char **values);
 
 int ouroboros_notify_watch(struct ouroboros_notify *notify, char **dirs);
 int ouroboros_notify_watch_path(struct ouroboros_notify *notify, const char *path);
+int ouroboros_notify_watch_add(struct ouroboros_notify *notify, const char *path);
+int ouroboros_notify_watch_remove(struct ouroboros_notify *notify, const char *path);
+int ouroboros_notify_scan(struct ouroboros_notify *notify);
 
+int ouroboros_notify_fd(const struct ouroboros_notify *notify);
 int ouroboros_notify_dispatch(struct ouroboros_notify *notify);
+int ouroboros_notify_inject(struct ouroboros_notify *notify, char **paths);
+int ouroboros_notify_settle(struct ouroboros_notify *notify);
+void ouroboros_notify_stats(struct ouroboros_notify *notify, struct ouroboros_notify_stats *stats);
+const char *ouroboros_notify_engine(struct ouroboros_notify *notify, const char *path);
 
 #endif
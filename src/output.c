@@ -0,0 +1,747 @@
+/*
+ * ouroboros - output.c
+ * Copyright (c) 2015 Arkadiusz Bokowy
+ *
+ * This file is a part of a ouroboros.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+#define _GNU_SOURCE
+#include "output.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "debug.h"
+
+
+/* the maximum amount of data moved by a single transfer */
+#define OUTPUT_CHUNK_SIZE (64 * 1024)
+/* the maximum length of the timestamp prefix */
+#define OUTPUT_PREFIX_SIZE 32
+/* time given to the writer for flushing remaining data (in ms) */
+#define OUTPUT_FLUSH_TIMEOUT 1000
+
+
+/* Internal function which checks whether data can be moved into the given
+ * descriptor with the splice(). Terminals do not support it, and for other
+ * character devices we do not want to take chances. */
+static int _splice_capable(int fd) {
+	struct stat st;
+	if (fstat(fd, &st) == -1)
+		return 0;
+	return S_ISREG(st.st_mode) || S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode);
+}
+
+/* Internal function which opens (or creates) the log file. The file is not
+ * opened in the append mode, because the splice() refuses to work with such
+ * files. However, we are the only writer, so seeking to the end is enough. */
+static int _output_open(struct ouroboros_output *output) {
+
+	if ((output->fd = open(output->path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644)) == -1) {
+		perror("warning: unable to open output file");
+		return -1;
+	}
+
+	if ((output->size = lseek(output->fd, 0, SEEK_END)) == -1)
+		output->size = 0;
+	output->fd_splice = _splice_capable(output->fd);
+
+	return 0;
+}
+
+/* Internal function which rotates the log file, if it has reached the size
+ * limit. Rotated files are suffixed with consecutive numbers, where 1 denotes
+ * the most recent one. If the number of kept files is zero, then the log
+ * file is simply truncated. */
+static void _output_rotate(struct ouroboros_output *output) {
+
+	char *src, *dst;
+	int i;
+
+	if (output->fd == -1 || output->rotate_size <= 0 ||
+			output->size < output->rotate_size)
+		return;
+
+	debug("rotating output: path=%s, size=%jd", output->path, (intmax_t)output->size);
+
+	if (output->rotate_count <= 0) {
+		if (ftruncate(output->fd, 0) == -1)
+			perror("warning: unable to truncate output file");
+		lseek(output->fd, 0, SEEK_SET);
+		output->size = 0;
+		return;
+	}
+
+	for (i = output->rotate_count; i > 0; i--) {
+		if (i == 1)
+			src = strdup(output->path);
+		else if (asprintf(&src, "%s.%d", output->path, i - 1) == -1)
+			src = NULL;
+		if (asprintf(&dst, "%s.%d", output->path, i) == -1)
+			dst = NULL;
+		if (src != NULL && dst != NULL)
+			rename(src, dst);
+		free(src);
+		free(dst);
+	}
+
+	close(output->fd);
+	_output_open(output);
+}
+
+/* Internal function which writes the whole buffer into the given descriptor.
+ * Upon error this function returns -1. */
+static int _write_all(int fd, const char *buffer, size_t len) {
+
+	ssize_t rv;
+
+	while (len > 0) {
+		if ((rv = write(fd, buffer, len)) == -1) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buffer += rv;
+		len -= rv;
+	}
+
+	return 0;
+}
+
+/* Internal function which moves exactly len bytes from the pipe into the
+ * given destination. If the destination does not support the splice(), data
+ * is copied through the user-space buffer. Upon error this function returns
+ * -1, however the data is consumed from the pipe anyway. */
+static int _transfer_all(int pipefd, int fd, int splice_capable, size_t len) {
+
+	char buffer[OUTPUT_CHUNK_SIZE];
+	ssize_t rv;
+	int err = 0;
+
+	while (len > 0) {
+
+		if (fd != -1 && splice_capable && !err)
+			rv = splice(pipefd, NULL, fd, NULL, len, SPLICE_F_MOVE);
+		else {
+			rv = read(pipefd, buffer, len < sizeof(buffer) ? len : sizeof(buffer));
+			if (rv > 0 && fd != -1 && !err && _write_all(fd, buffer, rv) == -1)
+				err = 1;
+		}
+
+		if (rv == -1) {
+			if (errno == EINTR)
+				continue;
+			if (fd != -1 && splice_capable && !err) {
+				/* destination has failed - drop remaining data */
+				err = 1;
+				continue;
+			}
+			return -1;
+		}
+		if (rv == 0)
+			break;
+
+		len -= rv;
+	}
+
+	return err ? -1 : 0;
+}
+
+/* Internal function which disables destination which has failed. */
+static void _output_disable(int *fd, const char *name) {
+	fprintf(stderr, "warning: unable to write %s: %s\n", name, strerror(errno));
+	close(*fd);
+	*fd = -1;
+}
+
+/* Internal function which relays data from the capture pipe to destinations
+ * without copying it into the user-space. In case of two destinations, data
+ * is duplicated with the tee() - it does not consume data from the source
+ * pipe, so it can be spliced into the log file afterwards. This function
+ * returns the number of relayed bytes, 0 upon EOF or -1 upon error. */
+static ssize_t _output_relay(struct ouroboros_output *output) {
+
+	int fd = output->fd;
+	int splice_capable = output->fd_splice;
+	ssize_t len;
+
+	if (output->fd != -1 && output->tty != -1) {
+
+		if ((len = tee(output->pipe[0], output->tpipe[1], OUTPUT_CHUNK_SIZE, 0)) <= 0)
+			return len;
+
+		if (_transfer_all(output->pipe[0], output->fd, output->fd_splice, len) == -1)
+			_output_disable(&output->fd, "output file");
+		else
+			output->size += len;
+		if (_transfer_all(output->tpipe[0], output->tty, output->tty_splice, len) == -1)
+			_output_disable(&output->tty, "output to terminal");
+
+		_output_rotate(output);
+		return len;
+	}
+
+	if (fd == -1) {
+		fd = output->tty;
+		splice_capable = output->tty_splice;
+	}
+
+	if (fd != -1 && splice_capable)
+		len = splice(output->pipe[0], NULL, fd, NULL, OUTPUT_CHUNK_SIZE, SPLICE_F_MOVE);
+	else {
+		char buffer[OUTPUT_CHUNK_SIZE];
+		if ((len = read(output->pipe[0], buffer, sizeof(buffer))) > 0 &&
+				fd != -1 && _write_all(fd, buffer, len) == -1)
+			len = -2;
+	}
+
+	if (len == -1 && errno != EINTR && fd != -1)
+		/* pipe can not fail, so the destination has failed */
+		len = -2;
+	if (len == -2) {
+		_output_disable(fd == output->fd ? &output->fd : &output->tty,
+				fd == output->fd ? "output file" : "output to terminal");
+		return 1;
+	}
+
+	if (len > 0 && fd == output->fd) {
+		output->size += len;
+		_output_rotate(output);
+	}
+
+	return len;
+}
+
+/* Internal function which appends data to the in-memory ring buffer. There
+ * is only one writer (the background thread), and readers do not block it.
+ * Instead, the range which is about to be overwritten is reserved before the
+ * copy, so readers can detect and drop data overwritten during a snapshot. */
+static void _ring_write(struct ouroboros_output_ring *ring, const char *buffer, size_t len) {
+
+	uint64_t head = ring->head;
+	size_t offset, size;
+
+	/* only the tail of the oversized data can be stored */
+	if (len > ring->size) {
+		head += len - ring->size;
+		buffer += len - ring->size;
+		len = ring->size;
+	}
+
+	__atomic_store_n(&ring->reserved, head + len, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	offset = head % ring->size;
+	size = len < ring->size - offset ? len : ring->size - offset;
+	memcpy(&ring->data[offset], buffer, size);
+	memcpy(ring->data, &buffer[size], len - size);
+
+	__atomic_store_n(&ring->head, head + len, __ATOMIC_RELEASE);
+}
+
+/* Internal function which writes decorated data into all destinations. */
+static void _output_write(struct ouroboros_output *output, const char *buffer, size_t len) {
+
+	if (output->ring.size)
+		_ring_write(&output->ring, buffer, len);
+
+	if (output->fd != -1) {
+		if (_write_all(output->fd, buffer, len) == -1)
+			_output_disable(&output->fd, "output file");
+		else
+			output->size += len;
+	}
+
+	if (output->tty != -1)
+		if (_write_all(output->tty, buffer, len) == -1)
+			_output_disable(&output->tty, "output to terminal");
+
+	_output_rotate(output);
+}
+
+/* Internal function which matches complete lines against the pattern. Lines
+ * longer than the line buffer are truncated. */
+static void _output_match(struct ouroboros_output *output, const char *buffer, size_t len) {
+
+	const uint64_t one = 1;
+	size_t i, size;
+	char *eol;
+
+	for (i = 0; i < len; i += size) {
+
+		if ((eol = memchr(&buffer[i], '\n', len - i)) != NULL)
+			size = eol - &buffer[i] + 1;
+		else
+			size = len - i;
+
+		if (output->line_len + size < sizeof(output->line)) {
+			memcpy(&output->line[output->line_len], &buffer[i], size);
+			output->line_len += size;
+		}
+
+		if (eol == NULL)
+			break;
+
+		/* strip the line terminator, so the pattern can be anchored */
+		if (output->line_len > 0 && output->line[output->line_len - 1] == '\n')
+			output->line_len--;
+		output->line[output->line_len] = '\0';
+		output->line_len = 0;
+
+		if (__atomic_load_n(&output->armed, __ATOMIC_ACQUIRE) &&
+				regexec(&output->pattern, output->line, 0, NULL, 0) == 0) {
+			debug("output pattern matched: %s", output->line);
+			__atomic_store_n(&output->armed, 0, __ATOMIC_RELEASE);
+			if (write(output->efd, &one, sizeof(one)) == -1)
+				debug("unable to signal pattern match: %s", strerror(errno));
+		}
+
+	}
+
+}
+
+/* Internal function which copies captured data through the user-space, so
+ * it can be stored in the ring buffer and every line can be prefixed with the
+ * monotonic timestamp. In such a case the zero-copy relay can not be used.
+ * This function returns the number of read bytes, 0 upon EOF or -1 upon
+ * error. */
+static ssize_t _output_decorate(struct ouroboros_output *output) {
+
+	char buffer[OUTPUT_CHUNK_SIZE];
+	char stage[OUTPUT_CHUNK_SIZE + OUTPUT_PREFIX_SIZE];
+	struct timespec now;
+	size_t staged = 0;
+	ssize_t len, i;
+	char *eol;
+
+	if ((len = read(output->pipe[0], buffer, sizeof(buffer))) <= 0)
+		return len;
+
+	if (output->pattern_set)
+		_output_match(output, buffer, len);
+
+	if (!output->timestamps) {
+		_output_write(output, buffer, len);
+		return len;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	for (i = 0; i < len; ) {
+
+		size_t size;
+
+		if ((eol = memchr(&buffer[i], '\n', len - i)) != NULL)
+			size = eol - &buffer[i] + 1;
+		else
+			size = len - i;
+
+		if (staged + OUTPUT_PREFIX_SIZE + size > sizeof(stage)) {
+			_output_write(output, stage, staged);
+			staged = 0;
+		}
+
+		if (output->bol)
+			staged += snprintf(&stage[staged], OUTPUT_PREFIX_SIZE, "[%5ld.%06ld] ",
+					(long)now.tv_sec, now.tv_nsec / 1000);
+
+		memcpy(&stage[staged], &buffer[i], size);
+		staged += size;
+		output->bol = eol != NULL;
+		i += size;
+
+	}
+
+	_output_write(output, stage, staged);
+	return len;
+}
+
+/* Internal function which is the main loop of the background writer. It
+ * runs until all writers close the capture pipe. */
+static void *_output_thread(void *arg) {
+
+	struct ouroboros_output *output = arg;
+	ssize_t rv;
+
+	do
+		if (output->timestamps || output->ring.size || output->pattern_set)
+			rv = _output_decorate(output);
+		else
+			rv = _output_relay(output);
+	while (rv > 0 || (rv == -1 && errno == EINTR));
+
+	if (rv == -1)
+		perror("error: output capture failed");
+
+	debug("output capture finished");
+	return NULL;
+}
+
+/* Open the output file, so it can be used by the process directly - without
+ * the capture. It shall be used when the output is not decorated in any way,
+ * because the data does not have to be copied then. Upon error this function
+ * returns -1. */
+int ouroboros_output_open(const char *path) {
+	int fd;
+	/* the log file is not truncated upon every restart */
+	if ((fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644)) == -1)
+		perror("error: unable to open output file");
+	return fd;
+}
+
+/* Initialize output capture. If the path is given, captured data is written
+ * into the log file, otherwise or if the tty is true it is written to our
+ * standard output. This function returns pointer to the initialized output
+ * structure or NULL upon error. */
+struct ouroboros_output *ouroboros_output_init(const char *path, int tty) {
+
+	struct ouroboros_output *output;
+
+	if ((output = malloc(sizeof(struct ouroboros_output))) == NULL)
+		return NULL;
+
+	output->pipe[0] = output->pipe[1] = -1;
+	output->tpipe[0] = output->tpipe[1] = -1;
+	output->path = NULL;
+	output->fd = -1;
+	output->tty = -1;
+	output->size = 0;
+	output->rotate_size = 0;
+	output->rotate_count = 0;
+	output->timestamps = 0;
+	output->markers = 0;
+	output->generation = 0;
+	output->bol = 1;
+	output->running = 0;
+
+	output->ring.data = NULL;
+	output->ring.size = 0;
+	output->ring.fd = -1;
+	output->ring.head = 0;
+	output->ring.reserved = 0;
+
+	output->pattern_set = 0;
+	output->armed = 0;
+	output->efd = -1;
+	output->line_len = 0;
+
+	if (pipe2(output->pipe, O_CLOEXEC) == -1 ||
+			pipe2(output->tpipe, O_CLOEXEC) == -1) {
+		perror("error: unable to create output pipe");
+		goto fail;
+	}
+
+	/* The bigger capture pipe is, the longer the process can write without
+	 * being blocked by a slow destination. It is not an error if we are not
+	 * allowed to enlarge it, though. */
+	if (fcntl(output->pipe[0], F_SETPIPE_SZ, OUROBOROS_OUTPUT_PIPE_SIZE) == -1 ||
+			fcntl(output->tpipe[0], F_SETPIPE_SZ, OUROBOROS_OUTPUT_PIPE_SIZE) == -1)
+		debug("unable to resize output pipe: %s", strerror(errno));
+
+	if (path != NULL) {
+		output->path = strdup(path);
+		if (_output_open(output) == -1)
+			goto fail;
+	}
+
+	if (path == NULL || tty) {
+		if ((output->tty = fcntl(fileno(stdout), F_DUPFD_CLOEXEC, 0)) == -1) {
+			perror("error: unable to duplicate standard output");
+			goto fail;
+		}
+		output->tty_splice = _splice_capable(output->tty);
+	}
+
+	return output;
+
+fail:
+	ouroboros_output_free(output);
+	return NULL;
+}
+
+/* Free allocated resources. The background writer is given a chance to
+ * write all remaining data, unless some other process holds the capture
+ * pipe (e.g. a daemonized child of the supervised process). */
+void ouroboros_output_free(struct ouroboros_output *output) {
+
+	if (output->pipe[1] != -1)
+		close(output->pipe[1]);
+
+	if (output->running) {
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += OUTPUT_FLUSH_TIMEOUT / 1000;
+		ts.tv_nsec += (OUTPUT_FLUSH_TIMEOUT % 1000) * 1000000;
+		if (ts.tv_nsec >= 1000000000) {
+			ts.tv_nsec -= 1000000000;
+			ts.tv_sec++;
+		}
+		if (pthread_timedjoin_np(output->thread, NULL, &ts) != 0) {
+			pthread_cancel(output->thread);
+			pthread_join(output->thread, NULL);
+		}
+	}
+
+	if (output->pipe[0] != -1)
+		close(output->pipe[0]);
+	if (output->tpipe[0] != -1)
+		close(output->tpipe[0]);
+	if (output->tpipe[1] != -1)
+		close(output->tpipe[1]);
+	if (output->fd != -1)
+		close(output->fd);
+	if (output->tty != -1)
+		close(output->tty);
+
+	if (output->ring.data != NULL)
+		munmap(output->ring.data, output->ring.size);
+	if (output->ring.fd != -1)
+		close(output->ring.fd);
+
+	if (output->pattern_set)
+		regfree(&output->pattern);
+	if (output->efd != -1)
+		close(output->efd);
+
+	free(output->path);
+	free(output);
+}
+
+/* Enable or disable monotonic timestamp prefix for every captured line. This
+ * function returns previous value. */
+int ouroboros_output_timestamps(struct ouroboros_output *output, int value) {
+	int tmp = output->timestamps;
+	output->timestamps = value;
+	return tmp;
+}
+
+/* Enable or disable generation marker written before every process start.
+ * This function returns previous value. */
+int ouroboros_output_markers(struct ouroboros_output *output, int value) {
+	int tmp = output->markers;
+	output->markers = value;
+	return tmp;
+}
+
+/* Set the log file size (in bytes) at which it is rotated, and the number of
+ * rotated files which should be kept. Size 0 disables rotation. */
+void ouroboros_output_rotate(struct ouroboros_output *output, off_t size, int count) {
+	output->rotate_size = size;
+	output->rotate_count = count;
+}
+
+/* Keep the given amount of the most recent output (in bytes) in memory, so
+ * it can be dumped when needed. If possible, the buffer is backed by the
+ * memfd, so it can be inspected via /proc/<pid>/fd even if we are stuck. This
+ * function shall be called before the background writer is started. On
+ * success this function returns 0, otherwise -1. */
+int ouroboros_output_buffer(struct ouroboros_output *output, size_t size) {
+
+	struct ouroboros_output_ring *ring = &output->ring;
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+	void *data;
+
+	if (size == 0)
+		return 0;
+
+#ifdef MFD_CLOEXEC
+	if ((ring->fd = memfd_create("ouroboros-output", MFD_CLOEXEC)) != -1) {
+		if (ftruncate(ring->fd, size) == -1) {
+			close(ring->fd);
+			ring->fd = -1;
+		}
+		else
+			flags = MAP_SHARED;
+	}
+#endif
+
+	data = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, ring->fd, 0);
+	if (data == MAP_FAILED) {
+		perror("error: unable to allocate output buffer");
+		if (ring->fd != -1)
+			close(ring->fd);
+		ring->fd = -1;
+		return -1;
+	}
+
+	ring->data = data;
+	ring->size = size;
+	return 0;
+}
+
+/* Set the pattern for the output lines matching. The match is reported via
+ * the eventfd, which shall be polled by the caller. On success this function
+ * returns 0, otherwise -1. */
+int ouroboros_output_pattern(struct ouroboros_output *output, const char *pattern) {
+
+	if (regcomp(&output->pattern, pattern, REG_EXTENDED | REG_NOSUB) != 0) {
+		fprintf(stderr, "error: invalid output pattern: %s\n", pattern);
+		return -1;
+	}
+
+	output->pattern_set = 1;
+	if ((output->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) {
+		perror("error: unable to create eventfd");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Enable or disable the pattern matching. Note, that the output written
+ * before arming, but not yet processed by the background writer, might be
+ * matched as well. */
+void ouroboros_output_arm(struct ouroboros_output *output, int value) {
+	__atomic_store_n(&output->armed, value, __ATOMIC_RELEASE);
+}
+
+/* Start the background writer, so a slow destination will block neither us
+ * nor (as long as the capture pipe is not full) the supervised process. The
+ * output has to be configured before calling this function. On success this
+ * function returns 0, otherwise -1. */
+int ouroboros_output_start(struct ouroboros_output *output) {
+
+	sigset_t sigset, oldset;
+	int rv;
+
+	/* all signals shall be handled by the main thread */
+	sigfillset(&sigset);
+	pthread_sigmask(SIG_SETMASK, &sigset, &oldset);
+	rv = pthread_create(&output->thread, NULL, _output_thread, output);
+	pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+
+	if (rv != 0) {
+		errno = rv;
+		perror("error: unable to start output writer");
+		return -1;
+	}
+
+	output->running = 1;
+	return 0;
+}
+
+/* Write generation marker into the capture pipe. The marker is written by
+ * us into the same pipe as the process output, so it is always placed after
+ * the output of the previous generation. This function shall be called just
+ * before the process is started. On success this function returns 0,
+ * otherwise -1. */
+int ouroboros_output_mark(struct ouroboros_output *output) {
+
+	char buffer[128];
+	char date[32];
+	time_t now;
+	int len;
+
+	output->generation++;
+	if (!output->markers)
+		return 0;
+
+	now = time(NULL);
+	strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&now));
+	len = snprintf(buffer, sizeof(buffer), "--- ouroboros: generation %u started at %s ---\n",
+			output->generation, date);
+
+	/* marker is shorter than PIPE_BUF, so it will be written atomically */
+	if (write(output->pipe[1], buffer, len) != len) {
+		perror("warning: unable to write generation marker");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Get the copy of the in-memory buffer content, starting with the oldest
+ * data. The snapshot is taken without stopping the background writer, so
+ * the data which has been overwritten in the meantime is dropped. Returned
+ * buffer shall be freed with the free(). Upon error this function returns
+ * -1, otherwise the length of the snapshot. */
+ssize_t ouroboros_output_snapshot(struct ouroboros_output *output, char **data) {
+
+	struct ouroboros_output_ring *ring = &output->ring;
+	uint64_t head, reserved, start;
+	size_t len, offset, size;
+	char *buffer;
+
+	*data = NULL;
+	if (ring->size == 0)
+		return 0;
+
+	head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	len = head < ring->size ? head : ring->size;
+	start = head - len;
+
+	if ((buffer = malloc(len + 1)) == NULL)
+		return -1;
+
+	offset = start % ring->size;
+	size = len < ring->size - offset ? len : ring->size - offset;
+	memcpy(buffer, &ring->data[offset], size);
+	memcpy(&buffer[size], ring->data, len - size);
+
+	/* drop data which might have been overwritten during the copy */
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	reserved = __atomic_load_n(&ring->reserved, __ATOMIC_RELAXED);
+	if (reserved > start + ring->size) {
+		size = reserved - start - ring->size;
+		if (size > len)
+			size = len;
+		memmove(buffer, &buffer[size], len - size);
+		len -= size;
+	}
+
+	*data = buffer;
+	return len;
+}
+
+/* Get the number of bytes which are waiting in the capture pipe - they have
+ * not reached the in-memory buffer yet. Upon error this function returns 0. */
+int ouroboros_output_pending(struct ouroboros_output *output) {
+	int pending;
+	if (ioctl(output->pipe[0], FIONREAD, &pending) == -1)
+		return 0;
+	return pending;
+}
+
+/* Write the content of the in-memory buffer into the given descriptor. This
+ * function does not wait for the data which is still waiting in the capture
+ * pipe (see the ouroboros_output_pending()) - it is up to the caller to give
+ * it a moment to reach the buffer, so the last words of the crashed process
+ * will not be lost. On success this function returns 0, otherwise -1. */
+int ouroboros_output_dump(struct ouroboros_output *output, int fd) {
+
+	char header[96];
+	char *data;
+	ssize_t len;
+
+	if ((len = ouroboros_output_snapshot(output, &data)) == -1)
+		return -1;
+
+	snprintf(header, sizeof(header), "--- ouroboros: last %zd bytes of output ---\n", len);
+	if (_write_all(fd, header, strlen(header)) == -1 ||
+			_write_all(fd, data, len) == -1) {
+		perror("warning: unable to dump output");
+		free(data);
+		return -1;
+	}
+
+	free(data);
+	return 0;
+}
@@ -0,0 +1,105 @@
+/*
+ * ouroboros - output.h
+ * Copyright (c) 2015 Arkadiusz Bokowy
+ *
+ * This file is a part of a ouroboros.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef __OUTPUT_H
+#define __OUTPUT_H
+
+#include <pthread.h>
+#include <regex.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+
+/* requested capacity of the capture pipe */
+#define OUROBOROS_OUTPUT_PIPE_SIZE (1024 * 1024)
+/* the maximum length of the line matched against the pattern */
+#define OUROBOROS_OUTPUT_LINE_SIZE 1024
+/* time (in seconds) given to the data pending in the capture pipe before
+ * the output is dumped, and the interval of checking it */
+#define OUROBOROS_OUTPUT_DUMP_TIMEOUT 0.1
+#define OUROBOROS_OUTPUT_DUMP_INTERVAL 0.005
+
+
+/* in-memory buffer with the most recent output */
+struct ouroboros_output_ring {
+	char *data;
+	size_t size;
+	/* memfd backing the buffer (or -1) */
+	int fd;
+	/* total number of written and reserved bytes */
+	uint64_t head;
+	uint64_t reserved;
+};
+
+struct ouroboros_output {
+
+	/* capture pipe - write end is inherited by the process */
+	int pipe[2];
+	/* auxiliary pipe for duplicating data with tee() */
+	int tpipe[2];
+
+	/* log file destination */
+	char *path;
+	int fd;
+	/* terminal destination */
+	int tty;
+	/* destinations which support splice() */
+	int fd_splice;
+	int tty_splice;
+
+	/* size-based log rotation */
+	off_t size;
+	off_t rotate_size;
+	int rotate_count;
+
+	/* output decorations */
+	int timestamps;
+	int markers;
+	unsigned int generation;
+	int bol;
+
+	/* recent output for post-mortem dumps */
+	struct ouroboros_output_ring ring;
+
+	/* Lines are matched against the pattern only when armed, and the first
+	 * match is reported via the eventfd (e.g. readiness of the process). */
+	regex_t pattern;
+	int pattern_set;
+	int armed;
+	int efd;
+	char line[OUROBOROS_OUTPUT_LINE_SIZE];
+	size_t line_len;
+
+	/* background writer */
+	pthread_t thread;
+	int running;
+
+};
+
+
+int ouroboros_output_open(const char *path);
+struct ouroboros_output *ouroboros_output_init(const char *path, int tty);
+void ouroboros_output_free(struct ouroboros_output *output);
+
+int ouroboros_output_timestamps(struct ouroboros_output *output, int value);
+int ouroboros_output_markers(struct ouroboros_output *output, int value);
+void ouroboros_output_rotate(struct ouroboros_output *output, off_t size, int count);
+int ouroboros_output_buffer(struct ouroboros_output *output, size_t size);
+int ouroboros_output_pattern(struct ouroboros_output *output, const char *pattern);
+void ouroboros_output_arm(struct ouroboros_output *output, int value);
+
+int ouroboros_output_start(struct ouroboros_output *output);
+int ouroboros_output_mark(struct ouroboros_output *output);
+
+ssize_t ouroboros_output_snapshot(struct ouroboros_output *output, char **data);
+int ouroboros_output_pending(struct ouroboros_output *output);
+int ouroboros_output_dump(struct ouroboros_output *output, int fd);
+
+#endif
@@ -8,18 +8,72 @@
  *
  */
 
+#define _GNU_SOURCE
 #include "process.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
+#include <spawn.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <proc/readproc.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
 
 #include "debug.h"
+#include "trace.h"
 
 
+extern char **environ;
+
+/* Internal function which resolves executable file name against the PATH
+ * environment variable - in the same way as the execvp() does. Upon error
+ * this function returns NULL. */
+static char *_resolve_path(const char *file) {
+
+	const char *paths;
+	char *tmp, *p, *t;
+	char *path = NULL;
+
+	/* file name with a slash is used as it is */
+	if (strchr(file, '/') != NULL)
+		return strdup(file);
+
+	if ((paths = getenv("PATH")) == NULL)
+		paths = "/bin:/usr/bin";
+	if ((tmp = strdup(paths)) == NULL)
+		return NULL;
+
+	for (p = tmp; (t = strsep(&p, ":")) != NULL; ) {
+		/* empty element denotes current working directory */
+		if (asprintf(&path, "%s/%s", *t ? t : ".", file) == -1) {
+			path = NULL;
+			break;
+		}
+		if (access(path, X_OK) == 0)
+			break;
+		free(path);
+		path = NULL;
+	}
+
+	free(tmp);
+	return path;
+}
+
+/* Internal function which obtains file descriptor referring to the given
+ * process. If it is not supported by the kernel, -1 is returned. */
+static int _pidfd_open(pid_t pid) {
+#ifdef SYS_pidfd_open
+	return syscall(SYS_pidfd_open, pid, 0);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
 /* Initialize process structure with default values. */
 void ouroboros_process_init(struct ouroboros_process *process,
 		const char *file, char **argv) {
@@ -27,9 +81,16 @@ void ouroboros_process_init(struct ouroboros_process *process,
 	process->pid = 0;
 	process->file = file;
 	process->argv = argv;
+	process->path = file != NULL ? _resolve_path(file) : NULL;
+	process->pidfd = -1;
+	process->pgroup = 0;
+	process->pgid = 0;
 	process->signal = SIGTERM;
+	process->status = 0;
+	process->killing = 0;
+	process->outfd = -1;
 
-	if (pipe(process->stdinfd) == -1)
+	if (pipe2(process->stdinfd, O_CLOEXEC) == -1)
 		perror("warning: unable to create pipe");
 
 }
@@ -38,24 +99,26 @@ void ouroboros_process_init(struct ouroboros_process *process,
 void ouroboros_process_free(struct ouroboros_process *process) {
 	close(process->stdinfd[0]);
 	close(process->stdinfd[1]);
+	if (process->pidfd != -1)
+		close(process->pidfd);
+	free(process->path);
 }
-
-/* Kill running instance of watched process. */
-void kill_ouroboros_process(struct ouroboros_process *process) {
-
-	if (process->pid <= 0)
-		return;
+/* Internal function which sends the signal to the process and to all
+ * processes from its process group. */
+static void _kill_group(struct ouroboros_process *process, int sig) {
 
 	PROCTAB *proc;
 	proc_t proc_info;
 
 	pid_t ouroboros_pid = getpid();
-	pid_t process_gpid = getpgid(process->pid);
+	pid_t process_gpid = process->pgid;
+	int leader = 0;
+	char tmp[16];
 
 	proc = openproc(PROC_FILLSTAT);
 	memset(&proc_info, 0, sizeof(proc_info));
 
-	while (readproc(proc, &proc_info) != NULL) {
+	while (process_gpid > 0 && readproc(proc, &proc_info) != NULL) {
 
 		/* we are only interested in processes inside the process
 		 * group of our supervised process */
@@ -66,40 +129,209 @@ void kill_ouroboros_process(struct ouroboros_process *process) {
 		if (proc_info.tgid == ouroboros_pid)
 			continue;
 
-		debug("killing: pid=%d, signal=%d", proc_info.tgid, process->signal);
-		if (kill(proc_info.tgid, process->signal) == -1)
+		debug("killing: pid=%d, signal=%d", proc_info.tgid, sig);
+		sprintf(tmp, "%d", proc_info.tgid);
+		trace_instant("kill signal", tmp);
+		if (kill(proc_info.tgid, sig) == -1)
 			perror("warning: unable to kill process");
 
-		/* prevent zombie apocalypse */
-		waitpid(proc_info.tgid, &process->status, 0);
+		if (proc_info.tgid == process->pid)
+			leader = 1;
 	}
 
 	closeproc(proc);
+
+	/* attached process might not have joined the process group yet */
+	if (process->pid > 0 && !leader)
+		kill(process->pid, sig);
+
 }
 
+/* Kill running instance of watched process. Processes from its process
+ * group are killed as well - even if the process itself has already been
+ * reaped (e.g. background server started by the shell script). This function
+ * does not wait for the termination - the process shall be reaped with the
+ * reap_ouroboros_process() when it terminates, or killed with the
+ * force_kill_ouroboros_process() if it does not terminate in time. */
+void kill_ouroboros_process(struct ouroboros_process *process) {
+
+	if (process->pid <= 0 && process->pgid <= 0)
+		return;
+
+	if (process->pid > 0 && !process->killing) {
+		clock_gettime(CLOCK_MONOTONIC, &process->killed);
+		process->killing = 1;
+	}
+
+	_kill_group(process, process->signal);
+
+	/* leftovers of the reaped process are killed once */
+	if (process->pid <= 0)
+		process->pgid = 0;
+
+}
+
+/* Kill the process and its process group with SIGKILL. */
+void force_kill_ouroboros_process(struct ouroboros_process *process) {
+	_kill_group(process, SIGKILL);
+}
+
+/* Kill the process and wait for its termination - for at most the kill
+ * timeout, after which it is killed with SIGKILL. This function blocks the
+ * caller, so it shall be used when there is no event loop to wait with,
+ * e.g. upon exit. */
+void terminate_ouroboros_process(struct ouroboros_process *process) {
+
+	struct pollfd pfd = { process->pidfd, POLLIN, 0 };
+	int i;
+
+	kill_ouroboros_process(process);
+
+	for (i = 0; process->pid > 0; i++) {
+		if (i == OUROBOROS_PROCESS_KILL_TIMEOUT * 100) {
+			fprintf(stderr, "warning: process has not terminated, sending SIGKILL\n");
+			force_kill_ouroboros_process(process);
+		}
+		/* attached process can be reaped only upon the pidfd readiness */
+		if ((pfd.fd == -1 || poll(&pfd, 1, 0) == 1) &&
+				reap_ouroboros_process(process))
+			break;
+		usleep(10000);
+	}
+
+}
+
+/* Start new instance of watched process. The process is spawned with the
+ * posix_spawn(), which (unlike the fork()) does not copy our page tables,
+ * so the cost of this operation does not depend on the size of our memory.
+ * Note, that failed execution is not considered as an error - in such case
+ * process ID is set to 0. Upon error this function returns -1. */
 int start_ouroboros_process(struct ouroboros_process *process) {
 
-	if ((process->pid = fork()) == -1)
+	posix_spawn_file_actions_t actions;
+	posix_spawnattr_t attr;
+	struct timespec ts;
+	sigset_t sigset;
+	int rv;
+
+	posix_spawn_file_actions_init(&actions);
+	posix_spawnattr_init(&attr);
+
+	/* setup IO redirections - descriptors created by us are marked as
+	 * close-on-exec, so only duplicated ones will be inherited */
+	posix_spawn_file_actions_adddup2(&actions, process->stdinfd[0], fileno(stdin));
+	if (process->outfd != -1) {
+		posix_spawn_file_actions_adddup2(&actions, process->outfd, fileno(stdout));
+		posix_spawn_file_actions_adddup2(&actions, process->outfd, fileno(stderr));
+	}
+
+	/* ignored signals and signal mask are inherited across exec */
+	sigemptyset(&sigset);
+	posix_spawnattr_setsigmask(&attr, &sigset);
+	sigaddset(&sigset, SIGPIPE);
+	posix_spawnattr_setsigdefault(&attr, &sigset);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF |
+			(process->pgroup ? POSIX_SPAWN_SETPGROUP : 0));
+
+	trace_mark(&ts);
+
+	rv = ENOENT;
+	if (process->path != NULL)
+		rv = posix_spawn(&process->pid, process->path, &actions, &attr,
+				process->argv, environ);
+	if (rv == ENOENT) {
+		/* executable might have been moved - resolve its location again */
+		free(process->path);
+		if ((process->path = _resolve_path(process->file)) != NULL)
+			rv = posix_spawn(&process->pid, process->path, &actions, &attr,
+					process->argv, environ);
+	}
+
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&actions);
+
+	trace_span("exec", &ts, process->file);
+
+	if (rv != 0) {
+		process->pid = 0;
+		errno = rv;
+		perror("error: unable to exec process");
+		/* not being able to allocate resources is a fatal error */
+		return rv == ENOMEM || rv == EAGAIN ? -1 : 0;
+	}
+
+	debug("starting: pid=%d, cmd=%s", process->pid, process->path);
+	clock_gettime(CLOCK_MONOTONIC, &process->started);
+	process->pgid = process->pgroup ? process->pid : getpgrp();
+
+	if (process->pidfd != -1)
+		close(process->pidfd);
+	if ((process->pidfd = _pidfd_open(process->pid)) == -1)
+		debug("pidfd not available: %s", strerror(errno));
+
+	return 0;
+}
+
+/* Attach already running process (e.g. forked by the zygote) to the process
+ * structure, so it can be supervised and killed in the same way as the one
+ * started by us. On success this function returns 0, otherwise -1. */
+int attach_ouroboros_process(struct ouroboros_process *process, pid_t pid) {
+
+	if (process->pidfd != -1)
+		close(process->pidfd);
+
+	process->pid = pid;
+	if ((process->pidfd = _pidfd_open(pid)) == -1 && errno == ESRCH) {
+		/* process has already terminated */
+		process->pid = 0;
 		return -1;
-	if (process->pid != 0) {
-		debug("starting: pid=%d, cmd=%s", process->pid, process->file);
+	}
+
+	debug("attaching: pid=%d", pid);
+	clock_gettime(CLOCK_MONOTONIC, &process->started);
+	/* Attached process joins our process group on its own, which might not
+	 * have happened yet, so its current group can not be used. */
+	process->pgid = getpgrp();
+	return 0;
+}
+
+/* Collect the exit status of the supervised process, if it has terminated.
+ * Note, that other processes from the process group are not affected - they
+ * will be killed by the kill_ouroboros_process() function. If the process
+ * has terminated, this function returns 1, otherwise 0. */
+int reap_ouroboros_process(struct ouroboros_process *process) {
+
+	if (process->pid <= 0)
+		return 0;
+
+	switch (waitpid(process->pid, &process->status, WNOHANG)) {
+	case -1:
+		/* attached process is not our child, so the exit status is not
+		 * available - this function shall be called upon pidfd readiness */
+		if (errno != ECHILD)
+			return 0;
+		process->status = 0;
+		break;
+	case 0:
 		return 0;
 	}
 
-	/* setup IO redirections */
-	dup2(process->stdinfd[0], fileno(stdin));
-	if (process->output) {
-		if (freopen(process->output, "w", stdout) != NULL)
-			dup2(fileno(stdout), fileno(stderr));
-		else
-			perror("warning: unable to redirect output");
+	debug("terminated: pid=%d, status=%d", process->pid, process->status);
+
+	if (process->pidfd != -1) {
+		close(process->pidfd);
+		process->pidfd = -1;
 	}
 
-	/* close temporal file descriptors */
-	close(process->stdinfd[0]);
-	close(process->stdinfd[1]);
+	process->pid = 0;
+	process->killing = 0;
+	return 1;
+}
 
-	execvp(process->file, process->argv);
-	perror("error: unable to exec process");
-	exit(EXIT_FAILURE);
+/* Get the time (in seconds) elapsed since the process has been started. */
+double get_ouroboros_process_uptime(const struct ouroboros_process *process) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec - process->started.tv_sec +
+		(now.tv_nsec - process->started.tv_nsec) / 1e9;
 }
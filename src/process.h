@@ -11,23 +11,42 @@
 #ifndef __PROCESS_H
 #define __PROCESS_H
 
+#include <time.h>
 #include <unistd.h>
 
 
+/* the maximal time (in seconds) we will wait for the killed process to
+ * terminate, before it is killed with SIGKILL */
+#define OUROBOROS_PROCESS_KILL_TIMEOUT 5
+
+
 struct ouroboros_process {
 
 	/* process creation */
 	pid_t pid;
 	const char *file;
 	char **argv;
+	/* resolved executable path */
+	char *path;
+	/* start in a new process group */
+	int pgroup;
+	/* process group to be killed - it might outlive the process itself */
+	pid_t pgid;
+
+	/* process supervision */
+	int pidfd;
+	struct timespec started;
 
 	/* process destruction */
 	int signal;
 	int status;
+	/* the process has been signaled, but it has not been reaped yet */
+	int killing;
+	struct timespec killed;
 
 	/* IO redirections */
 	int stdinfd[2];
-	char *output;
+	int outfd;
 
 };
 
@@ -36,6 +55,11 @@ void ouroboros_process_init(struct ouroboros_process *process,
 		const char *file, char *argv[]);
 void ouroboros_process_free(struct ouroboros_process *process);
 void kill_ouroboros_process(struct ouroboros_process *process);
+void force_kill_ouroboros_process(struct ouroboros_process *process);
+void terminate_ouroboros_process(struct ouroboros_process *process);
 int start_ouroboros_process(struct ouroboros_process *process);
+int attach_ouroboros_process(struct ouroboros_process *process, pid_t pid);
+int reap_ouroboros_process(struct ouroboros_process *process);
+double get_ouroboros_process_uptime(const struct ouroboros_process *process);
 
 #endif
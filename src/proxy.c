@@ -0,0 +1,583 @@
+/*
+ * ouroboros - proxy.c
+ * Copyright (c) 2015 Arkadiusz Bokowy
+ *
+ * This file is a part of a ouroboros.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+#define _GNU_SOURCE
+#include "proxy.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+
+#include "debug.h"
+
+
+/* the maximum amount of data moved by a single splice() call */
+#define PROXY_SPLICE_SIZE (64 * 1024)
+/* interval between consecutive connection attempts (in ms) */
+#define PROXY_RETRY_INTERVAL 50
+
+
+/* Initialize TCP proxy which listens on the given port and forwards all
+ * connections to the local target port. This function returns pointer to
+ * the initialized proxy structure or NULL upon error. */
+struct ouroboros_proxy *ouroboros_proxy_init(int port, int target_port) {
+
+	struct ouroboros_proxy *proxy;
+	struct sockaddr_in addr = { 0 };
+	struct epoll_event event = { 0 };
+	int one = 1;
+
+	if ((proxy = malloc(sizeof(struct ouroboros_proxy))) == NULL)
+		return NULL;
+
+	memset(&proxy->target, 0, sizeof(proxy->target));
+	proxy->target.sin_family = AF_INET;
+	proxy->target.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	proxy->target.sin_port = htons(target_port);
+
+	proxy->fd = -1;
+	proxy->epfd = -1;
+	proxy->timerfd = -1;
+	proxy->idlefd = -1;
+	proxy->idle_timeout = 0;
+	proxy->hold = 0;
+	proxy->hold_timeout = 30.0;
+	proxy->conns = NULL;
+	proxy->size = 0;
+	proxy->bytes = 0;
+	memset(&proxy->relay, 0, sizeof(proxy->relay));
+
+	if (port == 0)
+		/* proxy is disabled */
+		return proxy;
+
+	/* relaying to the port 0 would refuse every single connection */
+	if (target_port <= 0 || target_port > 65535) {
+		fprintf(stderr, "error: invalid proxy target port: %d\n", target_port);
+		free(proxy);
+		return NULL;
+	}
+
+	/* writing to the socket closed by the peer shall not kill us */
+	signal(SIGPIPE, SIG_IGN);
+
+	if ((proxy->epfd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+		perror("error: unable to create epoll instance");
+		goto fail;
+	}
+
+	proxy->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	proxy->idlefd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (proxy->timerfd == -1 || proxy->idlefd == -1) {
+		perror("error: unable to create timer");
+		goto fail;
+	}
+
+	proxy->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (proxy->fd == -1) {
+		perror("error: unable to create socket");
+		goto fail;
+	}
+
+	setsockopt(proxy->fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+
+	debug("proxy binding to: %d -> %d", port, target_port);
+	if (bind(proxy->fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+		perror("error: unable to bind address");
+		goto fail;
+	}
+
+	if (listen(proxy->fd, SOMAXCONN) == -1) {
+		perror("error: unable to listen on socket");
+		goto fail;
+	}
+
+	/* listening socket and timers are identified by the NULL pointer and
+	 * the pointers to the proxy structure fields respectively */
+	event.events = EPOLLIN;
+	event.data.ptr = NULL;
+	epoll_ctl(proxy->epfd, EPOLL_CTL_ADD, proxy->fd, &event);
+	event.data.ptr = &proxy->timerfd;
+	epoll_ctl(proxy->epfd, EPOLL_CTL_ADD, proxy->timerfd, &event);
+	event.data.ptr = &proxy->idlefd;
+	epoll_ctl(proxy->epfd, EPOLL_CTL_ADD, proxy->idlefd, &event);
+
+	return proxy;
+
+fail:
+	ouroboros_proxy_free(proxy);
+	return NULL;
+}
+
+/* Internal function which releases connection resources. */
+static void _conn_free(struct ouroboros_proxy_conn *conn) {
+	int i;
+	for (i = 0; i < 2; i++) {
+		if (conn->fd[i] != -1)
+			close(conn->fd[i]);
+		close(conn->pipe[i][0]);
+		close(conn->pipe[i][1]);
+	}
+	free(conn);
+}
+
+/* Free allocated resources. */
+void ouroboros_proxy_free(struct ouroboros_proxy *proxy) {
+
+	struct ouroboros_proxy_conn *conn;
+
+	while ((conn = proxy->conns) != NULL) {
+		proxy->conns = conn->next;
+		_conn_free(conn);
+	}
+
+	if (proxy->fd != -1)
+		close(proxy->fd);
+	if (proxy->timerfd != -1)
+		close(proxy->timerfd);
+	if (proxy->idlefd != -1)
+		close(proxy->idlefd);
+	if (proxy->epfd != -1)
+		close(proxy->epfd);
+	free(proxy);
+}
+
+/* Internal function which (re)arms the retry timer. Passing 0 as the
+ * interval disarms the timer. */
+static void _timer_set(struct ouroboros_proxy *proxy, long interval) {
+	struct itimerspec ts = { 0 };
+	ts.it_value.tv_nsec = interval * 1000000;
+	ts.it_interval.tv_nsec = interval * 1000000;
+	timerfd_settime(proxy->timerfd, 0, &ts, NULL);
+}
+
+/* Internal function which arms the inactivity timer to expire after given
+ * number of seconds. Setting 0 disarms the timer. */
+static void _idle_arm(struct ouroboros_proxy *proxy, double delay) {
+	struct itimerspec ts = { 0 };
+	if (delay > 0) {
+		ts.it_value.tv_sec = delay;
+		ts.it_value.tv_nsec = (delay - ts.it_value.tv_sec) * 1e9;
+		/* zero value would disarm the timer */
+		if (ts.it_value.tv_sec == 0 && ts.it_value.tv_nsec == 0)
+			ts.it_value.tv_nsec = 1;
+	}
+	timerfd_settime(proxy->idlefd, 0, &ts, NULL);
+}
+
+/* Internal function which marks the proxy as active now and (re)arms the
+ * inactivity timer. Note, that the timer is not re-armed upon every relayed
+ * chunk of data - the time of the last activity is checked when it expires. */
+static void _idle_set(struct ouroboros_proxy *proxy) {
+	clock_gettime(CLOCK_MONOTONIC, &proxy->active);
+	_idle_arm(proxy, proxy->idle_timeout);
+}
+
+/* Internal function which checks whether there was no traffic for the idle
+ * timeout. If not, the timer is re-armed for the remaining time. */
+static int _idle_expired(struct ouroboros_proxy *proxy) {
+
+	struct timespec now;
+	double elapsed;
+
+	if (proxy->idle_timeout <= 0)
+		return 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed = now.tv_sec - proxy->active.tv_sec +
+		(now.tv_nsec - proxy->active.tv_nsec) / 1e9;
+
+	/* inactivity is not counted while connections are held */
+	if (proxy->hold) {
+		_idle_arm(proxy, proxy->idle_timeout);
+		return 0;
+	}
+
+	if (elapsed < proxy->idle_timeout) {
+		_idle_arm(proxy, proxy->idle_timeout - elapsed);
+		return 0;
+	}
+
+	return 1;
+}
+
+/* Internal function which removes connection from the proxy. */
+static void _conn_close(struct ouroboros_proxy *proxy, struct ouroboros_proxy_conn *conn) {
+	debug("proxy closing connection: fd=%d", conn->fd[0]);
+
+	struct ouroboros_proxy_conn **ptr = &proxy->conns;
+	while (*ptr != conn)
+		ptr = &(*ptr)->next;
+	*ptr = conn->next;
+
+	/* closing descriptors removes them from the epoll set */
+	_conn_free(conn);
+	proxy->size--;
+}
+
+/* Internal function which updates epoll interest for both connection sides.
+ * Reading is suspended until the previously read data has been written, so
+ * the proxy never buffers more than one splice chunk per direction. */
+static void _conn_update(struct ouroboros_proxy *proxy, struct ouroboros_proxy_conn *conn) {
+
+	struct epoll_event event;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+
+		if (conn->fd[i] == -1)
+			continue;
+
+		event.events = 0;
+		if (!conn->eof[i] && conn->buffered[i] == 0)
+			event.events |= EPOLLIN;
+		if (conn->buffered[!i] > 0)
+			event.events |= EPOLLOUT;
+		event.data.ptr = &conn->ep[i];
+
+		if (event.events != conn->events[i])
+			epoll_ctl(proxy->epfd, EPOLL_CTL_MOD, conn->fd[i], &event);
+		conn->events[i] = event.events;
+
+	}
+
+}
+
+/* Internal function which starts connecting to the upstream. On success
+ * this function returns 0, otherwise -1. */
+static int _conn_connect(struct ouroboros_proxy *proxy, struct ouroboros_proxy_conn *conn) {
+
+	struct epoll_event event = { 0 };
+	int fd;
+
+	if ((fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1)
+		return -1;
+
+	if (connect(fd, (struct sockaddr *)&proxy->target, sizeof(proxy->target)) == -1 &&
+			errno != EINPROGRESS) {
+		close(fd);
+		return -1;
+	}
+
+	conn->fd[1] = fd;
+	conn->events[1] = EPOLLOUT;
+	conn->state = OPS_CONNECTING;
+
+	event.events = EPOLLOUT;
+	event.data.ptr = &conn->ep[1];
+	epoll_ctl(proxy->epfd, EPOLL_CTL_ADD, fd, &event);
+
+	return 0;
+}
+
+/* Internal function which accepts all pending connections. */
+static void _accept(struct ouroboros_proxy *proxy) {
+
+	struct ouroboros_proxy_conn *conn;
+	struct epoll_event event = { 0 };
+	int waiting = 0;
+	int fd;
+
+	while ((fd = accept4(proxy->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+
+		if ((conn = calloc(1, sizeof(*conn))) == NULL) {
+			close(fd);
+			continue;
+		}
+
+		if (pipe2(conn->pipe[0], O_NONBLOCK | O_CLOEXEC) == -1) {
+			close(fd);
+			free(conn);
+			continue;
+		}
+		if (pipe2(conn->pipe[1], O_NONBLOCK | O_CLOEXEC) == -1) {
+			close(conn->pipe[0][0]);
+			close(conn->pipe[0][1]);
+			close(fd);
+			free(conn);
+			continue;
+		}
+
+		debug("proxy new connection: fd=%d", fd);
+
+		conn->state = OPS_WAITING;
+		clock_gettime(CLOCK_MONOTONIC, &conn->accepted);
+		conn->fd[0] = fd;
+		conn->fd[1] = -1;
+		conn->ep[0].conn = conn;
+		conn->ep[0].side = 0;
+		conn->ep[1].conn = conn;
+		conn->ep[1].side = 1;
+
+		/* client is not read until the upstream is connected */
+		event.events = 0;
+		event.data.ptr = &conn->ep[0];
+		epoll_ctl(proxy->epfd, EPOLL_CTL_ADD, fd, &event);
+
+		conn->next = proxy->conns;
+		proxy->conns = conn;
+		proxy->size++;
+
+		if (proxy->hold || _conn_connect(proxy, conn) == -1)
+			waiting++;
+
+	}
+
+	/* make sure that waiting connections will be retried */
+	if (waiting)
+		_timer_set(proxy, PROXY_RETRY_INTERVAL);
+
+	_idle_set(proxy);
+
+}
+
+/* Internal function which moves buffered data from the pipe to the socket.
+ * This function returns -1 upon fatal error. */
+static int _conn_flush(struct ouroboros_proxy *proxy, struct ouroboros_proxy_conn *conn, int side) {
+
+	ssize_t len;
+
+	while (conn->buffered[side] > 0) {
+		len = splice(conn->pipe[side][0], NULL, conn->fd[!side], NULL,
+				conn->buffered[side], SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (len == -1)
+			return errno == EAGAIN ? 0 : -1;
+		conn->buffered[side] -= len;
+		proxy->bytes += len;
+		clock_gettime(CLOCK_MONOTONIC, &proxy->active);
+		/* time which the data has spent in the proxy */
+		if (conn->buffered[side] == 0)
+			ouroboros_metrics_observe(&proxy->relay,
+					ouroboros_metrics_since(&conn->received[side]));
+	}
+
+	/* propagate end-of-stream when there is nothing left to send */
+	if (conn->eof[side])
+		shutdown(conn->fd[!side], SHUT_WR);
+
+	return 0;
+}
+
+/* Internal function which reads data from the given connection side. This
+ * function returns -1 upon fatal error. */
+static int _conn_read(struct ouroboros_proxy *proxy, struct ouroboros_proxy_conn *conn, int side) {
+
+	ssize_t len;
+
+	len = splice(conn->fd[side], NULL, conn->pipe[side][1], NULL,
+			PROXY_SPLICE_SIZE, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+	if (len == -1)
+		return errno == EAGAIN ? 0 : -1;
+	if (len == 0)
+		conn->eof[side] = 1;
+	else if (conn->buffered[side] == 0)
+		clock_gettime(CLOCK_MONOTONIC, &conn->received[side]);
+
+	conn->buffered[side] += len;
+	return _conn_flush(proxy, conn, side);
+}
+
+/* Internal function which handles finished upstream connection attempt. If
+ * the upstream has been connected, this function returns 1, otherwise 0. */
+static int _conn_connected(struct ouroboros_proxy *proxy, struct ouroboros_proxy_conn *conn) {
+
+	socklen_t len = sizeof(int);
+	int err = 0;
+
+	getsockopt(conn->fd[1], SOL_SOCKET, SO_ERROR, &err, &len);
+	if (err != 0) {
+		debug("proxy upstream not ready: %s", strerror(err));
+		/* service is not accepting (yet) - retry later */
+		close(conn->fd[1]);
+		conn->fd[1] = -1;
+		conn->state = OPS_WAITING;
+		_timer_set(proxy, PROXY_RETRY_INTERVAL);
+		return 0;
+	}
+
+	debug("proxy upstream connected: fd=%d", conn->fd[1]);
+	conn->state = OPS_RELAYING;
+	_conn_update(proxy, conn);
+	return 1;
+}
+
+/* Internal function which retries (or drops) waiting connections. */
+static void _retry(struct ouroboros_proxy *proxy) {
+
+	struct ouroboros_proxy_conn *conn, *next;
+	struct timespec now;
+	uint64_t expirations;
+	int waiting = 0;
+
+	if (read(proxy->timerfd, &expirations, sizeof(expirations)) == -1)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	for (conn = proxy->conns; conn != NULL; conn = next) {
+		next = conn->next;
+
+		if (conn->state != OPS_WAITING)
+			continue;
+
+		if (now.tv_sec - conn->accepted.tv_sec +
+				(now.tv_nsec - conn->accepted.tv_nsec) / 1e9 > proxy->hold_timeout) {
+			fprintf(stderr, "warning: proxy connection hold timeout\n");
+			_conn_close(proxy, conn);
+			continue;
+		}
+
+		if (proxy->hold || _conn_connect(proxy, conn) == -1)
+			waiting++;
+	}
+
+	_timer_set(proxy, waiting ? PROXY_RETRY_INTERVAL : 0);
+
+}
+
+/* Hold new connections - do not connect them to the upstream until the
+ * hold is released. This function returns the previous value. */
+int ouroboros_proxy_hold(struct ouroboros_proxy *proxy, int value) {
+	int tmp = proxy->hold;
+	proxy->hold = value;
+	if (proxy->timerfd != -1 && proxy->size)
+		/* process held connections as soon as possible */
+		_timer_set(proxy, value ? PROXY_RETRY_INTERVAL : 1);
+	if (proxy->idlefd != -1 && !value)
+		/* inactivity is counted since the upstream is available */
+		_idle_set(proxy);
+	return tmp;
+}
+
+/* Set the maximal time (in seconds) for which new connection might be held
+ * waiting for the upstream. This function returns the previous value. */
+double ouroboros_proxy_hold_timeout(struct ouroboros_proxy *proxy, double value) {
+	double tmp = proxy->hold_timeout;
+	proxy->hold_timeout = value;
+	return tmp;
+}
+
+/* Set the time (in seconds) without any relayed data after which the proxy
+ * reports inactivity - open but silent connections do not count. Setting 0
+ * disables inactivity reporting. This function returns the previous value. */
+double ouroboros_proxy_idle_timeout(struct ouroboros_proxy *proxy, double value) {
+	double tmp = proxy->idle_timeout;
+	proxy->idle_timeout = value;
+	if (proxy->idlefd != -1)
+		_idle_set(proxy);
+	return tmp;
+}
+
+/* Check the inactivity again after given number of seconds. It shall be used
+ * when the reported inactivity could not have been handled at once. */
+void ouroboros_proxy_idle_check(struct ouroboros_proxy *proxy, double delay) {
+	if (proxy->idlefd != -1 && proxy->idle_timeout > 0)
+		_idle_arm(proxy, delay);
+}
+
+/* Dispatch all pending proxy events. This function never blocks. On success
+ * this function returns the mask of reported events (new connection has been
+ * accepted, upstream has been connected or proxy has been idle for too long).
+ * Upon error -1 is returned. */
+int ouroboros_proxy_dispatch(struct ouroboros_proxy *proxy) {
+
+	struct epoll_event events[32];
+	uint64_t expirations;
+	int rv = 0;
+	int count;
+	int i;
+
+	if ((count = epoll_wait(proxy->epfd, events, 32, 0)) == -1) {
+		perror("warning: proxy epoll wait failed");
+		return -1;
+	}
+
+	for (i = 0; i < count; i++) {
+
+		struct ouroboros_proxy_endpoint *ep = events[i].data.ptr;
+		struct ouroboros_proxy_conn *conn;
+
+		if (ep == NULL) {
+			_accept(proxy);
+			rv |= OPE_ACCEPT;
+			continue;
+		}
+		if (ep == (void *)&proxy->timerfd) {
+			_retry(proxy);
+			continue;
+		}
+		if (ep == (void *)&proxy->idlefd) {
+			if (read(proxy->idlefd, &expirations, sizeof(expirations)) > 0 &&
+					_idle_expired(proxy))
+				rv |= OPE_IDLE;
+			continue;
+		}
+
+		conn = ep->conn;
+
+		if (conn->state != OPS_RELAYING) {
+			/* client has gone away before the upstream was connected */
+			if (ep->side == 0)
+				goto close;
+			if (_conn_connected(proxy, conn))
+				rv |= OPE_CONNECT;
+			continue;
+		}
+
+		/* peer has hung up and there is nothing more to read from it */
+		if (events[i].events & (EPOLLHUP | EPOLLERR) && conn->eof[ep->side])
+			goto close;
+
+		if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+			if (_conn_read(proxy, conn, ep->side) == -1)
+				goto close;
+		if (events[i].events & EPOLLOUT)
+			if (_conn_flush(proxy, conn, !ep->side) == -1)
+				goto close;
+
+		/* both directions have been drained and closed */
+		if (conn->eof[0] && conn->eof[1] &&
+				conn->buffered[0] == 0 && conn->buffered[1] == 0)
+			goto close;
+
+		_conn_update(proxy, conn);
+		continue;
+
+close:
+		/* the rest of events for this connection (if any) refer to the
+		 * freed memory, so stop processing of the current batch */
+		_conn_close(proxy, conn);
+		break;
+	}
+
+	/* new connection cancels inactivity */
+	if (rv & OPE_ACCEPT)
+		rv &= ~OPE_IDLE;
+
+	return rv;
+}
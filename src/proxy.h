@@ -0,0 +1,107 @@
+/*
+ * ouroboros - proxy.h
+ * Copyright (c) 2015 Arkadiusz Bokowy
+ *
+ * This file is a part of a ouroboros.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef __PROXY_H
+#define __PROXY_H
+
+#include <time.h>
+#include <netinet/in.h>
+
+#include "metrics.h"
+
+
+/* connection relaying state */
+enum ouroboros_proxy_state {
+	OPS_WAITING = 0,
+	OPS_CONNECTING,
+	OPS_RELAYING,
+};
+
+
+/* events reported by the dispatcher */
+enum ouroboros_proxy_event {
+	OPE_ACCEPT = 1 << 0,
+	OPE_IDLE = 1 << 1,
+	OPE_CONNECT = 1 << 2,
+};
+
+
+struct ouroboros_proxy_conn;
+
+/* epoll registration handle - one for every connection side */
+struct ouroboros_proxy_endpoint {
+	struct ouroboros_proxy_conn *conn;
+	int side;
+};
+
+struct ouroboros_proxy_conn {
+
+	enum ouroboros_proxy_state state;
+	struct timespec accepted;
+
+	/* client (0) and upstream (1) sockets */
+	int fd[2];
+	struct ouroboros_proxy_endpoint ep[2];
+	unsigned int events[2];
+
+	/* pipe[i] carries data from fd[i] to fd[!i] */
+	int pipe[2][2];
+	size_t buffered[2];
+	int eof[2];
+	/* the time when the buffered data has been received */
+	struct timespec received[2];
+
+	struct ouroboros_proxy_conn *next;
+
+};
+
+
+struct ouroboros_proxy {
+
+	/* public listening socket */
+	int fd;
+	/* supervised service address */
+	struct sockaddr_in target;
+
+	/* event multiplexer for all proxy descriptors */
+	int epfd;
+	/* connection retry timer */
+	int timerfd;
+	/* inactivity timer - the time of the last relayed data */
+	int idlefd;
+	double idle_timeout;
+	struct timespec active;
+
+	/* hold new connections */
+	int hold;
+	double hold_timeout;
+
+	/* active connections */
+	struct ouroboros_proxy_conn *conns;
+	int size;
+
+	/* relayed data statistics */
+	unsigned long long bytes;
+	struct ouroboros_metrics_histogram relay;
+
+};
+
+
+struct ouroboros_proxy *ouroboros_proxy_init(int port, int target_port);
+void ouroboros_proxy_free(struct ouroboros_proxy *proxy);
+
+int ouroboros_proxy_hold(struct ouroboros_proxy *proxy, int value);
+double ouroboros_proxy_hold_timeout(struct ouroboros_proxy *proxy, double value);
+double ouroboros_proxy_idle_timeout(struct ouroboros_proxy *proxy, double value);
+void ouroboros_proxy_idle_check(struct ouroboros_proxy *proxy, double delay);
+
+int ouroboros_proxy_dispatch(struct ouroboros_proxy *proxy);
+
+#endif
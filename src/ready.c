@@ -0,0 +1,153 @@
+/*
+ * ouroboros - ready.c
+ * Copyright (c) 2015 Arkadiusz Bokowy
+ *
+ * This file is a part of a ouroboros.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#define _GNU_SOURCE
+#include "ready.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "debug.h"
+
+
+/* Initialize readiness detection. If the notify is true, the NOTIFY_SOCKET
+ * is created in the abstract namespace and exported via the environment, so
+ * it is inherited by started processes. This function returns pointer to
+ * the initialized structure or NULL upon error. */
+struct ouroboros_ready *ouroboros_ready_init(int notify, int port) {
+
+	struct ouroboros_ready *ready;
+	socklen_t len;
+
+	if ((ready = malloc(sizeof(struct ouroboros_ready))) == NULL)
+		return NULL;
+
+	ready->fd = -1;
+	ready->port = port;
+	memset(&ready->addr, 0, sizeof(ready->addr));
+
+	if (!notify)
+		return ready;
+
+	if ((ready->fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1) {
+		perror("error: unable to create notify socket");
+		free(ready);
+		return NULL;
+	}
+
+	/* abstract address is not visible in the file system, so there is
+	 * nothing to clean up - even if we get killed */
+	ready->addr.sun_family = AF_UNIX;
+	len = snprintf(&ready->addr.sun_path[1], sizeof(ready->addr.sun_path) - 1,
+			"ouroboros/%d/notify", getpid());
+	len += offsetof(struct sockaddr_un, sun_path) + 1;
+
+	if (bind(ready->fd, (struct sockaddr *)&ready->addr, len) == -1) {
+		perror("error: unable to bind notify socket");
+		ouroboros_ready_free(ready);
+		return NULL;
+	}
+
+	/* sd_notify(3) denotes the abstract namespace with the '@' prefix */
+	ready->addr.sun_path[0] = '@';
+	setenv("NOTIFY_SOCKET", ready->addr.sun_path, 1);
+	ready->addr.sun_path[0] = '\0';
+
+	debug("notify socket: @%s", &ready->addr.sun_path[1]);
+	return ready;
+}
+
+/* Free allocated resources. */
+void ouroboros_ready_free(struct ouroboros_ready *ready) {
+	if (ready->fd != -1) {
+		unsetenv("NOTIFY_SOCKET");
+		close(ready->fd);
+	}
+	free(ready);
+}
+
+/* Dispatch notification message. Only READY=1 and WATCHDOG=1 assignments
+ * are taken into account, other ones (e.g. STATUS) are ignored. This function
+ * returns the bitwise OR of received ouroboros_ready_message values. */
+int ouroboros_ready_dispatch(struct ouroboros_ready *ready) {
+
+	char buffer[4096];
+	char *tmp, *line;
+	ssize_t len;
+	int rv = 0;
+
+	while ((len = recv(ready->fd, buffer, sizeof(buffer) - 1, 0)) > 0) {
+		buffer[len] = '\0';
+		for (line = strtok_r(buffer, "\n", &tmp); line != NULL; line = strtok_r(NULL, "\n", &tmp)) {
+			debug("notify message: %s", line);
+			if (strcmp(line, "READY=1") == 0)
+				rv |= ORM_READY;
+			else if (strcmp(line, "WATCHDOG=1") == 0)
+				rv |= ORM_WATCHDOG;
+		}
+	}
+
+	return rv;
+}
+
+/* Check whether the process accepts connections on the given port of the
+ * loopback interface. Connection to the local port is usually accepted or
+ * refused right away, however the kernel might report it as in progress.
+ * In such case this function returns -1 and the pending socket is stored in
+ * the fd - it shall be watched for writability and the result obtained with
+ * the ouroboros_ready_probe_result(). If the port is open, this function
+ * returns 1, otherwise 0. */
+int ouroboros_ready_probe(int port, int *fd) {
+
+	struct sockaddr_in addr = { 0 };
+	int rv = 0;
+
+	if ((*fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1)
+		return 0;
+
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+
+	if (connect(*fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+		rv = 1;
+	else if (errno == EINPROGRESS)
+		return -1;
+
+	close(*fd);
+	*fd = -1;
+	return rv;
+}
+
+/* Get the result of the pending probe connection and close its socket. This
+ * function does not wait - connection which has not been established yet
+ * (e.g. the listen backlog is full) is taken as a failure. If the port is
+ * open, this function returns 1, otherwise 0. */
+int ouroboros_ready_probe_result(int fd) {
+
+	struct pollfd pfd = { fd, POLLOUT, 0 };
+	socklen_t len = sizeof(int);
+	int err, rv = 0;
+
+	if (poll(&pfd, 1, 0) == 1 &&
+			getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0)
+		rv = err == 0;
+
+	close(fd);
+	return rv;
+}
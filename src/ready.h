@@ -0,0 +1,50 @@
+/*
+ * ouroboros - ready.h
+ * Copyright (c) 2015 Arkadiusz Bokowy
+ *
+ * This file is a part of a ouroboros.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef __READY_H
+#define __READY_H
+
+#include <sys/un.h>
+
+
+/* interval (in seconds) between TCP port probes */
+#define OUROBOROS_READY_PROBE_INTERVAL 0.05
+
+
+/* messages received via the notify socket */
+enum ouroboros_ready_message {
+	ORM_READY = 1 << 0,
+	ORM_WATCHDOG = 1 << 1,
+};
+
+
+/* Readiness detection of the started process. The process might report
+ * readiness by itself via the sd_notify(3) protocol, or the readiness can
+ * be probed by connecting to the port on which the process listens. */
+struct ouroboros_ready {
+
+	/* NOTIFY_SOCKET datagram socket (or -1) */
+	int fd;
+	struct sockaddr_un addr;
+
+	/* TCP port probed on the loopback interface (or 0) */
+	int port;
+
+};
+
+
+struct ouroboros_ready *ouroboros_ready_init(int notify, int port);
+void ouroboros_ready_free(struct ouroboros_ready *ready);
+
+int ouroboros_ready_dispatch(struct ouroboros_ready *ready);
+int ouroboros_ready_probe(int port, int *fd);
+int ouroboros_ready_probe_result(int fd);
+
+#endif
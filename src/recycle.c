@@ -0,0 +1,175 @@
+/*
+ * ouroboros - recycle.c
+ * Copyright (c) 2015 Arkadiusz Bokowy
+ *
+ * This file is a part of a ouroboros.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include "recycle.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+
+
+/* mount point of the unified (v2) cgroup hierarchy */
+#define CGROUP_ROOT "/sys/fs/cgroup"
+
+
+/* Internal function which gets the unified hierarchy cgroup of the given
+ * process. Returned string shall be freed with the free(). Upon error this
+ * function returns NULL. */
+static char *_cgroup(const char *pid) {
+
+	char buffer[4096];
+	char *path = NULL;
+	FILE *f;
+
+	sprintf(buffer, "/proc/%s/cgroup", pid);
+	if ((f = fopen(buffer, "r")) == NULL)
+		return NULL;
+
+	while (path == NULL && fgets(buffer, sizeof(buffer), f) != NULL)
+		if (strncmp(buffer, "0::", 3) == 0) {
+			buffer[strcspn(buffer, "\n")] = '\0';
+			path = strdup(&buffer[3]);
+		}
+
+	fclose(f);
+	return path;
+}
+
+/* Internal function which reads the value of the cgroup file. If the key is
+ * given, the file is a flat keyed one (e.g. memory.events). Upon error this
+ * function returns -1. */
+static long long _cgroup_read(const char *cgroup, const char *file, const char *key) {
+
+	char buffer[4096];
+	long long value = -1;
+	size_t len = key != NULL ? strlen(key) : 0;
+	FILE *f;
+
+	snprintf(buffer, sizeof(buffer), CGROUP_ROOT "%s/%s", cgroup, file);
+	if ((f = fopen(buffer, "r")) == NULL)
+		return -1;
+
+	while (fgets(buffer, sizeof(buffer), f) != NULL) {
+		if (key != NULL && (strncmp(buffer, key, len) != 0 || buffer[len] != ' '))
+			continue;
+		value = strtoll(&buffer[len], NULL, 10);
+		break;
+	}
+
+	fclose(f);
+	return value;
+}
+
+/* Initialize recycling. This function returns pointer to the initialized
+ * structure or NULL upon error. */
+struct ouroboros_recycle *ouroboros_recycle_init(long limit, double lifetime) {
+
+	struct ouroboros_recycle *recycle;
+
+	if ((recycle = malloc(sizeof(struct ouroboros_recycle))) == NULL)
+		return NULL;
+
+	recycle->limit = limit;
+	recycle->lifetime = lifetime;
+	recycle->cgroup = NULL;
+	recycle->high = 0;
+
+	return recycle;
+}
+
+/* Free allocated resources. */
+void ouroboros_recycle_free(struct ouroboros_recycle *recycle) {
+	free(recycle->cgroup);
+	free(recycle);
+}
+
+/* Reset the state for the newly started process. The cgroup is used only
+ * if the process has been placed in its own one (e.g. by a wrapper like the
+ * systemd-run), otherwise the memory usage would include our own usage and
+ * the usage of all other services. */
+void ouroboros_recycle_reset(struct ouroboros_recycle *recycle, pid_t pid) {
+
+	char tmp[16];
+	char *self;
+
+	free(recycle->cgroup);
+	recycle->cgroup = NULL;
+	recycle->high = 0;
+
+	sprintf(tmp, "%d", pid);
+	if ((recycle->cgroup = _cgroup(tmp)) == NULL)
+		return;
+
+	if ((self = _cgroup("self")) != NULL && strcmp(self, recycle->cgroup) == 0) {
+		free(recycle->cgroup);
+		recycle->cgroup = NULL;
+	}
+	free(self);
+
+	if (recycle->cgroup != NULL) {
+		long long high = _cgroup_read(recycle->cgroup, "memory.events", "high");
+		recycle->high = high > 0 ? high : 0;
+		debug("recycle cgroup: %s", recycle->cgroup);
+	}
+
+}
+
+/* Get the memory usage (in KiB) of the process. If the process has its own
+ * cgroup, the usage of the whole cgroup is returned, otherwise the resident
+ * set size of the process itself. Upon error this function returns -1. */
+long ouroboros_recycle_usage(struct ouroboros_recycle *recycle, pid_t pid) {
+
+	char buffer[64];
+	long long usage;
+	long pages;
+	FILE *f;
+
+	if (recycle->cgroup != NULL &&
+			(usage = _cgroup_read(recycle->cgroup, "memory.current", NULL)) != -1)
+		return usage / 1024;
+
+	sprintf(buffer, "/proc/%d/statm", pid);
+	if ((f = fopen(buffer, "r")) == NULL)
+		return -1;
+	if (fscanf(f, "%*s %ld", &pages) != 1)
+		pages = -1;
+	fclose(f);
+
+	return pages == -1 ? -1 : pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/* Check whether the process shall be recycled. If so, this function returns
+ * the reason of the recycling, otherwise NULL. */
+const char *ouroboros_recycle_check(struct ouroboros_recycle *recycle,
+		const struct ouroboros_process *process) {
+
+	long long high;
+	long usage;
+
+	if (recycle->lifetime > 0 &&
+			get_ouroboros_process_uptime(process) > recycle->lifetime)
+		return "lifetime limit";
+
+	/* the memory.high limit of the cgroup is our soft limit as well */
+	if (recycle->cgroup != NULL &&
+			(high = _cgroup_read(recycle->cgroup, "memory.events", "high")) > 0 &&
+			(unsigned long long)high > recycle->high)
+		return "cgroup memory.high";
+
+	if (recycle->limit > 0 &&
+			(usage = ouroboros_recycle_usage(recycle, process->pid)) > recycle->limit) {
+		debug("memory usage: %ld KiB", usage);
+		return "memory limit";
+	}
+
+	return NULL;
+}
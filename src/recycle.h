@@ -0,0 +1,48 @@
+/*
+ * ouroboros - recycle.h
+ * Copyright (c) 2015 Arkadiusz Bokowy
+ *
+ * This file is a part of a ouroboros.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef __RECYCLE_H
+#define __RECYCLE_H
+
+#include "process.h"
+
+
+/* interval (in seconds) between memory usage samples */
+#define OUROBOROS_RECYCLE_INTERVAL 1.0
+
+
+/* Recycling of the long-running process, so slow memory leaks will not
+ * push the host into swap. The process is restarted when its memory usage
+ * crosses the soft limit or when it has been running for too long. */
+struct ouroboros_recycle {
+
+	/* memory usage limit (in KiB) or 0 */
+	long limit;
+	/* the maximum lifetime (in seconds) or 0 */
+	double lifetime;
+
+	/* Directory of the cgroup dedicated to the process (or NULL). Within
+	 * such a cgroup the memory usage of the whole process tree is known,
+	 * and the kernel reports crossing the memory.high limit. */
+	char *cgroup;
+	unsigned long long high;
+
+};
+
+
+struct ouroboros_recycle *ouroboros_recycle_init(long limit, double lifetime);
+void ouroboros_recycle_free(struct ouroboros_recycle *recycle);
+
+void ouroboros_recycle_reset(struct ouroboros_recycle *recycle, pid_t pid);
+long ouroboros_recycle_usage(struct ouroboros_recycle *recycle, pid_t pid);
+const char *ouroboros_recycle_check(struct ouroboros_recycle *recycle,
+		const struct ouroboros_process *process);
+
+#endif
@@ -12,8 +12,10 @@
 #include "../config.h"
 #endif
 
+#define _GNU_SOURCE
 #include "server.h"
 
+#include <errno.h>
 #include <ifaddrs.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -21,27 +23,51 @@
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 
 #include "debug.h"
 
 
-/* Initialize server. This function returns pointer to the initialized server
- * structure or NULL upon error. */
-struct ouroboros_server *ouroboros_server_init(const char *ifname, int port) {
+/* the maximum size of a single reply datagram */
+#define SERVER_REPLY_SIZE (32 * 1024)
 
-	struct ouroboros_server *server;
+/* Internal function which joins the multicast group, so events published
+ * by fleet peers to this group will be received. On success this function
+ * returns 0, otherwise -1. */
+static int _join_group(struct ouroboros_server *server, const char *group) {
 
-	if ((server = malloc(sizeof(struct ouroboros_server))) == NULL)
-		return NULL;
+	struct ip_mreq mreq = { 0 };
+	struct ipv6_mreq mreq6 = { 0 };
 
-	server->ifname = ifname != NULL ? strdup(ifname) : NULL;
-	server->ifaddr.sa_family = AF_INET;
-	((struct sockaddr_in *)(&server->ifaddr))->sin_addr.s_addr = 0;
-	server->fd = -1;
+	debug("joining group: %s", group);
+
+	if (inet_pton(AF_INET, group, &mreq.imr_multiaddr) == 1 &&
+			server->ifaddr.sa_family == AF_INET) {
+		mreq.imr_interface = ((struct sockaddr_in *)(&server->ifaddr))->sin_addr;
+		return setsockopt(server->fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
+	}
+
+	if (inet_pton(AF_INET6, group, &mreq6.ipv6mr_multiaddr) == 1 &&
+			server->ifaddr.sa_family == AF_INET6)
+		return setsockopt(server->fd, IPPROTO_IPV6, IPV6_JOIN_GROUP, &mreq6, sizeof(mreq6));
+
+	errno = EAFNOSUPPORT;
+	return -1;
+}
+
+/* Internal function which binds the network socket to the given interface.
+ * If the multicast group is given, the port can be shared with other local
+ * instances, which join the same group. On success this function returns 0,
+ * otherwise -1. */
+static int _bind_inet(struct ouroboros_server *server, const char *ifname, int port,
+		const char *group) {
+
+	const int reuse = 1;
 
 	if (ifname == NULL)
-		/* server is disabled */
-		return server;
+		/* network server is disabled */
+		return 0;
 
 	/* get the address of given interface name */
 	if (strcmp(ifname, "any") != 0) {
@@ -65,7 +91,7 @@ struct ouroboros_server *ouroboros_server_init(const char *ifname, int port) {
 
 			if (ifa == NULL) {
 				fprintf(stderr, "warning: interface %s not found\n", ifname);
-				return server;
+				return 0;
 			}
 		}
 	}
@@ -79,8 +105,7 @@ struct ouroboros_server *ouroboros_server_init(const char *ifname, int port) {
 		break;
 	default:
 		fprintf(stderr, "error: unsupported interface: %d\n", server->ifaddr.sa_family);
-		ouroboros_server_free(server);
-		return NULL;
+		return -1;
 	}
 
 #if DEBUG
@@ -92,12 +117,94 @@ struct ouroboros_server *ouroboros_server_init(const char *ifname, int port) {
 	server->fd = socket(server->ifaddr.sa_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
 	if (server->fd == -1) {
 		perror("error: unable to create socket");
-		ouroboros_server_free(server);
-		return NULL;
+		return -1;
 	}
 
+	if (group != NULL &&
+			setsockopt(server->fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) == -1)
+		perror("warning: unable to share address");
+
 	if (bind(server->fd, &server->ifaddr, sizeof(server->ifaddr)) == -1) {
 		perror("error: unable to bind address");
+		return -1;
+	}
+
+	if (group != NULL && _join_group(server, group) == -1)
+		perror("warning: unable to join multicast group");
+
+	return 0;
+}
+
+/* Internal function which binds the Unix domain socket to the given path.
+ * Stale socket left by the previous instance is removed. The socket is
+ * accessible for the owner only, because it allows to control processes.
+ * On success this function returns 0, otherwise -1. */
+static int _bind_unix(struct ouroboros_server *server, const char *path) {
+
+	struct sockaddr_un addr = { 0 };
+	mode_t mask;
+	int rv;
+
+	if (path == NULL)
+		return 0;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "error: socket path too long: %s\n", path);
+		return -1;
+	}
+
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	server->ufd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if (server->ufd == -1) {
+		perror("error: unable to create socket");
+		return -1;
+	}
+
+	debug("binding to: %s", path);
+	unlink(path);
+
+	mask = umask(0077);
+	rv = bind(server->ufd, (struct sockaddr *)&addr, sizeof(addr));
+	umask(mask);
+
+	if (rv == -1) {
+		perror("error: unable to bind socket");
+		return -1;
+	}
+
+	server->path = strdup(path);
+	return 0;
+}
+
+/* Initialize server. It listens on the network interface and (or) on the
+ * Unix domain socket, if the path is given. Optionally, the network socket
+ * joins the multicast group of the fleet. This function returns pointer to
+ * the initialized server structure or NULL upon error. */
+struct ouroboros_server *ouroboros_server_init(const char *ifname, int port,
+		const char *path, const char *group) {
+
+	struct ouroboros_server *server;
+
+	if ((server = malloc(sizeof(struct ouroboros_server))) == NULL)
+		return NULL;
+
+	server->ifname = ifname != NULL ? strdup(ifname) : NULL;
+	server->ifaddr.sa_family = AF_INET;
+	((struct sockaddr_in *)(&server->ifaddr))->sin_addr.s_addr = 0;
+	server->fd = -1;
+	server->path = NULL;
+	server->ufd = -1;
+	server->size = 0;
+	server->peerfd = -1;
+	server->peerlen = 0;
+	server->peers_size = 0;
+	server->rate_limit = 0;
+	server->dropped = 0;
+
+	if (_bind_inet(server, ifname, port, group) == -1 ||
+			_bind_unix(server, path) == -1) {
 		ouroboros_server_free(server);
 		return NULL;
 	}
@@ -107,21 +214,231 @@ struct ouroboros_server *ouroboros_server_init(const char *ifname, int port) {
 
 /* Free allocated resources. */
 void ouroboros_server_free(struct ouroboros_server *server) {
-	close(server->fd);
+	if (server->fd != -1)
+		close(server->fd);
+	if (server->ufd != -1)
+		close(server->ufd);
+	if (server->path != NULL)
+		unlink(server->path);
+	free(server->path);
 	free(server->ifname);
 	free(server);
 }
 
-/* Dispatch incoming data. If reload was requested, then this function
- * returns 1. Upon error this function returns -1. */
-int ouroboros_server_dispatch(struct ouroboros_server *server) {
+/* Internal function which maps command name (and the subcommand, if there is
+ * one) to the request value. Consumed subcommand is removed from arguments. */
+static enum ouroboros_server_request _request(struct ouroboros_server_command *command) {
 
-	char buffer[32];
+	static const struct {
+		const char *name;
+		enum ouroboros_server_request request;
+	} requests[] = {
+		{ "restart", OSR_RESTART },
+		/* reload is a legacy name of the restart */
+		{ "reload", OSR_RESTART },
+		{ "signal", OSR_SIGNAL },
+		{ "stop", OSR_STOP },
+		{ "start", OSR_START },
+		{ "pause", OSR_PAUSE },
+		{ "resume", OSR_RESUME },
+		{ "status", OSR_STATUS },
+		{ "stats", OSR_STATS },
+		{ "dump", OSR_DUMP },
+		{ "change", OSR_CHANGE },
+		{ "event", OSR_EVENT },
+	};
+	size_t i;
+
+	if (strcmp(command->name, "watch") == 0 && command->args[0] != NULL) {
+		if (strcmp(command->args[0], "add") == 0 || strcmp(command->args[0], "remove") == 0) {
+			i = command->args[0][0] == 'a';
+			command->args[0] = command->args[1];
+			command->args[1] = command->args[2];
+			command->args[2] = NULL;
+			return i ? OSR_WATCH_ADD : OSR_WATCH_REMOVE;
+		}
+	}
+
+	for (i = 0; i < sizeof(requests) / sizeof(*requests); i++)
+		if (strcmp(command->name, requests[i].name) == 0)
+			return requests[i].request;
+
+	return OSR_UNKNOWN;
+}
+
+/* Dispatch incoming data from the given server socket. The request consists
+ * of commands separated by new lines or semicolons, and every command is a
+ * sequence of white-space separated words - except the change command, which
+ * takes the rest of the line as a path. Parsed commands are stored in the
+ * commands array of the server structure. This function returns the number
+ * of received commands, or -1 upon error. */
+int ouroboros_server_dispatch(struct ouroboros_server *server, int fd) {
+
+	struct ouroboros_server_command *command;
+	char *line, *word, *ptr, *tmp;
 	ssize_t rlen;
+	int i;
 
-	if ((rlen = read(server->fd, buffer, sizeof(buffer))) == -1)
+	server->size = 0;
+	server->peerfd = fd;
+	server->peerlen = sizeof(server->peer);
+	if ((rlen = recvfrom(fd, server->buffer, sizeof(server->buffer) - 1, 0,
+					(struct sockaddr *)&server->peer, &server->peerlen)) == -1) {
 		perror("warning: unable to read client data");
+		server->peerlen = 0;
+		return -1;
+	}
+
+	server->buffer[rlen] = '\0';
+	debug("message (%zd): %s", rlen, server->buffer);
+
+	for (ptr = server->buffer; (line = strsep(&ptr, "\n;")) != NULL; ) {
+
+		if (server->size == OUROBOROS_SERVER_COMMANDS) {
+			/* trailing separator does not start a new command */
+			if (line[strspn(line, " \t\r")] == '\0')
+				continue;
+			fprintf(stderr, "warning: too many commands in request\n");
+			break;
+		}
+
+		command = &server->commands[server->size];
+		command->name = NULL;
+		command->args[0] = command->args[1] = command->args[2] = NULL;
+
+		for (i = -1; (word = strtok_r(line, " \t\r", &tmp)) != NULL; line = NULL) {
+			if (i == -1) {
+				command->name = word;
+				/* changed path is taken verbatim, so it might contain spaces */
+				if (strcmp(word, "change") == 0) {
+					tmp += strspn(tmp, " \t");
+					tmp[strcspn(tmp, "\r")] = '\0';
+					if (*tmp != '\0')
+						command->args[0] = tmp;
+					break;
+				}
+			}
+			else if (i < (int)(sizeof(command->args) / sizeof(*command->args)))
+				command->args[i] = word;
+			i++;
+		}
+
+		/* skip empty commands */
+		if (command->name == NULL)
+			continue;
+
+		command->request = _request(command);
+		server->size++;
+	}
+
+	return server->size;
+}
+
+/* Send data to the sender of the last request. Data is split into several
+ * datagrams, and the end of data is denoted by an empty datagram. On success
+ * this function returns 0, otherwise -1. */
+int ouroboros_server_reply(struct ouroboros_server *server, const char *data, size_t len) {
+
+	size_t size;
+
+	/* unbound Unix domain socket can not receive replies */
+	if (server->peerlen <= sizeof(sa_family_t))
+		return -1;
+
+	do {
+		size = len < SERVER_REPLY_SIZE ? len : SERVER_REPLY_SIZE;
+		if (sendto(server->peerfd, data, size, 0,
+					(struct sockaddr *)&server->peer, server->peerlen) == -1) {
+			perror("warning: unable to send reply");
+			return -1;
+		}
+		data += size;
+		len -= size;
+	} while (size > 0);
+
+	return 0;
+}
+
+/* Check the event header received from the fleet peer. Events which have
+ * been already received (e.g. delivered via multicast and the peer list as
+ * well) are dropped, and so are events which exceed the rate limit of the
+ * peer. Every datagram has its own sequence number, however datagrams of one
+ * flush carry the sequence number of the first one as well (if omitted, the
+ * datagram is a flush on its own), so the rate limit applies to flushes -
+ * a large batch of changes is not cut in the middle. This function returns
+ * 1 if the event shall be applied, 0 if it is a duplicate (or it is
+ * malformed), and -1 if it exceeds the rate limit. */
+int ouroboros_server_event(struct ouroboros_server *server, const char *origin,
+		const char *seq, const char *flush) {
+
+	struct ouroboros_server_peer *peer = NULL;
+	unsigned long long value, first;
+	struct timespec ts;
+	char *tmp;
+	int i;
+
+	if (origin == NULL || seq == NULL || strlen(origin) >= sizeof(peer->origin))
+		return 0;
+	if ((value = strtoull(seq, &tmp, 10)) == 0 || *tmp != '\0')
+		return 0;
+	first = value;
+	if (flush != NULL &&
+			((first = strtoull(flush, &tmp, 10)) == 0 || *tmp != '\0' || first > value))
+		return 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	for (i = 0; i < server->peers_size; i++)
+		if (strcmp(server->peers[i].origin, origin) == 0) {
+			peer = &server->peers[i];
+			break;
+		}
+
+	if (peer == NULL) {
+		if (server->peers_size < OUROBOROS_SERVER_PEERS)
+			peer = &server->peers[server->peers_size++];
+		else {
+			/* replace the peer which has been silent for the longest time */
+			peer = &server->peers[0];
+			for (i = 1; i < server->peers_size; i++)
+				if (server->peers[i].second < peer->second)
+					peer = &server->peers[i];
+		}
+		debug("new fleet peer: %s", origin);
+		strcpy(peer->origin, origin);
+		peer->seq = 0;
+		peer->window = 0;
+		peer->second = 0;
+		peer->events = 0;
+		peer->flush = 0;
+		peer->limited = 0;
+	}
+
+	if (value > peer->seq) {
+		peer->window = value - peer->seq < 64 ? peer->window << (value - peer->seq) : 0;
+		peer->window |= 1;
+		peer->seq = value;
+	}
+	else {
+		if (peer->seq - value >= 64 || peer->window & (1ULL << (peer->seq - value)))
+			return 0;
+		peer->window |= 1ULL << (peer->seq - value);
+	}
+
+	/* datagrams of one flush share the verdict of the first received one */
+	if (first != peer->flush) {
+		if (peer->second != ts.tv_sec) {
+			peer->second = ts.tv_sec;
+			peer->events = 0;
+		}
+		peer->flush = first;
+		peer->limited = server->rate_limit > 0 && ++peer->events > server->rate_limit;
+	}
+
+	if (peer->limited) {
+		server->dropped++;
+		return -1;
+	}
 
-	debug("message (%zd): %s", rlen, buffer);
-	return rlen > 0 ? 1 : 0;
+	return 1;
 }
@@ -11,9 +11,66 @@
 #ifndef __SERVER_H
 #define __SERVER_H
 
+#include <stdint.h>
+#include <time.h>
 #include <sys/socket.h>
 
 
+/* the maximum size of the request datagram */
+#define OUROBOROS_SERVER_REQUEST_SIZE 4096
+/* the maximum number of commands batched in a single request */
+#define OUROBOROS_SERVER_COMMANDS 32
+/* the maximum number of tracked fleet peers */
+#define OUROBOROS_SERVER_PEERS 64
+
+
+/* requests returned by the dispatcher */
+enum ouroboros_server_request {
+	OSR_NONE = 0,
+	OSR_UNKNOWN,
+	OSR_RESTART,
+	OSR_SIGNAL,
+	OSR_STOP,
+	OSR_START,
+	OSR_PAUSE,
+	OSR_RESUME,
+	OSR_WATCH_ADD,
+	OSR_WATCH_REMOVE,
+	OSR_STATUS,
+	OSR_STATS,
+	OSR_DUMP,
+	OSR_CHANGE,
+	OSR_EVENT,
+};
+
+
+/* single command of the control protocol */
+struct ouroboros_server_command {
+	enum ouroboros_server_request request;
+	/* command name and arguments - NULL if omitted */
+	const char *name;
+	const char *args[3];
+};
+
+/* publisher of events received by the server */
+struct ouroboros_server_peer {
+
+	char origin[17];
+
+	/* the highest received sequence number and the bitmap of recently
+	 * received ones, so reordered events are not taken as duplicates */
+	unsigned long long seq;
+	uint64_t window;
+
+	/* events received within the current second - all datagrams published
+	 * by one flush are accounted as a single event */
+	time_t second;
+	int events;
+	unsigned long long flush;
+	int limited;
+
+};
+
 struct ouroboros_server {
 
 	/* interface binding */
@@ -21,12 +78,37 @@ struct ouroboros_server {
 	struct sockaddr ifaddr;
 	int fd;
 
+	/* Unix domain socket binding */
+	char *path;
+	int ufd;
+
+	/* commands of the last request - they refer to the buffer */
+	char buffer[OUROBOROS_SERVER_REQUEST_SIZE];
+	struct ouroboros_server_command commands[OUROBOROS_SERVER_COMMANDS];
+	int size;
+
+	/* the socket and the sender of the last request */
+	int peerfd;
+	struct sockaddr_storage peer;
+	socklen_t peerlen;
+
+	/* fleet peers tracking */
+	struct ouroboros_server_peer peers[OUROBOROS_SERVER_PEERS];
+	int peers_size;
+	/* the maximum number of events per second accepted from one peer */
+	int rate_limit;
+	unsigned long long dropped;
+
 };
 
 
-struct ouroboros_server *ouroboros_server_init(const char *ifname, int port);
+struct ouroboros_server *ouroboros_server_init(const char *ifname, int port,
+		const char *path, const char *group);
 void ouroboros_server_free(struct ouroboros_server *server);
 
-int ouroboros_server_dispatch(struct ouroboros_server *server);
+int ouroboros_server_dispatch(struct ouroboros_server *server, int fd);
+int ouroboros_server_reply(struct ouroboros_server *server, const char *data, size_t len);
+int ouroboros_server_event(struct ouroboros_server *server, const char *origin,
+		const char *seq, const char *flush);
 
 #endif
@@ -0,0 +1,434 @@
+/*
+ * ouroboros - service.c
+ * Copyright (c) 2015 Arkadiusz Bokowy
+ *
+ * This file is a part of a ouroboros.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+#define _GNU_SOURCE
+#include "service.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "debug.h"
+
+
+/* Internal function which resolves given path into the canonical form, so
+ * paths reported by the notification subsystem can be compared with service
+ * scopes. Path of the removed node can not be resolved, so in such a case
+ * only its parent directory is resolved. Returned string shall be freed with
+ * the free() function. */
+static char *_canonical(const char *path) {
+
+	char *tmp, *dir, *name;
+	char *rv;
+
+	if ((rv = realpath(path, NULL)) != NULL)
+		return rv;
+
+	if ((tmp = strdup(path)) == NULL)
+		return NULL;
+
+	if ((name = strrchr(tmp, '/')) != NULL) {
+		*name++ = '\0';
+		dir = realpath(*tmp ? tmp : "/", NULL);
+	}
+	else {
+		name = tmp;
+		dir = realpath(".", NULL);
+	}
+
+	if (dir == NULL || asprintf(&rv, "%s/%s", strcmp(dir, "/") ? dir : "", name) == -1)
+		rv = strdup(path);
+
+	free(dir);
+	free(tmp);
+	return rv;
+}
+
+/* Internal function which schedules pending action after given delay. */
+static void _schedule(struct ouroboros_service *service,
+		enum ouroboros_service_action action, double delay) {
+	service->action = action;
+	service->start_pending = 0;
+	ouroboros_loop_timer_set(service->timer, delay, 0);
+}
+
+/* Internal function which kills the service process. The process is reaped
+ * by the _service_reap() once it terminates, or it is killed with SIGKILL
+ * by the _service_kill_timeout() if it ignores the kill signal. */
+static void _kill(struct ouroboros_service *service) {
+	if (service->process.killing)
+		return;
+	kill_ouroboros_process(&service->process);
+	if (service->process.pid)
+		ouroboros_loop_timer_set(service->kill_timer, OUROBOROS_PROCESS_KILL_TIMEOUT, 0);
+}
+
+/* Initialize service scope. Given paths are resolved into the canonical form,
+ * and if there are no paths at all, the scope covers everything. On success
+ * this function returns 0, otherwise -1. */
+int ouroboros_service_scope_init(struct ouroboros_service_scope *scope,
+		char **paths, char **includes, char **excludes) {
+
+	char *tmp;
+
+	scope->paths = NULL;
+	for (; paths != NULL && *paths != NULL; paths++) {
+		if ((tmp = _canonical(*paths)) == NULL)
+			return -1;
+		ouroboros_config_add_string(&scope->paths, tmp);
+		free(tmp);
+	}
+
+	ouroboros_notify_patterns_compile(&scope->include, includes);
+	ouroboros_notify_patterns_compile(&scope->exclude, excludes);
+	return 0;
+}
+
+/* Free allocated resources. */
+void ouroboros_service_scope_free(struct ouroboros_service_scope *scope) {
+
+	ouroboros_service_watch_paths_free(scope->paths);
+	scope->paths = NULL;
+
+	ouroboros_notify_patterns_free(&scope->include);
+	ouroboros_notify_patterns_free(&scope->exclude);
+}
+
+/* Internal function which checks whether given canonical path is located
+ * within one of canonical directories. */
+static int _covered(char **dirs, const char *path) {
+
+	size_t len;
+
+	for (; dirs != NULL && *dirs != NULL; dirs++) {
+		len = strlen(*dirs);
+		if (strncmp(path, *dirs, len) == 0 &&
+				(path[len] == '/' || path[len] == '\0' || strcmp(*dirs, "/") == 0))
+			return 1;
+	}
+
+	return 0;
+}
+
+/* Check whether given canonical path belongs to the scope. If so, this
+ * function returns 1, otherwise 0. */
+int ouroboros_service_scope_contains(const struct ouroboros_service_scope *scope,
+		const char *path) {
+
+	const char *name;
+
+	if (scope->paths != NULL && !_covered(scope->paths, path))
+		return 0;
+
+	/* patterns are matched against the node name - in the same way as it is
+	 * done by the notification subsystem */
+	name = (name = strrchr(path, '/')) != NULL ? name + 1 : path;
+	if (scope->include.size && !ouroboros_notify_patterns_match(&scope->include, name))
+		return 0;
+	return !ouroboros_notify_patterns_match(&scope->exclude, name);
+}
+
+/* Check whether any of the given changes belongs to the scope. If so, this
+ * function returns 1, otherwise 0. */
+int ouroboros_service_scope_match(const struct ouroboros_service_scope *scope,
+		char **changes) {
+
+	char *path;
+	int rv = 0;
+
+	/* scope which covers everything does not need path resolving */
+	if (scope->paths == NULL && !scope->include.size && !scope->exclude.size)
+		return 1;
+
+	for (; !rv && changes != NULL && *changes != NULL; changes++) {
+		if ((path = _canonical(*changes)) == NULL)
+			continue;
+		rv = ouroboros_service_scope_contains(scope, path);
+		free(path);
+	}
+
+	return rv;
+}
+
+/* Get the list of directories which have to be watched in order to cover
+ * scopes of all configured services. If the global flag is true, globally
+ * configured directories are included as well. In the recursive mode nested
+ * directories are skipped, because they are watched anyway. Returned array
+ * shall be freed with the ouroboros_service_watch_paths_free() function. */
+char **ouroboros_service_watch_paths(const struct ouroboros_config *config, int global) {
+
+	char *defaults[] = { ".", NULL };
+	char **globals = config->watch_paths != NULL ? config->watch_paths : defaults;
+	char **canonical = NULL;
+	char **paths = NULL;
+	char **tmp;
+	char *path;
+	int i;
+
+	/* service without paths covers the whole global scope */
+	for (i = 0; i < config->services_size; i++)
+		if (config->services[i].watch_paths == NULL)
+			global = 1;
+
+	for (i = global ? -1 : 0; i < config->services_size; i++) {
+		for (tmp = i == -1 ? globals : config->services[i].watch_paths;
+				tmp != NULL && *tmp != NULL; tmp++) {
+			if ((path = _canonical(*tmp)) == NULL)
+				continue;
+			if (!config->watch_recursive || !_covered(canonical, path)) {
+				ouroboros_config_add_string(&paths, *tmp);
+				ouroboros_config_add_string(&canonical, path);
+			}
+			free(path);
+		}
+	}
+
+	ouroboros_service_watch_paths_free(canonical);
+	return paths;
+}
+
+/* Free array returned by the ouroboros_service_watch_paths() function. */
+void ouroboros_service_watch_paths_free(char **paths) {
+	char **tmp;
+	for (tmp = paths; tmp != NULL && *tmp != NULL; tmp++)
+		free(*tmp);
+	free(paths);
+}
+
+static void _service_dispatch(struct ouroboros_loop_source *source,
+		uint32_t events, void *userdata);
+static void _service_kill_timeout(struct ouroboros_loop_source *source,
+		uint32_t events, void *userdata);
+
+/* Initialize named service from the given configuration. Settings which are
+ * not specific for the service are taken from the global configuration. The
+ * service is scheduled to start right away. On success this function returns
+ * 0, otherwise -1. */
+int ouroboros_service_init(struct ouroboros_service *service,
+		const struct ouroboros_config_service *config,
+		const struct ouroboros_config *defaults, struct ouroboros_loop *loop) {
+
+	service->name = config->name;
+	service->output = NULL;
+	service->kill_latency = config->kill_latency;
+	service->start_latency = config->start_latency;
+	service->action = OSA_NONE;
+	service->start_pending = 0;
+	service->source = NULL;
+	service->crash_restart = defaults->crash_restart;
+	service->halted = 0;
+	service->starts = 0;
+	service->verbose = 0;
+
+	ouroboros_process_init(&service->process, config->command[0], config->command);
+	service->process.signal = config->kill_signal;
+	/* Killing process group of one service shall not affect others. Also,
+	 * we do not want to be killed as a member of the service group. */
+	service->process.pgroup = 1;
+
+	ouroboros_crash_init(&service->crash, defaults->crash_restart_limit,
+			defaults->crash_restart_window, defaults->crash_backoff_min,
+			defaults->crash_backoff_max);
+
+	if ((service->timer = ouroboros_loop_timer(loop, _service_dispatch, service)) == NULL)
+		return -1;
+	if ((service->kill_timer = ouroboros_loop_timer(loop, _service_kill_timeout, service)) == NULL)
+		return -1;
+
+	if (ouroboros_service_scope_init(&service->scope, config->watch_paths,
+				config->watch_includes, config->watch_excludes) == -1)
+		return -1;
+
+	if (config->redirect_output != NULL && !defaults->output_timestamps &&
+			!defaults->output_markers && defaults->output_rotate_size <= 0) {
+		if ((service->process.outfd = ouroboros_output_open(config->redirect_output)) == -1)
+			return -1;
+	}
+	else if (config->redirect_output != NULL) {
+		if ((service->output = ouroboros_output_init(config->redirect_output, 0)) == NULL)
+			return -1;
+		ouroboros_output_timestamps(service->output, defaults->output_timestamps);
+		ouroboros_output_markers(service->output, defaults->output_markers);
+		ouroboros_output_rotate(service->output, (off_t)defaults->output_rotate_size * 1024,
+				defaults->output_rotate_count);
+		if (ouroboros_output_start(service->output) == -1)
+			return -1;
+		service->process.outfd = service->output->pipe[1];
+	}
+
+	_schedule(service, OSA_START, 0);
+	return 0;
+}
+
+/* Free allocated resources. Running process is killed. */
+void ouroboros_service_free(struct ouroboros_service *service) {
+	ouroboros_loop_remove(service->source);
+	ouroboros_loop_remove(service->timer);
+	ouroboros_loop_remove(service->kill_timer);
+	terminate_ouroboros_process(&service->process);
+	ouroboros_process_free(&service->process);
+	if (service->output != NULL)
+		ouroboros_output_free(service->output);
+	else if (service->process.outfd != -1)
+		close(service->process.outfd);
+	ouroboros_service_scope_free(&service->scope);
+}
+
+/* Schedule restart of the service. Consecutive triggers postpone the restart,
+ * so a burst of modifications will restart the service only once. */
+void ouroboros_service_trigger(struct ouroboros_service *service) {
+	debug("service triggered: %s", service->name);
+	if (!service->halted)
+		_schedule(service, OSA_KILL, service->kill_latency);
+}
+
+/* Stop the service. It will not be restarted - neither upon modifications
+ * nor upon crash - until it is started with ouroboros_service_start(). */
+void ouroboros_service_stop(struct ouroboros_service *service) {
+	_schedule(service, OSA_NONE, -1);
+	_kill(service);
+	service->halted = 1;
+}
+
+/* Start stopped service. If the service is already running, this function
+ * returns -1, otherwise 0. */
+int ouroboros_service_start(struct ouroboros_service *service) {
+	if (service->process.pid && !service->process.killing)
+		return -1;
+	service->halted = 0;
+	_schedule(service, OSA_START, 0);
+	return 0;
+}
+
+/* Internal callback which collects the exit status of the terminated service
+ * process. If crash supervision is enabled, failed process is scheduled for
+ * restart. */
+static void _service_reap(struct ouroboros_loop_source *source,
+		uint32_t events, void *userdata) {
+
+	struct ouroboros_service *service = userdata;
+	struct ouroboros_process *process = &service->process;
+	int killing = process->killing;
+	double delay;
+
+	ouroboros_loop_remove(service->source);
+	service->source = NULL;
+
+	if (!reap_ouroboros_process(process))
+		return;
+
+	/* process has been killed on purpose */
+	if (killing) {
+		ouroboros_loop_timer_set(service->kill_timer, -1, 0);
+		if (service->start_pending)
+			_schedule(service, OSA_START, 0);
+		return;
+	}
+
+	if (service->verbose) {
+		if (WIFSIGNALED(process->status))
+			fprintf(stderr, "[%s] Process killed by signal: %s\n", service->name,
+					strsignal(WTERMSIG(process->status)));
+		else
+			fprintf(stderr, "[%s] Process exited with status: %d\n", service->name,
+					WEXITSTATUS(process->status));
+	}
+
+	if (!service->crash_restart || service->action != OSA_NONE || service->halted ||
+			!ouroboros_crash_is_failure(process->status))
+		return;
+
+	delay = ouroboros_crash_record(&service->crash, process->status,
+			get_ouroboros_process_uptime(process));
+	if (delay < 0) {
+		fprintf(stderr, "warning: [%s] restart limit reached, waiting for modifications\n",
+				service->name);
+		return;
+	}
+
+	_schedule(service, OSA_START, delay);
+}
+
+/* Reap the service process which can not be watched with the pidfd, if it
+ * has terminated. This function shall be called upon the SIGCHLD. */
+void ouroboros_service_reap(struct ouroboros_service *service) {
+	if (service->process.pid && service->process.pidfd == -1)
+		_service_reap(NULL, 0, service);
+}
+
+/* Internal callback which kills the service process with SIGKILL, if it has
+ * not terminated in time. */
+static void _service_kill_timeout(struct ouroboros_loop_source *source,
+		uint32_t events, void *userdata) {
+	struct ouroboros_service *service = userdata;
+	if (service->process.pid == 0 || !service->process.killing)
+		return;
+	fprintf(stderr, "warning: [%s] process has not terminated, sending SIGKILL\n",
+			service->name);
+	force_kill_ouroboros_process(&service->process);
+}
+
+/* Internal callback which performs pending action, when its timer expires. */
+static void _service_dispatch(struct ouroboros_loop_source *source,
+		uint32_t events, void *userdata) {
+
+	struct ouroboros_service *service = userdata;
+
+	switch (service->action) {
+	case OSA_NONE:
+		break;
+
+	case OSA_KILL:
+		_kill(service);
+		/* restart on purpose - forget about previous crashes */
+		ouroboros_crash_reset(&service->crash);
+		_schedule(service, OSA_START, service->start_latency);
+		break;
+
+	case OSA_START:
+
+		/* previous instance has to terminate first */
+		if (service->process.pid) {
+			_kill(service);
+			service->start_pending = 1;
+			break;
+		}
+
+		service->action = OSA_NONE;
+
+		if (service->verbose)
+			fprintf(stderr, "[%s] Running command: %s\n", service->name, service->process.file);
+
+		if (service->output != NULL)
+			ouroboros_output_mark(service->output);
+		/* leftovers of the crashed process */
+		kill_ouroboros_process(&service->process);
+		if (start_ouroboros_process(&service->process) == -1)
+			fprintf(stderr, "error: [%s] process starting failed\n", service->name);
+		service->starts++;
+
+		if (service->process.pidfd != -1)
+			service->source = ouroboros_loop_add(source->loop, service->process.pidfd,
+					EPOLLIN, _service_reap, service);
+
+		if (service->verbose && service->process.pid)
+			fprintf(stderr, "[%s] Process ID: %d\n", service->name, service->process.pid);
+
+		break;
+	}
+
+}
@@ -0,0 +1,90 @@
+/*
+ * ouroboros - service.h
+ * Copyright (c) 2015 Arkadiusz Bokowy
+ *
+ * This file is a part of a ouroboros.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef __SERVICE_H
+#define __SERVICE_H
+
+#include "config.h"
+#include "crash.h"
+#include "loop.h"
+#include "notify.h"
+#include "output.h"
+#include "process.h"
+
+
+/* pending service actions */
+enum ouroboros_service_action {
+	OSA_NONE = 0,
+	OSA_KILL,
+	OSA_START,
+};
+
+
+/* part of the watched tree which belongs to the service */
+struct ouroboros_service_scope {
+	/* canonical directory paths (NULL means everything) */
+	char **paths;
+	struct ouroboros_notify_patterns include;
+	struct ouroboros_notify_patterns exclude;
+};
+
+struct ouroboros_service {
+
+	const char *name;
+	struct ouroboros_process process;
+	struct ouroboros_output *output;
+	struct ouroboros_service_scope scope;
+
+	/* restart timing */
+	double kill_latency;
+	double start_latency;
+	enum ouroboros_service_action action;
+	struct ouroboros_loop_source *timer;
+	/* start is waiting for the termination of the killed process */
+	int start_pending;
+	/* process termination */
+	struct ouroboros_loop_source *source;
+	struct ouroboros_loop_source *kill_timer;
+
+	/* crash supervision */
+	int crash_restart;
+	struct ouroboros_crash crash;
+
+	/* stopped on request - not restarted until started explicitly */
+	int halted;
+	unsigned int starts;
+
+	int verbose;
+
+};
+
+
+int ouroboros_service_scope_init(struct ouroboros_service_scope *scope,
+		char **paths, char **includes, char **excludes);
+void ouroboros_service_scope_free(struct ouroboros_service_scope *scope);
+int ouroboros_service_scope_contains(const struct ouroboros_service_scope *scope,
+		const char *path);
+int ouroboros_service_scope_match(const struct ouroboros_service_scope *scope,
+		char **changes);
+
+char **ouroboros_service_watch_paths(const struct ouroboros_config *config, int global);
+void ouroboros_service_watch_paths_free(char **paths);
+
+int ouroboros_service_init(struct ouroboros_service *service,
+		const struct ouroboros_config_service *config,
+		const struct ouroboros_config *defaults, struct ouroboros_loop *loop);
+void ouroboros_service_free(struct ouroboros_service *service);
+
+void ouroboros_service_trigger(struct ouroboros_service *service);
+void ouroboros_service_stop(struct ouroboros_service *service);
+int ouroboros_service_start(struct ouroboros_service *service);
+void ouroboros_service_reap(struct ouroboros_service *service);
+
+#endif
@@ -0,0 +1,162 @@
+/*
+ * ouroboros - trace.c
+ * Copyright (c) 2015 Arkadiusz Bokowy
+ *
+ * This file is a part of a ouroboros.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#define _GNU_SOURCE
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "debug.h"
+
+
+struct ouroboros_trace *ouroboros_trace = NULL;
+
+/* thread ID cached by every thread, so the system call is made only once */
+static __thread pid_t _tid = 0;
+
+
+/* Initialize the tracer. Events are written into the given file (in the
+ * Chrome trace-event format) upon the flush. This function returns pointer
+ * to the initialized structure or NULL upon error. */
+struct ouroboros_trace *ouroboros_trace_init(const char *path) {
+
+	struct ouroboros_trace *trace;
+
+	if ((trace = malloc(sizeof(struct ouroboros_trace))) == NULL)
+		return NULL;
+
+	trace->head = 0;
+	trace->path = strdup(path);
+	trace->events = calloc(OUROBOROS_TRACE_EVENTS, sizeof(*trace->events));
+	if (trace->path == NULL || trace->events == NULL) {
+		ouroboros_trace_free(trace);
+		return NULL;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &trace->started);
+	return trace;
+}
+
+/* Free allocated resources. */
+void ouroboros_trace_free(struct ouroboros_trace *trace) {
+	free(trace->path);
+	free(trace->events);
+	free(trace);
+}
+
+/* Record the event. If the start time is given, the event is a span which
+ * ends right now, otherwise it is an instant event. This function might be
+ * called from any thread. */
+void ouroboros_trace_add(struct ouroboros_trace *trace, const char *name,
+		const struct timespec *ts, const char *arg) {
+
+	struct ouroboros_trace_event *event;
+	struct timespec now;
+	unsigned long seq;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (_tid == 0)
+		_tid = syscall(SYS_gettid);
+
+	seq = __atomic_fetch_add(&trace->head, 1, __ATOMIC_RELAXED);
+	event = &trace->events[seq % OUROBOROS_TRACE_EVENTS];
+
+	/* mark the slot as being written */
+	__atomic_store_n(&event->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	event->name = name;
+	event->tid = _tid;
+	event->arg[0] = '\0';
+	if (arg != NULL)
+		strncat(event->arg, arg, sizeof(event->arg) - 1);
+
+	if (ts != NULL) {
+		event->ts = *ts;
+		event->duration = (now.tv_sec - ts->tv_sec) * 1000000000L + now.tv_nsec - ts->tv_nsec;
+	}
+	else {
+		event->ts = now;
+		event->duration = -1;
+	}
+
+	__atomic_store_n(&event->seq, seq + 1, __ATOMIC_RELEASE);
+
+}
+
+/* Internal function which writes JSON string with escaped characters. */
+static void _print_string(FILE *f, const char *str) {
+	fputc('"', f);
+	for (; *str != '\0'; str++)
+		if (*str == '"' || *str == '\\')
+			fprintf(f, "\\%c", *str);
+		else if ((unsigned char)*str < 0x20)
+			fprintf(f, "\\u%04x", *str);
+		else
+			fputc(*str, f);
+	fputc('"', f);
+}
+
+/* Write recorded events into the trace file. The file is rewritten on every
+ * call, so it is always a valid JSON document. On success this function
+ * returns 0, otherwise -1. */
+int ouroboros_trace_flush(struct ouroboros_trace *trace) {
+
+	struct ouroboros_trace_event event;
+	unsigned long head = __atomic_load_n(&trace->head, __ATOMIC_ACQUIRE);
+	unsigned long seq = head > OUROBOROS_TRACE_EVENTS ? head - OUROBOROS_TRACE_EVENTS : 0;
+	const char *separator = "";
+	FILE *f;
+
+	if ((f = fopen(trace->path, "w")) == NULL) {
+		perror("warning: unable to write trace file");
+		return -1;
+	}
+
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+	for (; seq < head; seq++) {
+		struct ouroboros_trace_event *slot = &trace->events[seq % OUROBOROS_TRACE_EVENTS];
+
+		/* the slot might be overwritten while we are reading it */
+		if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != seq + 1)
+			continue;
+		event = *slot;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq + 1)
+			continue;
+
+		fprintf(f, "%s\n{\"name\":\"%s\",\"cat\":\"ouroboros\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,",
+				separator, event.name, getpid(), event.tid,
+				(event.ts.tv_sec - trace->started.tv_sec) * 1e6 +
+				(event.ts.tv_nsec - trace->started.tv_nsec) / 1e3);
+		if (event.duration >= 0)
+			fprintf(f, "\"ph\":\"X\",\"dur\":%.3f", event.duration / 1e3);
+		else
+			fprintf(f, "\"ph\":\"i\",\"s\":\"t\"");
+		if (event.arg[0] != '\0') {
+			fprintf(f, ",\"args\":{\"arg\":");
+			_print_string(f, event.arg);
+			fputc('}', f);
+		}
+		fputc('}', f);
+
+		separator = ",";
+	}
+
+	fprintf(f, "\n]}\n");
+
+	debug("trace events written: %lu", head);
+	return fclose(f) == 0 ? 0 : -1;
+}
@@ -0,0 +1,75 @@
+/*
+ * ouroboros - trace.h
+ * Copyright (c) 2015 Arkadiusz Bokowy
+ *
+ * This file is a part of a ouroboros.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include <sys/types.h>
+#include <time.h>
+
+
+/* the number of the most recent events kept in the buffer */
+#define OUROBOROS_TRACE_EVENTS 8192
+/* the maximum length of the event argument (e.g. the path) */
+#define OUROBOROS_TRACE_ARG_SIZE 112
+
+
+/* Tracing is disabled unless the tracer is initialized, and then the cost
+ * of every trace point is a single pointer check. These macros shall be
+ * used instead of calling tracer functions directly. */
+#define trace_mark(ts) do { \
+	if (ouroboros_trace != NULL) clock_gettime(CLOCK_MONOTONIC, ts); } while (0)
+#define trace_span(name, ts, arg) do { \
+	if (ouroboros_trace != NULL) ouroboros_trace_add(ouroboros_trace, name, ts, arg); } while (0)
+#define trace_instant(name, arg) do { \
+	if (ouroboros_trace != NULL) ouroboros_trace_add(ouroboros_trace, name, NULL, arg); } while (0)
+
+
+/* single span (or instant event if the duration is negative) */
+struct ouroboros_trace_event {
+
+	/* sequence number of the event stored in the slot, so the flush can
+	 * skip slots which are being written at the moment */
+	unsigned long seq;
+
+	const char *name;
+	char arg[OUROBOROS_TRACE_ARG_SIZE];
+	pid_t tid;
+
+	struct timespec ts;
+	long duration;
+
+};
+
+struct ouroboros_trace {
+
+	char *path;
+	/* the origin of the time axis */
+	struct timespec started;
+
+	/* Ring buffer of events shared by all threads. Writers claim slots
+	 * with an atomic increment, so no locking is required. */
+	struct ouroboros_trace_event *events;
+	unsigned long head;
+
+};
+
+
+/* global tracer instance - NULL if tracing is disabled */
+extern struct ouroboros_trace *ouroboros_trace;
+
+struct ouroboros_trace *ouroboros_trace_init(const char *path);
+void ouroboros_trace_free(struct ouroboros_trace *trace);
+
+void ouroboros_trace_add(struct ouroboros_trace *trace, const char *name,
+		const struct timespec *ts, const char *arg);
+int ouroboros_trace_flush(struct ouroboros_trace *trace);
+
+#endif
@@ -0,0 +1,160 @@
+/*
+ * ouroboros - vcs.c
+ * Copyright (c) 2015 Arkadiusz Bokowy
+ *
+ * This file is a part of a ouroboros.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include "vcs.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "config.h"
+#include "debug.h"
+
+
+/* Files and directories which exist within the git directory while the
+ * operation which modifies the working tree is in progress. Note, that the
+ * merge and rebase might be stopped (e.g. due to conflicts) until they are
+ * concluded by the user. */
+static const char *markers[] = {
+	"index.lock",
+	"rebase-merge",
+	"rebase-apply",
+	"MERGE_HEAD",
+	"CHERRY_PICK_HEAD",
+	"REVERT_HEAD",
+	NULL,
+};
+
+
+/* Internal function which gets the git directory of the repository which
+ * contains the given directory. The ".git" might be a file (linked work tree
+ * or submodule) with the location of the actual git directory. Returned
+ * string shall be freed with the free(). Upon error this function returns
+ * NULL. */
+static char *_git_dir(const char *dir) {
+
+	char path[PATH_MAX + 16];
+	char gitdir[PATH_MAX];
+	char tmp[PATH_MAX];
+	struct stat s;
+	char *slash;
+	FILE *f;
+
+	if (realpath(dir, tmp) == NULL)
+		return NULL;
+
+	for (;;) {
+
+		snprintf(path, sizeof(path), "%s/.git", strcmp(tmp, "/") == 0 ? "" : tmp);
+		if (stat(path, &s) == 0) {
+
+			if (S_ISDIR(s.st_mode))
+				return strdup(path);
+
+			if ((f = fopen(path, "r")) == NULL)
+				return NULL;
+			slash = fgets(path, sizeof(path), f);
+			fclose(f);
+
+			if (slash == NULL || strncmp(path, "gitdir: ", 8) != 0)
+				return NULL;
+			path[strcspn(path, "\n")] = '\0';
+
+			/* relative location is resolved against the work tree */
+			if (path[8] != '/') {
+				if (snprintf(gitdir, sizeof(gitdir), "%s/%s", tmp, &path[8]) >= (int)sizeof(gitdir))
+					return NULL;
+				return strdup(gitdir);
+			}
+			return strdup(&path[8]);
+		}
+
+		if ((slash = strrchr(tmp, '/')) == NULL || strcmp(tmp, "/") == 0)
+			return NULL;
+		/* go up to the parent directory (keep the root slash) */
+		*(slash == tmp ? slash + 1 : slash) = '\0';
+
+	}
+
+}
+
+/* Initialize version control awareness for given watched paths. Paths
+ * which are not a part of any git repository are omitted. This function
+ * returns pointer to the initialized structure or NULL upon error. */
+struct ouroboros_vcs *ouroboros_vcs_init(char **paths) {
+
+	struct ouroboros_vcs *vcs;
+	struct stat s;
+	char *dir, *tmp;
+	char **ptr;
+
+	if ((vcs = malloc(sizeof(struct ouroboros_vcs))) == NULL)
+		return NULL;
+
+	vcs->dirs = NULL;
+
+	for (; paths != NULL && *paths != NULL; paths++) {
+
+		/* the git directory of the single-file path is looked up from
+		 * the directory containing that file */
+		dir = strdup(*paths);
+		if (stat(dir, &s) == 0 && !S_ISDIR(s.st_mode)) {
+			if ((tmp = strrchr(dir, '/')) == NULL)
+				strcpy(dir, ".");
+			else
+				*(tmp == dir ? tmp + 1 : tmp) = '\0';
+		}
+
+		tmp = _git_dir(dir);
+		free(dir);
+		if (tmp == NULL)
+			continue;
+
+		for (ptr = vcs->dirs; ptr != NULL && *ptr != NULL; ptr++)
+			if (strcmp(*ptr, tmp) == 0)
+				break;
+		if (ptr == NULL || *ptr == NULL) {
+			debug("git directory: %s", tmp);
+			ouroboros_config_add_string(&vcs->dirs, tmp);
+		}
+		free(tmp);
+
+	}
+
+	return vcs;
+}
+
+/* Free allocated resources. */
+void ouroboros_vcs_free(struct ouroboros_vcs *vcs) {
+	ouroboros_config_free_strings(&vcs->dirs);
+	free(vcs);
+}
+
+/* Check whether the operation which modifies the working tree is in
+ * progress in any of the repositories. If so, this function returns the
+ * name of the found marker, otherwise NULL. */
+const char *ouroboros_vcs_busy(const struct ouroboros_vcs *vcs) {
+
+	char path[PATH_MAX + 32];
+	struct stat s;
+	char **dir;
+	int i;
+
+	for (dir = vcs->dirs; dir != NULL && *dir != NULL; dir++)
+		for (i = 0; markers[i] != NULL; i++) {
+			snprintf(path, sizeof(path), "%s/%s", *dir, markers[i]);
+			if (lstat(path, &s) == 0)
+				return markers[i];
+		}
+
+	return NULL;
+}
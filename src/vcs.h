@@ -0,0 +1,38 @@
+/*
+ * ouroboros - vcs.h
+ * Copyright (c) 2015 Arkadiusz Bokowy
+ *
+ * This file is a part of a ouroboros.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef __VCS_H
+#define __VCS_H
+
+
+/* interval (in seconds) between checks of the in-progress operation */
+#define OUROBOROS_VCS_INTERVAL 0.25
+/* the maximum time (in seconds) for which changes are held - the lock might
+ * be a stale one, e.g. left by the killed git process */
+#define OUROBOROS_VCS_MAX_HOLD 60
+
+
+/* Version control awareness. Operations like checkout or rebase update the
+ * working tree file by file, so changes made in the meantime shall not
+ * trigger restarts - the tree is not consistent until they are finished. */
+struct ouroboros_vcs {
+
+	/* git directories of repositories containing watched paths */
+	char **dirs;
+
+};
+
+
+struct ouroboros_vcs *ouroboros_vcs_init(char **paths);
+void ouroboros_vcs_free(struct ouroboros_vcs *vcs);
+
+const char *ouroboros_vcs_busy(const struct ouroboros_vcs *vcs);
+
+#endif
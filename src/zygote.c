@@ -0,0 +1,274 @@
+/*
+ * ouroboros - zygote.c
+ * Copyright (c) 2015 Arkadiusz Bokowy
+ *
+ * This file is a part of a ouroboros.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include "zygote.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "debug.h"
+
+
+/* Initialize zygote (fork-server) for the given preloader command. The
+ * preloader is not started until the first fork request. This function
+ * returns pointer to the initialized zygote structure or NULL upon error. */
+struct ouroboros_zygote *ouroboros_zygote_init(char **argv, char **patterns) {
+
+	struct ouroboros_zygote *zygote;
+
+	if ((zygote = malloc(sizeof(struct ouroboros_zygote))) == NULL)
+		return NULL;
+
+	ouroboros_process_init(&zygote->process, argv[0], argv);
+	/* killing workers shall not kill the zygote itself */
+	zygote->process.pgroup = 1;
+	ouroboros_notify_patterns_compile(&zygote->invalidate, patterns);
+	zygote->fd = -1;
+	zygote->invalid = 0;
+	zygote->worker = NULL;
+	zygote->requests = 0;
+	zygote->canceled = 0;
+	zygote->retried = 0;
+
+	return zygote;
+}
+
+/* Internal function which terminates the preloader process. */
+static void _zygote_stop(struct ouroboros_zygote *zygote) {
+	if (zygote->fd != -1) {
+		close(zygote->fd);
+		zygote->fd = -1;
+	}
+	/* pending requests will not be answered */
+	zygote->requests = 0;
+	zygote->canceled = 0;
+	kill_ouroboros_process(&zygote->process);
+}
+
+/* Free allocated resources. */
+void ouroboros_zygote_free(struct ouroboros_zygote *zygote) {
+	_zygote_stop(zygote);
+	ouroboros_process_free(&zygote->process);
+	ouroboros_notify_patterns_free(&zygote->invalidate);
+	free(zygote);
+}
+
+/* Internal function which starts the preloader process with the control
+ * socket passed via the environment variable. On success this function
+ * returns 0, otherwise -1. */
+static int _zygote_start(struct ouroboros_zygote *zygote) {
+
+	char tmp[16];
+	int fds[2];
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) == -1) {
+		perror("error: unable to create zygote socket");
+		return -1;
+	}
+
+	/* preloader end of the socket has to survive the exec */
+	fcntl(fds[1], F_SETFD, 0);
+	sprintf(tmp, "%d", fds[1]);
+	setenv(OUROBOROS_ZYGOTE_ENV, tmp, 1);
+
+	start_ouroboros_process(&zygote->process);
+
+	unsetenv(OUROBOROS_ZYGOTE_ENV);
+	close(fds[1]);
+
+	if (zygote->process.pid == 0) {
+		close(fds[0]);
+		return -1;
+	}
+
+	zygote->fd = fds[0];
+	zygote->invalid = 0;
+
+	debug("zygote started: pid=%d", zygote->process.pid);
+	return 0;
+}
+
+/* Check whether given paths invalidate preloaded state. If so, the zygote
+ * will be restarted before the next fork and this function returns 1. */
+int ouroboros_zygote_check(struct ouroboros_zygote *zygote, char **paths) {
+
+	if (paths == NULL)
+		return zygote->invalid;
+
+	for (; *paths != NULL; paths++)
+		if (ouroboros_notify_patterns_match(&zygote->invalidate, *paths)) {
+			debug("zygote invalidated by: %s", *paths);
+			zygote->invalid = 1;
+			break;
+		}
+
+	return zygote->invalid;
+}
+
+/* Internal function which sends fork request with the worker standard IO
+ * descriptors and command line arguments. The response (worker PID) is read
+ * by the ouroboros_zygote_dispatch() function. On success this function
+ * returns 0, otherwise -1. */
+static int _zygote_request(struct ouroboros_zygote *zygote,
+		const struct ouroboros_process *process) {
+
+	char cmsgbuf[CMSG_SPACE(sizeof(int) * 3)] = { 0 };
+	int fds[3] = { process->stdinfd[0], fileno(stdout), fileno(stderr) };
+	char **argv = process->argv;
+	struct msghdr msg = { 0 };
+	struct cmsghdr *cmsg;
+	struct iovec iov;
+	char buffer[4096];
+	size_t len;
+
+	if (process->outfd != -1)
+		fds[1] = fds[2] = process->outfd;
+
+	/* request: "FORK" followed by NUL-terminated arguments */
+	len = sprintf(buffer, "FORK") + 1;
+	for (; *argv != NULL; argv++) {
+		if (len + strlen(*argv) + 1 > sizeof(buffer)) {
+			fprintf(stderr, "error: zygote request too long\n");
+			return -1;
+		}
+		len += sprintf(&buffer[len], "%s", *argv) + 1;
+	}
+
+	iov.iov_base = buffer;
+	iov.iov_len = len;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cmsgbuf;
+	msg.msg_controllen = sizeof(cmsgbuf);
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int) * 3);
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * 3);
+
+	if (sendmsg(zygote->fd, &msg, MSG_NOSIGNAL) == -1)
+		return -1;
+
+	zygote->requests++;
+	return 0;
+}
+
+/* Ask zygote to fork new worker for the given process. The preloader is
+ * (re)started if it is not running or its state has been invalidated. The
+ * worker is attached to the process structure once the zygote replies -
+ * until then the process ID is set to 0. Upon error this function returns
+ * -1, otherwise 0. */
+int ouroboros_zygote_fork(struct ouroboros_zygote *zygote,
+		struct ouroboros_process *process) {
+
+	/* the previous worker is not needed anymore */
+	ouroboros_zygote_cancel(zygote);
+
+	process->pid = 0;
+	zygote->worker = process;
+	zygote->retried = 0;
+
+	if (zygote->invalid || zygote->fd == -1) {
+		_zygote_stop(zygote);
+		if (_zygote_start(zygote) == -1) {
+			zygote->worker = NULL;
+			fprintf(stderr, "error: unable to fork zygote worker\n");
+			return -1;
+		}
+	}
+
+	if (_zygote_request(zygote, process) == -1)
+		return ouroboros_zygote_retry(zygote);
+
+	return 0;
+}
+
+/* Cancel pending fork requests - e.g. the process has been killed before
+ * its worker was forked. */
+void ouroboros_zygote_cancel(struct ouroboros_zygote *zygote) {
+	zygote->canceled = zygote->requests;
+	zygote->worker = NULL;
+}
+
+/* Retry the pending fork request with the fresh zygote, because the current
+ * one has not answered (it might have died). The request is retried once.
+ * Upon error this function returns -1, otherwise 0. */
+int ouroboros_zygote_retry(struct ouroboros_zygote *zygote) {
+
+	struct ouroboros_process *process = zygote->worker;
+
+	_zygote_stop(zygote);
+	zygote->invalid = 1;
+
+	/* there is nobody waiting for the worker */
+	if (process == NULL)
+		return 0;
+
+	fprintf(stderr, "warning: zygote fork request failed\n");
+	if (zygote->retried++ || _zygote_start(zygote) == -1 ||
+			_zygote_request(zygote, process) == -1) {
+		zygote->worker = NULL;
+		fprintf(stderr, "error: unable to fork zygote worker\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Dispatch the zygote response. If the worker has been attached to the
+ * process given to the ouroboros_zygote_fork(), this function returns 1.
+ * If there is nothing to be done (yet), 0 is returned. Upon error this
+ * function returns -1. */
+int ouroboros_zygote_dispatch(struct ouroboros_zygote *zygote) {
+
+	struct ouroboros_process *process;
+	char buffer[32];
+	ssize_t len;
+	pid_t pid;
+
+	/* response: worker PID as a decimal number */
+	if ((len = recv(zygote->fd, buffer, sizeof(buffer) - 1, MSG_DONTWAIT)) == -1 &&
+			(errno == EAGAIN || errno == EINTR))
+		return 0;
+	if (len <= 0 || zygote->requests == 0) {
+		debug("zygote has closed the control socket");
+		return ouroboros_zygote_retry(zygote);
+	}
+
+	buffer[len] = '\0';
+	pid = atoi(buffer);
+	zygote->requests--;
+
+	if (zygote->canceled > 0) {
+		zygote->canceled--;
+		debug("killing canceled zygote worker: pid=%d", pid);
+		if (pid > 0)
+			kill(pid, zygote->process.signal);
+		return 0;
+	}
+
+	if ((process = zygote->worker) == NULL)
+		return 0;
+
+	zygote->worker = NULL;
+	if (pid <= 0 || attach_ouroboros_process(process, pid) == -1) {
+		fprintf(stderr, "error: unable to fork zygote worker\n");
+		return -1;
+	}
+
+	return 1;
+}
@@ -0,0 +1,57 @@
+/*
+ * ouroboros - zygote.h
+ * Copyright (c) 2015 Arkadiusz Bokowy
+ *
+ * This file is a part of a ouroboros.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#ifndef __ZYGOTE_H
+#define __ZYGOTE_H
+
+#include "notify.h"
+#include "process.h"
+
+
+/* environment variable with the control socket descriptor number */
+#define OUROBOROS_ZYGOTE_ENV "OUROBOROS_ZYGOTE_FD"
+
+/* the maximal time (in seconds) we will wait for the zygote response */
+#define OUROBOROS_ZYGOTE_TIMEOUT 30
+
+
+struct ouroboros_zygote {
+
+	/* preloader process */
+	struct ouroboros_process process;
+	/* control socket */
+	int fd;
+
+	/* Fork requests are answered asynchronously, because the preloader
+	 * might be still loading its dependencies. Replies to canceled requests
+	 * are discarded and their workers are killed right away. */
+	struct ouroboros_process *worker;
+	int requests;
+	int canceled;
+	int retried;
+
+	/* patterns which invalidate preloaded state */
+	struct ouroboros_notify_patterns invalidate;
+	int invalid;
+
+};
+
+
+struct ouroboros_zygote *ouroboros_zygote_init(char **argv, char **patterns);
+void ouroboros_zygote_free(struct ouroboros_zygote *zygote);
+
+int ouroboros_zygote_check(struct ouroboros_zygote *zygote, char **paths);
+int ouroboros_zygote_fork(struct ouroboros_zygote *zygote,
+		struct ouroboros_process *process);
+void ouroboros_zygote_cancel(struct ouroboros_zygote *zygote);
+int ouroboros_zygote_retry(struct ouroboros_zygote *zygote);
+int ouroboros_zygote_dispatch(struct ouroboros_zygote *zygote);
+
+#endif
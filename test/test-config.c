@@ -15,14 +15,64 @@ static const char *config_libconfig =
 	"watch-exclude = [\"^temp.txt$\"];\n"
 	"watch-dirs-only = true;\n"
 	"watch-files-only = true;\n"
+	"watch-verify-content = true;\n"
+	"watch-ignore-temp = false;\n"
+	"watch-write-timeout = 10.0;\n"
+	"watch-vcs-gate = true;\n"
+	"watch-remote-poll = false;\n"
+	"watch-follow-symlinks = false;\n"
 	"kill-latency = 5.5;\n"
 	"kill-signal = \"SIGINT\";\n"
 	"start-latency = 1.5;\n"
+	"ready-notify = true;\n"
+	"ready-port = 8000;\n"
+	"ready-pattern = \"^Listening\";\n"
+	"ready-timeout = 10.0;\n"
+	"watchdog-timeout = 5.0;\n"
+	"liveness-port = 8001;\n"
+	"liveness-idle = 120.0;\n"
+	"liveness-interval = 2.0;\n"
+	"recycle-memory = 524288;\n"
+	"recycle-lifetime = 3600.0;\n"
+	"crash-restart = true;\n"
+	"crash-backoff-min = 1.0;\n"
+	"crash-backoff-max = 10.0;\n"
+	"crash-restart-limit = 3;\n"
+	"crash-restart-window = 30.0;\n"
+	"zygote = [\"python3\", \"zygote.py\"];\n"
+	"zygote-invalidate = [\"\\\\.lock$\"];\n"
+	"start-on-demand = true;\n"
+	"idle-timeout = 60.0;\n"
 	"redirect-input = true;\n"
 	"redirect-output = \"/dev/null\";\n"
 	"redirect-signal = [\"SIGUSR1\"];\n"
+	"output-tee = true;\n"
+	"output-timestamps = true;\n"
+	"output-markers = true;\n"
+	"output-rotate-size = 1024;\n"
+	"output-rotate-count = 5;\n"
+	"output-buffer-size = 512;\n"
+	"output-dump = \"/tmp/dump.log\";\n"
 	"server-interface = \"eth0\";\n"
 	"server-port = 20202;\n"
+	"server-socket = \"/run/ouroboros.sock\";\n"
+	"agent-target = \"192.168.56.10:3945\";\n"
+	"fleet-peer = [ \"10.0.0.2\", \"10.0.0.3:4000\" ];\n"
+	"fleet-group = \"239.255.39.45\";\n"
+	"fleet-rate-limit = 5;\n"
+	"http-port = 9394;\n"
+	"proxy-port = 8080;\n"
+	"proxy-target-port = 8081;\n"
+	"proxy-hold-timeout = 2.5;\n"
+	"trace-file = \"/tmp/trace.json\";\n"
+	"services = ({\n"
+	"  name = \"api\";\n"
+	"  command = [\"./api\", \"--debug\"];\n"
+	"  watch-path = [\"services/api\"];\n"
+	"  kill-signal = \"SIGHUP\";\n"
+	"}, {\n"
+	"  command = [\"worker\"];\n"
+	"});\n"
 	"custom-test: {\n"
 	"  filename = \"test\";\n"
 	"  watch-files-only = false;\n"
@@ -65,19 +115,63 @@ static void test_default_values(void) {
 	assert(config.watch_update_nodes == 0);
 	assert(config.watch_dirs_only == 0);
 	assert(config.watch_files_only == 0);
+	assert(config.watch_verify_content == 0);
+	assert(config.watch_ignore_temp == 1);
+	assert(config.watch_write_timeout == 0.0);
+	assert(config.watch_vcs_gate == 0);
+	assert(config.watch_remote_poll == 1);
+	assert(config.watch_follow_symlinks == 1);
 	assert(config.watch_paths == NULL);
 	assert(config.watch_includes == NULL);
 	assert(config.watch_excludes == NULL);
 	assert(config.kill_signal == SIGTERM);
 	assert(config.kill_latency == 1.0);
 	assert(config.start_latency == 0.0);
+	assert(config.ready_notify == 0);
+	assert(config.ready_port == 0);
+	assert(config.ready_pattern == NULL);
+	assert(config.ready_timeout == 30.0);
+	assert(config.watchdog_timeout == 0.0);
+	assert(config.liveness_port == 0);
+	assert(config.liveness_idle == 0.0);
+	assert(config.liveness_interval == 1.0);
+	assert(config.recycle_memory == 0);
+	assert(config.recycle_lifetime == 0.0);
+	assert(config.crash_restart == 0);
+	assert(config.crash_backoff_min == 0.5);
+	assert(config.crash_backoff_max == 30.0);
+	assert(config.crash_restart_limit == 5);
+	assert(config.crash_restart_window == 60.0);
+	assert(config.zygote == NULL);
+	assert(config.zygote_invalidate == NULL);
+	assert(config.start_on_demand == 0);
+	assert(config.idle_timeout == 0.0);
 	assert(config.redirect_input == 0);
 	assert(config.redirect_output == NULL);
 	assert(config.redirect_signals == NULL);
+	assert(config.output_tee == 0);
+	assert(config.output_timestamps == 0);
+	assert(config.output_markers == 0);
+	assert(config.output_rotate_size == 0);
+	assert(config.output_rotate_count == 3);
+	assert(config.output_buffer_size == 0);
+	assert(config.output_dump == NULL);
 #if ENABLE_SERVER
 	assert(config.server_iface == NULL);
 	assert(config.server_port == 3945);
+	assert(config.server_socket == NULL);
+	assert(config.agent_target == NULL);
+	assert(config.fleet_peers == NULL);
+	assert(config.fleet_group == NULL);
+	assert(config.fleet_rate_limit == 10);
+	assert(config.http_port == 0);
 #endif
+	assert(config.proxy_port == 0);
+	assert(config.proxy_target_port == 0);
+	assert(config.proxy_hold_timeout == 30.0);
+	assert(config.trace_file == NULL);
+	assert(config.services == NULL);
+	assert(config.services_size == 0);
 
 	/* check freeing resources when nothing was loaded */
 	ouroboros_config_free(&config);
@@ -105,6 +199,12 @@ static void test_libconfig(void) {
 	assert(config.watch_dirs_only == 1);
 	/* this value is overwritten by the "custom" section */
 	assert(config.watch_files_only == 0);
+	assert(config.watch_verify_content == 1);
+	assert(config.watch_ignore_temp == 0);
+	assert(config.watch_write_timeout == 10.0);
+	assert(config.watch_vcs_gate == 1);
+	assert(config.watch_remote_poll == 0);
+	assert(config.watch_follow_symlinks == 0);
 	assert(strcmp(config.watch_paths[0], "/tmp") == 0);
 	assert(strcmp(config.watch_paths[1], "/var/lib/") == 0);
 	assert(config.watch_paths[2] == NULL);
@@ -116,24 +216,93 @@ static void test_libconfig(void) {
 	assert(config.kill_signal == SIGINT);
 	assert(config.kill_latency == 5.5);
 	assert(config.start_latency == 1.5);
+	assert(config.ready_notify == 1);
+	assert(config.ready_port == 8000);
+	assert(strcmp(config.ready_pattern, "^Listening") == 0);
+	assert(config.ready_timeout == 10.0);
+	assert(config.watchdog_timeout == 5.0);
+	assert(config.liveness_port == 8001);
+	assert(config.liveness_idle == 120.0);
+	assert(config.liveness_interval == 2.0);
+	assert(config.recycle_memory == 524288);
+	assert(config.recycle_lifetime == 3600.0);
+	assert(config.crash_restart == 1);
+	assert(config.crash_backoff_min == 1.0);
+	assert(config.crash_backoff_max == 10.0);
+	assert(config.crash_restart_limit == 3);
+	assert(config.crash_restart_window == 30.0);
+	assert(strcmp(config.zygote[0], "python3") == 0);
+	assert(strcmp(config.zygote[1], "zygote.py") == 0);
+	assert(config.zygote[2] == NULL);
+	assert(strcmp(config.zygote_invalidate[0], "\\.lock$") == 0);
+	assert(config.zygote_invalidate[1] == NULL);
+	assert(config.start_on_demand == 1);
+	assert(config.idle_timeout == 60.0);
 	assert(config.redirect_input == 1);
 	assert(strcmp(config.redirect_output, "/dev/null") == 0);
 	assert(config.redirect_signals[0] == SIGUSR1);
 	assert(config.redirect_signals[1] == 0);
+	assert(config.output_tee == 1);
+	assert(config.output_timestamps == 1);
+	assert(config.output_markers == 1);
+	assert(config.output_rotate_size == 1024);
+	assert(config.output_rotate_count == 5);
+	assert(config.output_buffer_size == 512);
+	assert(strcmp(config.output_dump, "/tmp/dump.log") == 0);
 #if ENABLE_SERVER
 	assert(strcmp(config.server_iface, "eth0") == 0);
 	assert(config.server_port == 20202);
+	assert(strcmp(config.server_socket, "/run/ouroboros.sock") == 0);
+	assert(strcmp(config.agent_target, "192.168.56.10:3945") == 0);
+	assert(strcmp(config.fleet_peers[0], "10.0.0.2") == 0);
+	assert(strcmp(config.fleet_peers[1], "10.0.0.3:4000") == 0);
+	assert(config.fleet_peers[2] == NULL);
+	assert(strcmp(config.fleet_group, "239.255.39.45") == 0);
+	assert(config.fleet_rate_limit == 5);
+	assert(config.http_port == 9394);
 #endif
+	assert(config.proxy_port == 8080);
+	assert(config.proxy_target_port == 8081);
+	assert(config.proxy_hold_timeout == 2.5);
+	assert(strcmp(config.trace_file, "/tmp/trace.json") == 0);
+	assert(config.services_size == 2);
+	assert(strcmp(config.services[0].name, "api") == 0);
+	assert(strcmp(config.services[0].command[0], "./api") == 0);
+	assert(strcmp(config.services[0].command[1], "--debug") == 0);
+	assert(config.services[0].command[2] == NULL);
+	assert(strcmp(config.services[0].watch_paths[0], "services/api") == 0);
+	assert(config.services[0].watch_paths[1] == NULL);
+	assert(config.services[0].kill_signal == SIGHUP);
+	assert(strcmp(config.services[1].name, "worker") == 0);
+	assert(config.services[1].watch_paths == NULL);
+	/* inherited settings are resolved after command line options */
+	assert(config.services[1].kill_signal == 0);
+	assert(config.services[1].start_latency < 0);
+	config.start_latency = 4.0;
+	ouroboros_config_inherit(&config);
+	assert(config.services[0].kill_signal == SIGHUP);
+	assert(config.services[0].kill_latency == 5.5);
+	assert(config.services[1].kill_signal == SIGINT);
+	assert(config.services[1].start_latency == 4.0);
 
 	ouroboros_config_free(&config);
 
 	assert(config.watch_paths == NULL);
 	assert(config.watch_includes == NULL);
 	assert(config.watch_excludes == NULL);
+	assert(config.zygote == NULL);
+	assert(config.zygote_invalidate == NULL);
 	assert(config.redirect_output == NULL);
 	assert(config.redirect_signals == NULL);
+	assert(config.output_dump == NULL);
+	assert(config.services == NULL);
+	assert(config.services_size == 0);
 #if ENABLE_SERVER
 	assert(config.server_iface == NULL);
+	assert(config.server_socket == NULL);
+	assert(config.agent_target == NULL);
+	assert(config.fleet_peers == NULL);
+	assert(config.fleet_group == NULL);
 #endif
 
 #endif /* ENABLE_LIBCONFIG */
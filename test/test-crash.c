@@ -0,0 +1,78 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#include "../src/crash.c"
+
+/* Check whether the delay is within the equal jitter bounds. */
+static int jittered(double delay, double expected) {
+	return delay >= expected / 2 && delay <= expected;
+}
+
+static void test_backoff(void) {
+
+	static const double delays[] = { 1, 2, 4, 8, 8, 8 };
+	struct ouroboros_crash crash;
+	size_t i;
+
+	ouroboros_crash_init(&crash, 100, 60, 1, 8);
+
+	/* delay grows exponentially up to the maximum */
+	for (i = 0; i < sizeof(delays) / sizeof(*delays); i++)
+		assert(jittered(ouroboros_crash_record(&crash, 1 << 8, 0.1), delays[i]));
+
+	/* long-running process starts the backoff from the beginning */
+	assert(jittered(ouroboros_crash_record(&crash, 1 << 8, 10), 1));
+	assert(jittered(ouroboros_crash_record(&crash, 1 << 8, 0.1), 2));
+
+	ouroboros_crash_reset(&crash);
+	assert(jittered(ouroboros_crash_record(&crash, 1 << 8, 0.1), 1));
+
+	/* maximum delay below the minimum one is raised */
+	ouroboros_crash_init(&crash, 100, 60, 2, 1);
+	assert(jittered(ouroboros_crash_record(&crash, 1 << 8, 0.1), 2));
+	assert(jittered(ouroboros_crash_record(&crash, 1 << 8, 0.1), 2));
+
+}
+
+static void test_limit(void) {
+
+	struct ouroboros_crash crash;
+
+	ouroboros_crash_init(&crash, 3, 3600, 0.1, 1);
+
+	assert(ouroboros_crash_record(&crash, 1 << 8, 0.1) >= 0);
+	assert(ouroboros_crash_record(&crash, 1 << 8, 0.1) >= 0);
+	assert(ouroboros_crash_record(&crash, 1 << 8, 0.1) >= 0);
+	assert(ouroboros_crash_record(&crash, 1 << 8, 0.1) == -1);
+
+}
+
+static void test_history(void) {
+
+	struct ouroboros_crash crash;
+	int i;
+
+	assert(ouroboros_crash_is_failure(0) == 0);
+	assert(ouroboros_crash_is_failure(1 << 8) == 1);
+	assert(ouroboros_crash_is_failure(SIGKILL) == 1);
+
+	ouroboros_crash_init(&crash, 100, 60, 0, 0);
+	assert(ouroboros_crash_history(&crash, 0) == NULL);
+
+	for (i = 0; i < OUROBOROS_CRASH_HISTORY + 2; i++)
+		ouroboros_crash_record(&crash, i << 8, i);
+
+	assert(ouroboros_crash_history(&crash, 0)->status == (OUROBOROS_CRASH_HISTORY + 1) << 8);
+	assert(ouroboros_crash_history(&crash, OUROBOROS_CRASH_HISTORY - 1)->status == 2 << 8);
+	assert(ouroboros_crash_history(&crash, OUROBOROS_CRASH_HISTORY) == NULL);
+
+}
+
+int main(void) {
+	test_backoff();
+	test_limit();
+	test_history();
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,115 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../src/digest.c"
+
+static void test_hash(void) {
+
+	static const char *text = "Nobody inspects the spammish repetition";
+	unsigned char data[1000];
+	struct _hash_state state;
+	size_t i, n;
+
+	/* reference vectors of the XXH64 */
+	assert(ouroboros_digest_hash(0, "", 0) == 0xEF46DB3751D8E999ULL);
+	assert(ouroboros_digest_hash(0, "a", 1) == 0xD24EC4F1A98C6E5BULL);
+	assert(ouroboros_digest_hash(0, "abc", 3) == 0x44BC2CF5AD770999ULL);
+	assert(ouroboros_digest_hash(0, text, strlen(text)) == 0xFBCEA83C8A378BF1ULL);
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = i * 7;
+
+	/* streamed data gives the same hash regardless of the chunk size */
+	for (n = 1; n < 70; n++) {
+		_hash_init(&state, 42);
+		for (i = 0; i < sizeof(data); i += n)
+			_hash_update(&state, &data[i], i + n < sizeof(data) ? n : sizeof(data) - i);
+		assert(_hash_final(&state) == ouroboros_digest_hash(42, data, sizeof(data)));
+	}
+
+	assert(ouroboros_digest_hash(0, data, sizeof(data)) !=
+			ouroboros_digest_hash(1, data, sizeof(data)));
+
+}
+
+/* Write given content to the file. */
+static void write_file(const char *path, const char *content) {
+	FILE *f;
+	assert((f = fopen(path, "w")) != NULL);
+	fputs(content, f);
+	fclose(f);
+}
+
+/* Set the modification time of the file to the given time. */
+static void touch_file(const char *path, const struct timespec *mtime) {
+	struct timespec times[2] = { *mtime, *mtime };
+	assert(utimensat(AT_FDCWD, path, times, 0) == 0);
+}
+
+static void test_verify(void) {
+
+	struct ouroboros_digest digest = { 0 };
+	char path1[] = "/tmp/test-digest-XXXXXX";
+	char path2[] = "/tmp/test-digest-XXXXXX";
+	struct timespec past = { time(NULL) - 60, 0 };
+	off_t budget = 1024;
+	struct stat s;
+	int fd;
+
+	assert((fd = mkstemp(path1)) != -1);
+	close(fd);
+	assert((fd = mkstemp(path2)) != -1);
+	close(fd);
+
+	write_file(path1, "content");
+	write_file(path2, "content");
+	touch_file(path1, &past);
+	touch_file(path2, &past);
+
+	/* the first change is always reported */
+	assert(ouroboros_digest_verify(&digest, path1, &budget) == 1);
+	assert(ouroboros_digest_verify(&digest, path2, &budget) == 1);
+	assert(digest.size == 2);
+	assert(budget == 1024 - 2 * 7);
+
+	/* unchanged metadata is not hashed again */
+	assert(ouroboros_digest_verify(&digest, path1, &budget) == 0);
+	assert(budget == 1024 - 2 * 7);
+
+	write_file(path1, "content");
+	assert(ouroboros_digest_verify(&digest, path1, &budget) == 0);
+	write_file(path1, "changed!");
+	assert(ouroboros_digest_verify(&digest, path1, &budget) == 1);
+
+	/* recently modified file is hashed again, because it might have been
+	 * modified within the timestamp granularity (racy-clean file) */
+	assert(stat(path1, &s) == 0);
+	write_file(path1, "changed?");
+	touch_file(path1, &s.st_mtim);
+	assert(ouroboros_digest_verify(&digest, path1, &budget) == 1);
+	assert(ouroboros_digest_verify(&digest, path1, &budget) == 0);
+
+	/* change is assumed if the budget does not suffice */
+	budget = 6;
+	write_file(path2, "content2");
+	assert(ouroboros_digest_verify(&digest, path2, &budget) == 1);
+	assert(budget == 6);
+	assert(digest.size == 1);
+
+	unlink(path1);
+	assert(ouroboros_digest_verify(&digest, path1, &budget) == 1);
+	assert(digest.size == 0);
+
+	unlink(path2);
+	ouroboros_digest_free(&digest);
+}
+
+int main(void) {
+	test_hash();
+	test_verify();
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,90 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/metrics.c"
+
+static void test_bounds(void) {
+
+	int i;
+
+	assert(_bucket_bound(0) == 1.25 / 1024);
+	assert(_bucket_bound(OUROBOROS_METRICS_SUB_BUCKETS - 1) == 2.0 / 1024);
+	assert(_bucket_bound(OUROBOROS_METRICS_SUB_BUCKETS) == 2.5 / 1024);
+	assert(_bucket_bound(OUROBOROS_METRICS_BUCKETS - 1) == 128);
+
+	/* bounds are strictly increasing */
+	for (i = 1; i < OUROBOROS_METRICS_BUCKETS; i++)
+		assert(_bucket_bound(i - 1) < _bucket_bound(i));
+
+}
+
+static void test_observe(void) {
+
+	struct ouroboros_metrics_histogram histogram;
+	double bound;
+	int i;
+
+	/* value equal to the bucket bound is accounted in that bucket */
+	for (i = 0; i < OUROBOROS_METRICS_BUCKETS; i++) {
+		memset(&histogram, 0, sizeof(histogram));
+		ouroboros_metrics_observe(&histogram, bound = _bucket_bound(i));
+		assert(histogram.buckets[i] == 1);
+		if (i + 1 < OUROBOROS_METRICS_BUCKETS) {
+			ouroboros_metrics_observe(&histogram, bound * 1.001);
+			assert(histogram.buckets[i + 1] == 1);
+		}
+	}
+
+	memset(&histogram, 0, sizeof(histogram));
+
+	/* values below the range are accounted in the first bucket */
+	ouroboros_metrics_observe(&histogram, 0);
+	ouroboros_metrics_observe(&histogram, 1.0 / 1024);
+	assert(histogram.buckets[0] == 2);
+
+	ouroboros_metrics_observe(&histogram, 0.75);
+	assert(histogram.buckets[9 * OUROBOROS_METRICS_SUB_BUCKETS + 1] == 1);
+
+	/* values above the range are accounted in the count only */
+	ouroboros_metrics_observe(&histogram, 129);
+	for (i = 1; i < OUROBOROS_METRICS_BUCKETS; i++)
+		assert(histogram.buckets[i] == (i == 9 * OUROBOROS_METRICS_SUB_BUCKETS + 1));
+	assert(histogram.count == 4);
+	assert(histogram.sum == 0 + 1.0 / 1024 + 0.75 + 129);
+
+}
+
+static void test_print(void) {
+
+	struct ouroboros_metrics_histogram histogram = { 0 };
+	char *buffer;
+	size_t size;
+	FILE *f;
+
+	ouroboros_metrics_observe(&histogram, 0.5);
+	ouroboros_metrics_observe(&histogram, 1);
+	ouroboros_metrics_observe(&histogram, 200);
+
+	assert((f = open_memstream(&buffer, &size)) != NULL);
+	ouroboros_metrics_print_histogram(f, "latency", "Latency", &histogram);
+	fclose(f);
+
+	assert(strncmp(buffer, "# HELP latency Latency\n# TYPE latency histogram\n", 47) == 0);
+	assert(strstr(buffer, "latency_bucket{le=\"0.4375\"} 0\n") != NULL);
+	assert(strstr(buffer, "latency_bucket{le=\"0.5\"} 1\n") != NULL);
+	assert(strstr(buffer, "latency_bucket{le=\"1\"} 2\n") != NULL);
+	assert(strstr(buffer, "latency_bucket{le=\"128\"} 2\n") != NULL);
+	assert(strstr(buffer, "latency_bucket{le=\"+Inf\"} 3\n") != NULL);
+	assert(strstr(buffer, "latency_sum 201.5\nlatency_count 3\n") != NULL);
+
+	free(buffer);
+}
+
+int main(void) {
+	test_bounds();
+	test_observe();
+	test_print();
+	return EXIT_SUCCESS;
+}
@@ -42,5 +42,128 @@ function test_ouroboros_watch {
 	fi
 }
 
+# Test that the watch of a single file given relatively to the current
+# directory (with and without the leading dot) is re-armed after the file has been replaced by the rename
+# (atomic save) - so the subsequent modification is noticed as well.
+function test_ouroboros_atomic_save {
+
+	TEMPDIR=`mktemp -d`
+	PRJ=$TEMPDIR/project
+	LOG=$TEMPDIR/project.log
+	BIN=$(realpath $OUROBOROS)
+
+	tar -xzpf $PROJECT -C $TEMPDIR
+	cp $PRJ/src/main.c $PRJ/src/common.h $PRJ
+
+	(cd $PRJ && exec $BIN -E inotify -p ./main.c -p common.h -l 0.2 -- pwd) >$LOG &
+	PID=$!
+
+	sleep 0.5
+	echo "* mv $PRJ/common.h~ $PRJ/common.h"
+	cp $PRJ/common.h $PRJ/common.h~
+	mv $PRJ/common.h~ $PRJ/common.h
+	sleep 0.5
+	echo "* touch $PRJ/common.h"
+	touch $PRJ/common.h
+	sleep 0.5
+	echo "* mv $PRJ/main.c~ $PRJ/main.c"
+	cp $PRJ/main.c $PRJ/main.c~
+	mv $PRJ/main.c~ $PRJ/main.c
+	sleep 0.5
+	echo "* touch $PRJ/main.c"
+	touch $PRJ/main.c
+	sleep 0.5
+
+	RETVAL=$(grep -c $PRJ $LOG)
+
+	kill -9 $PID
+	rm -r $TEMPDIR
+
+	if [ $RETVAL != 5 ]; then
+		return 1
+	fi
+}
+
+# Test that the symbolic link loop does not stall the scan, and that the
+# location given many times (also nested in the recursive mode) is watched
+# once. This function takes engine type as its first argument.
+function test_ouroboros_watch_once {
+
+	TEMPDIR=`mktemp -d`
+	PRJ=$TEMPDIR/project
+	LOG=$TEMPDIR/project.log
+
+	tar -xzpf $PROJECT -C $TEMPDIR
+	ln -s .. $PRJ/src/loop
+
+	$OUROBOROS -v -E $1 -p $PRJ -p $PRJ/src -p $PRJ/ -r true -l 0.2 -- pwd >$LOG 2>&1 &
+	PID=$!
+
+	sleep 0.5
+	echo "* touch $PRJ/src/main.c"
+	touch $PRJ/src/main.c
+	sleep 1
+
+	RETVAL=$(grep -cx $PWD $LOG)
+	WATCHED=$(grep -c "^Watching with" $LOG)
+
+	kill -9 $PID
+	rm -r $TEMPDIR
+
+	if [ $RETVAL != 2 ] || [ $WATCHED != 1 ]; then
+		return 1
+	fi
+}
+
+# Test built-in TCP proxy - the request is relayed to the supervised process
+# and the request sent while the process is being restarted is held until
+# the new instance accepts connections.
+function test_ouroboros_proxy {
+
+	# the supervised HTTP server is provided by the Python
+	which python3 >/dev/null || return 0
+
+	TEMPDIR=`mktemp -d`
+	PRJ=$TEMPDIR/project
+	LOG=$TEMPDIR/project.log
+
+	tar -xzpf $PROJECT -C $TEMPDIR
+
+	$OUROBOROS -v -p $PRJ/src -l 0.2 --proxy-port=38461 --proxy-target-port=38462 -- \
+		sh -c "sleep 0.5; exec python3 -m http.server 38462 --bind 127.0.0.1 --directory $PRJ" \
+		>$LOG 2>&1 &
+	PID=$!
+
+	# send GET request via the proxy with the bash built-in TCP client
+	function proxy_get {
+		exec 3<>/dev/tcp/127.0.0.1/38461 || return
+		printf "GET $1 HTTP/1.0\r\n\r\n" >&3
+		cat <&3
+		exec 3<&-
+	}
+
+	sleep 1
+	echo "* GET /etc/project.conf"
+	RELAYED=$(proxy_get /etc/project.conf | grep -c "^# Configuration")
+	echo "* touch $PRJ/src/main.c"
+	touch $PRJ/src/main.c
+	sleep 0.4
+	echo "* GET /etc/project.conf (held)"
+	HELD=$(proxy_get /etc/project.conf | grep -c "^# Configuration")
+	STARTS=$(grep -c "^Running command" $LOG)
+
+	kill -9 $PID
+	pkill -9 -f "http.server 38462"
+	rm -r $TEMPDIR
+
+	if [ $RELAYED != 1 ] || [ $HELD != 1 ] || [ $STARTS != 2 ]; then
+		return 1
+	fi
+}
+
 test_ouroboros_watch pool || exit 1
 test_ouroboros_watch inotify || exit 1
+test_ouroboros_watch_once poll || exit 1
+test_ouroboros_watch_once inotify || exit 1
+test_ouroboros_atomic_save || exit 1
+test_ouroboros_proxy || exit 1
@@ -0,0 +1,175 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#include "../src/server.c"
+
+/* Send given request to the server and dispatch it. */
+static int dispatch(struct ouroboros_server *server, const char *request) {
+
+	int fds[2];
+	int rv;
+
+	assert(socketpair(AF_UNIX, SOCK_DGRAM, 0, fds) == 0);
+	assert(send(fds[1], request, strlen(request), 0) == (ssize_t)strlen(request));
+	rv = ouroboros_server_dispatch(server, fds[0]);
+
+	close(fds[0]);
+	close(fds[1]);
+	return rv;
+}
+
+static void test_dispatch(void) {
+
+	struct ouroboros_server *server;
+	struct ouroboros_server_command *commands;
+	char request[256];
+	int i;
+
+	assert((server = ouroboros_server_init(NULL, 0, NULL, NULL)) != NULL);
+	commands = server->commands;
+
+	/* commands are separated by new lines or semicolons */
+	assert(dispatch(server, "pause; stats\nrestart  api\r\n") == 3);
+	assert(commands[0].request == OSR_PAUSE);
+	assert(commands[0].args[0] == NULL);
+	assert(commands[1].request == OSR_STATS);
+	assert(commands[2].request == OSR_RESTART);
+	assert(strcmp(commands[2].args[0], "api") == 0);
+	assert(commands[2].args[1] == NULL);
+
+	/* legacy name and empty commands */
+	assert(dispatch(server, ";;reload\n\n") == 1);
+	assert(commands[0].request == OSR_RESTART);
+	assert(strcmp(commands[0].name, "reload") == 0);
+
+	/* arguments above the limit are ignored */
+	assert(dispatch(server, "signal SIGHUP api extra") == 1);
+	assert(commands[0].request == OSR_SIGNAL);
+	assert(strcmp(commands[0].args[0], "SIGHUP") == 0);
+	assert(strcmp(commands[0].args[1], "api") == 0);
+
+	/* changed path is taken verbatim */
+	assert(dispatch(server, "change  src/my file.c\r\nchange\nstatus") == 3);
+	assert(commands[0].request == OSR_CHANGE);
+	assert(strcmp(commands[0].args[0], "src/my file.c") == 0);
+	assert(commands[1].request == OSR_CHANGE);
+	assert(commands[1].args[0] == NULL);
+	assert(commands[2].request == OSR_STATUS);
+
+	/* subcommand is consumed */
+	assert(dispatch(server, "watch add /tmp/x; watch remove lib; watch list") == 3);
+	assert(commands[0].request == OSR_WATCH_ADD);
+	assert(strcmp(commands[0].args[0], "/tmp/x") == 0);
+	assert(commands[0].args[1] == NULL);
+	assert(commands[1].request == OSR_WATCH_REMOVE);
+	assert(strcmp(commands[1].args[0], "lib") == 0);
+	assert(commands[2].request == OSR_UNKNOWN);
+
+	assert(dispatch(server, "event host 12 10\nchange a") == 2);
+	assert(commands[0].request == OSR_EVENT);
+	assert(strcmp(commands[0].args[0], "host") == 0);
+	assert(strcmp(commands[0].args[1], "12") == 0);
+	assert(strcmp(commands[0].args[2], "10") == 0);
+
+	assert(dispatch(server, "unknown") == 1);
+	assert(commands[0].request == OSR_UNKNOWN);
+
+	/* commands above the limit are dropped */
+	for (request[0] = '\0', i = 0; i < OUROBOROS_SERVER_COMMANDS + 2; i++)
+		strcat(request, "stats;");
+	assert(dispatch(server, request) == OUROBOROS_SERVER_COMMANDS);
+
+	ouroboros_server_free(server);
+}
+
+static void test_event_window(void) {
+
+	struct ouroboros_server *server;
+	char seq[16];
+	int i;
+
+	assert((server = ouroboros_server_init(NULL, 0, NULL, NULL)) != NULL);
+
+	/* malformed headers */
+	assert(ouroboros_server_event(server, NULL, "1", NULL) == 0);
+	assert(ouroboros_server_event(server, "host", NULL, NULL) == 0);
+	assert(ouroboros_server_event(server, "host", "0", NULL) == 0);
+	assert(ouroboros_server_event(server, "host", "1x", NULL) == 0);
+	assert(ouroboros_server_event(server, "host", "1", "2") == 0);
+	assert(ouroboros_server_event(server, "0123456789abcdef0", "1", NULL) == 0);
+
+	assert(ouroboros_server_event(server, "host", "1", NULL) == 1);
+	assert(ouroboros_server_event(server, "host", "1", NULL) == 0);
+	assert(ouroboros_server_event(server, "other", "1", NULL) == 1);
+
+	/* reordered events are not duplicates */
+	assert(ouroboros_server_event(server, "host", "4", NULL) == 1);
+	assert(ouroboros_server_event(server, "host", "3", NULL) == 1);
+	assert(ouroboros_server_event(server, "host", "2", NULL) == 1);
+	assert(ouroboros_server_event(server, "host", "3", NULL) == 0);
+
+	/* events older than the window are dropped */
+	assert(ouroboros_server_event(server, "host", "68", NULL) == 1);
+	assert(ouroboros_server_event(server, "host", "4", NULL) == 0);
+	assert(ouroboros_server_event(server, "host", "5", NULL) == 1);
+	assert(ouroboros_server_event(server, "host", "5", NULL) == 0);
+	assert(ouroboros_server_event(server, "host", "68", NULL) == 0);
+
+	/* big jump forward clears the window */
+	assert(ouroboros_server_event(server, "host", "1000", NULL) == 1);
+	assert(ouroboros_server_event(server, "host", "999", NULL) == 1);
+
+	/* the oldest peer is replaced when the list is full */
+	for (i = 0; i < OUROBOROS_SERVER_PEERS; i++) {
+		sprintf(seq, "peer%d", i);
+		assert(ouroboros_server_event(server, seq, "1", NULL) == 1);
+	}
+	assert(server->peers_size == OUROBOROS_SERVER_PEERS);
+
+	ouroboros_server_free(server);
+}
+
+static void test_event_rate_limit(void) {
+
+	struct ouroboros_server *server;
+	char origin[16];
+	time_t second;
+	int rv[7];
+	int i = 0;
+
+	assert((server = ouroboros_server_init(NULL, 0, NULL, NULL)) != NULL);
+	server->rate_limit = 2;
+
+	/* the limit is per second, so repeat the check if the second passed */
+	do {
+		second = time(NULL);
+		sprintf(origin, "host%d", i++);
+		/* datagrams of one flush count as a single event */
+		rv[0] = ouroboros_server_event(server, origin, "1", "1");
+		rv[1] = ouroboros_server_event(server, origin, "3", "1");
+		rv[2] = ouroboros_server_event(server, origin, "2", "1");
+		rv[3] = ouroboros_server_event(server, origin, "4", NULL);
+		/* the whole flush exceeding the limit is dropped */
+		rv[4] = ouroboros_server_event(server, origin, "5", "5");
+		rv[5] = ouroboros_server_event(server, origin, "6", "5");
+		rv[6] = ouroboros_server_event(server, origin, "6", "5");
+	} while (second != time(NULL));
+
+	assert(rv[0] == 1 && rv[1] == 1 && rv[2] == 1 && rv[3] == 1);
+	assert(rv[4] == -1 && rv[5] == -1);
+	assert(rv[6] == 0);
+
+	ouroboros_server_free(server);
+}
+
+int main(void) {
+	test_dispatch();
+	test_event_window();
+	test_event_rate_limit();
+	return EXIT_SUCCESS;
+}